@@ -121,6 +121,9 @@ namespace mongo {
             kc += b->fullValidate(nextChild, order);
         }
 
+        if ( flags & Counted )
+            massert( 13128 , "btree subtree count is wrong" , _count == kc );
+
         return kc;
     }
 
@@ -194,7 +197,7 @@ namespace mongo {
         n = 0;
         emptySize = totalDataSize();
         topSize = 0;
-        reserved = 0;
+        _count = 0;
     }
 
     /* see _alloc */
@@ -557,6 +560,14 @@ found:
 
     int qqq = 0;
 
+    /* what an insert into a counted index did, for bt_insert() to fix the counts after.
+       we hold the write lock. */
+    static vector< DiskLoc > countedSplits;
+    static DiskLoc countedInsertLoc;
+
+    /* the bucket the last _insert() put its new key in, for bt_insertSorted() */
+    static DiskLoc lastInsertLoc;
+
     /* remove a key from the index */
     bool BtreeBucket::unindex(const DiskLoc& thisLoc, IndexDetails& id, BSONObj& key, const DiskLoc& recordLoc ) {
         if ( key.objsize() > KeyMax ) {
@@ -568,7 +579,10 @@ found:
         bool found;
         DiskLoc loc = locate(id, thisLoc, key, id.keyPattern(), pos, found, recordLoc, 1);
         if ( found ) {
-            loc.btree()->delKeyAtPos(loc, id, pos);
+            BtreeBucket *b = loc.btree();
+            if ( b->isCounted() && b->k(pos).isUsed() )
+                adjustCounts(loc, -1);
+            b->delKeyAtPos(loc, id, pos);
             return true;
         }
         return false;
@@ -611,6 +625,8 @@ found:
         DiskLoc oldLoc = thisLoc;
 
         if ( basicInsert(thisLoc, keypos, recordLoc, key, order) ) {
+            if ( isCounted() && rchild.isNull() )
+                countedInsertLoc = thisLoc; // the new key, rather than one promoted by a split
             _KeyNode& kn = k(keypos);
             if ( keypos+1 == n ) { // last key
                 if ( nextChild != lchild ) {
@@ -674,6 +690,10 @@ found:
 
         DiskLoc rLoc = addBucket(idx);
         BtreeBucket *r = rLoc.btreemod();
+        if ( isCounted() ) {
+            countedSplits.push_back(thisLoc);
+            countedSplits.push_back(rLoc);
+        }
         if ( split_debug )
             out() << "     split:" << split << ' ' << keyNode(split).key.toString() << " n:" << n << endl;
         for ( int i = split+1; i < n; i++ ) {
@@ -703,6 +723,8 @@ found:
                 p->pushBack(splitkey.recordLoc, splitkey.key, order, thisLoc);
                 p->nextChild = rLoc;
                 p->assertValid( order );
+                if ( p->isCounted() )
+                    countedSplits.push_back(L);
                 parent = idx.head = L;
                 if ( split_debug )
                     out() << "    we were root, making new root:" << hex << parent.getOfs() << dec << endl;
@@ -743,6 +765,8 @@ found:
         DiskLoc loc = btreeStore->insert(id.indexNamespace().c_str(), 0, BucketSize, true);
         BtreeBucket *b = loc.btreemod();
         b->init();
+        if ( id.counted() )
+            b->flags |= Counted;
         return loc;
     }
 
@@ -856,6 +880,9 @@ found:
                 massert( 10285 , "_insert: reuse key but lchild is not null", lChild.isNull());
                 massert( 10286 , "_insert: reuse key but rchild is not null", rChild.isNull());
                 kn.setUsed();
+                if ( isCounted() )
+                    countedInsertLoc = thisLoc;
+                lastInsertLoc = thisLoc;
                 return 0;
             }
 
@@ -875,6 +902,8 @@ found:
         if ( insert_debug )
             out() << "    getChild(" << pos << "): " << child.toString() << endl;
         if ( child.isNull() || !rChild.isNull() /* means an 'internal' insert */ ) {
+            if ( rChild.isNull() )
+                lastInsertLoc = thisLoc; // a split may move the key on, but this bucket stays in the path
             insertHere(thisLoc, pos, recordLoc, key, order, lChild, rChild, idx);
             return 0;
         }
@@ -908,15 +937,174 @@ found:
             }
         }
 
+        bool counted = toplevel && isCounted();
+        if ( counted ) {
+            countedSplits.clear();
+            countedInsertLoc.Null();
+        }
+
         int x = _insert(thisLoc, recordLoc, key, order, dupsAllowed, DiskLoc(), DiskLoc(), idx);
         assertValid( order );
 
+        if ( counted && x == 0 )
+            fixCounts();
+
         return x;
     }
 
+    /* key:recordLoc against a key node, in the order find() uses */
+    static int compareKeyLoc(const BSONObj& key, const DiskLoc& recordLoc, const KeyNode& kn, const BSONObj& order) {
+        int x = key.woCompare(kn.key, order);
+        if ( x )
+            return x;
+        DiskLoc rl = kn.recordLoc;
+        rl.GETOFS() &= ~1;
+        return recordLoc.compare(rl);
+    }
+
+    /* if a key in bucket prev is before the new key, and the new key is before the last key of
+       some bucket on the path from prev up to the root, the new key's place is in that bucket's
+       subtree - so insert from there.
+    */
+    void BtreeBucket::bt_insertSorted(IndexDetails& idx, const vector< pair< BSONObj, DiskLoc > >& keys, bool dupsAllowed) {
+        BSONObj order = idx.keyPattern();
+        DiskLoc prev;
+        for ( unsigned i = 0; i < keys.size(); i++ ) {
+            const BSONObj& key = keys[i].first;
+            const DiskLoc& recordLoc = keys[i].second;
+            DiskLoc start = idx.head;
+            if ( !prev.isNull() && prev.btree()->n > 0 && compareKeyLoc(key, recordLoc, prev.btree()->keyNode(0), order) > 0 ) {
+                for ( DiskLoc a = prev; !a.isNull(); a = a.btree()->parent ) {
+                    BtreeBucket *b = a.btree();
+                    if ( b->n > 0 && compareKeyLoc(key, recordLoc, b->keyNode(b->n - 1), order) < 0 ) {
+                        start = a;
+                        break;
+                    }
+                }
+            }
+            lastInsertLoc.Null();
+            start.btree()->bt_insert(start, recordLoc, key, order, dupsAllowed, idx);
+            prev = lastInsertLoc;
+        }
+    }
+
     void BtreeBucket::shape(stringstream& ss) {
         _shape(0, ss);
     }
+
+    int BtreeBucket::subtreeCount() const {
+        int c = 0;
+        for ( int i = 0; i < n; i++ ) {
+            if ( k(i).isUsed() )
+                c++;
+            if ( !k(i).prevChildBucket.isNull() )
+                c += k(i).prevChildBucket.btree()->_count;
+        }
+        if ( !nextChild.isNull() )
+            c += nextChild.btree()->_count;
+        return c;
+    }
+
+    void BtreeBucket::adjustCounts(const DiskLoc& thisLoc, int delta) {
+        for ( DiskLoc loc = thisLoc; !loc.isNull(); loc = loc.btree()->parent )
+            loc.btreemod()->_count += delta;
+    }
+
+    /* after an insert into a counted index.  without a split, the new key adds one to each bucket
+       up to the root.  splits move keys and children around, so the split buckets and everything
+       above them are summed again from their children, deepest first.
+    */
+    void BtreeBucket::fixCounts() {
+        if ( countedSplits.empty() ) {
+            if ( !countedInsertLoc.isNull() )
+                adjustCounts(countedInsertLoc, 1);
+            return;
+        }
+
+        set< DiskLoc > seen;
+        vector< pair< int, DiskLoc > > todo;
+        for ( vector< DiskLoc >::const_iterator i = countedSplits.begin(); i != countedSplits.end(); ++i ) {
+            for ( DiskLoc loc = *i; !loc.isNull() && seen.insert(loc).second; loc = loc.btree()->parent ) {
+                int depth = 0;
+                for ( DiskLoc p = loc.btree()->parent; !p.isNull(); p = p.btree()->parent )
+                    depth++;
+                todo.push_back( make_pair( -depth, loc ) );
+            }
+        }
+        sort( todo.begin(), todo.end() );
+        for ( vector< pair< int, DiskLoc > >::const_iterator i = todo.begin(); i != todo.end(); ++i ) {
+            BtreeBucket *b = i->second.btreemod();
+            b->_count = b->subtreeCount();
+        }
+        countedSplits.clear();
+    }
+
+    int BtreeBucket::recount(const DiskLoc& thisLoc) {
+        BtreeBucket *b = thisLoc.btreemod();
+        int c = 0;
+        for ( int i = 0; i < b->n; i++ ) {
+            if ( b->k(i).isUsed() )
+                c++;
+            if ( !b->k(i).prevChildBucket.isNull() )
+                c += recount(b->k(i).prevChildBucket);
+        }
+        if ( !b->nextChild.isNull() )
+            c += recount(b->nextChild);
+        b->_count = c;
+        return c;
+    }
+
+    long long BtreeBucket::countBefore(const IndexDetails& idx, const DiskLoc& thisLoc, const BSONObj& key, const BSONObj &order, const DiskLoc& recordLoc) {
+        long long c = 0;
+        DiskLoc loc = thisLoc;
+        while ( !loc.isNull() ) {
+            BtreeBucket *b = loc.btree();
+            massert( 13129 , "countBefore() needs a counted index", b->isCounted() );
+            int p;
+            bool found = b->find(idx, key, recordLoc, order, p, false);
+            for ( int i = 0; i < p; i++ ) {
+                if ( b->k(i).isUsed() )
+                    c++;
+                if ( !b->k(i).prevChildBucket.isNull() )
+                    c += b->k(i).prevChildBucket.btree()->_count;
+            }
+            if ( found ) {
+                if ( !b->childForPos(p).isNull() )
+                    c += b->childForPos(p).btree()->_count;
+                break;
+            }
+            loc = b->childForPos(p);
+        }
+        return c;
+    }
+
+    /* position in the index just before (or after) every key whose first field is e */
+    static long long countFirstFieldBefore(const IndexDetails& idx, const BSONElement& e, bool after) {
+        BSONObj order = idx.keyPattern();
+        BSONObjBuilder b;
+        b.appendAs( e, "" );
+        BSONObjIterator i( order );
+        i.next();
+        while ( i.more() ) {
+            // the extreme of each remaining field, in index order
+            if ( ( i.next().number() >= 0 ) == after )
+                b.appendMaxKey( "" );
+            else
+                b.appendMinKey( "" );
+        }
+        return idx.head.btree()->countBefore(idx, idx.head, b.obj(), order, after ? maxDiskLoc : minDiskLoc);
+    }
+
+    long long BtreeBucket::countInterval(const IndexDetails& idx, const FieldInterval& interval) {
+        const FieldBound &lower = interval.lower_;
+        const FieldBound &upper = interval.upper_;
+        if ( idx.keyPattern().firstElement().number() >= 0 )
+            return countFirstFieldBefore(idx, upper.bound_, upper.inclusive_) -
+                countFirstFieldBefore(idx, lower.bound_, !lower.inclusive_);
+        // a descending first field has the upper end first
+        return countFirstFieldBefore(idx, lower.bound_, lower.inclusive_) -
+            countFirstFieldBefore(idx, upper.bound_, !upper.inclusive_);
+    }
     
     DiskLoc BtreeBucket::findSingle( const IndexDetails& indexdetails , const DiskLoc& thisLoc, const BSONObj& key ){
         int pos;
@@ -1090,6 +1278,8 @@ namespace mongo {
     /* when all addKeys are done, we then build the higher levels of the tree */
     void BtreeBuilder::commit() { 
         buildNextLevel(first);
+        if ( idx.counted() )
+            BtreeBucket::recount(idx.head);
         committed = true;
     }
 
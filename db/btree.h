@@ -22,6 +22,7 @@
 #include "jsobj.h"
 #include "diskloc.h"
 #include "pdfile.h"
+#include "queryutil.h"
 
 namespace mongo {
 
@@ -122,8 +123,9 @@ namespace mongo {
         /* !Packed means there is deleted fragment space within the bucket.
            We "repack" when we run out of space before considering the node
            to be full.
+           Counted buckets belong to an index created with counted:true, and keep _count.
            */
-        enum Flags { Packed=1 };
+        enum Flags { Packed=1, Counted=2 };
 
         DiskLoc& childForPos(int p) {
             return p == n ? nextChild : k(p).prevChildBucket;
@@ -161,6 +163,8 @@ namespace mongo {
             return k(i).isUsed();
         }
 
+        bool isCounted() const { return flags & Counted; }
+
     protected:
         void _shape(int level, stringstream&);
         DiskLoc nextChild; // child bucket off and to the right of the highest key.
@@ -170,7 +174,7 @@ namespace mongo {
         int emptySize; // size of the empty region
         int topSize; // size of the data at the top of the bucket (keys are at the beginning or 'bottom')
         int n; // # of keys so far.
-        int reserved;
+        int _count; // # of used keys in this subtree, for Counted buckets
         const _KeyNode& k(int i) const {
             return ((_KeyNode*)data)[i];
         }
@@ -207,6 +211,13 @@ namespace mongo {
                    const BSONObj& key, const BSONObj &order, bool dupsAllowed,
                    IndexDetails& idx, bool toplevel = true);
 
+        /* bt_insert() of keys already in index order (key, then recordLoc), as when indexing a
+           batch of new records.  each insert starts from the lowest ancestor of the previous
+           key's bucket that must hold the new key, so a run of nearby keys stays near one leaf
+           instead of descending from the root every time.  throws as bt_insert() does.
+        */
+        static void bt_insertSorted(IndexDetails& idx, const vector< pair< BSONObj, DiskLoc > >& keys, bool dupsAllowed);
+
         bool unindex(const DiskLoc& thisLoc, IndexDetails& id, BSONObj& key, const DiskLoc& recordLoc);
 
         /* locate may return an "unused" key that is just a marker.  so be careful.
@@ -232,9 +243,22 @@ namespace mongo {
         /* get tree shape */
         void shape(stringstream&);
 
+        /* for counted indexes: the number of used keys before key:recordLoc.  one descent, reading
+           the counts of the children to the left of the path. */
+        long long countBefore(const IndexDetails&, const DiskLoc& thisLoc, const BSONObj& key, const BSONObj &order, const DiskLoc& recordLoc);
+
+        /* for counted indexes: the number of keys whose first field is in the interval */
+        static long long countInterval(const IndexDetails&, const FieldInterval& interval);
+
+        /* sets _count throughout the subtree, for a counted index built bottom up */
+        static int recount(const DiskLoc& thisLoc);
+
         static void a_test(IndexDetails&);
 
     private:
+        int subtreeCount() const;
+        static void adjustCounts(const DiskLoc& thisLoc, int delta);
+        static void fixCounts();
         void fixParentPtrs(const DiskLoc& thisLoc);
         void delBucket(const DiskLoc& thisLoc, IndexDetails&);
         void delKeyAtPos(const DiskLoc& thisLoc, IndexDetails& id, int p);
@@ -261,6 +285,11 @@ namespace mongo {
 
         BtreeCursor( NamespaceDetails *_d, int _idxNo, const IndexDetails& _id, const BoundList &_bounds, int _direction );
 
+        /* scan with skips: keys outside _fieldRanges are jumped over with seeks.
+           _bounds is only reported by prettyIndexBounds(), as for the other constructors.
+        */
+        BtreeCursor( NamespaceDetails *_d, int _idxNo, const IndexDetails& _id, const BoundList &_bounds, const shared_ptr< FieldRangeVector > &_fieldRanges, int _direction );
+
         virtual bool ok() {
             return !bucket.isNull();
         }
@@ -327,6 +356,7 @@ namespace mongo {
             string s = string("BtreeCursor ") + indexDetails.indexName();
             if ( direction < 0 ) s += " reverse";
             if ( bounds_.size() > 1 ) s += " multi";
+            if ( _ranges ) s += " skip";
             return s;
         }
 
@@ -348,6 +378,16 @@ namespace mongo {
         
         void forgetEndKey() { endKey = BSONObj(); }
 
+        /* moves past every key with the current value of the first field: one seek per
+           distinct value, for walking those values without reading the keys in between.
+        */
+        void advancePastFirstField();
+
+        /* moves forward to key:loc, or the first entry after it in scan order.  for resuming
+           a scan where an earlier one stopped; key:loc should be after the current position.
+        */
+        void advanceTo( const BSONObj &key, const DiskLoc &loc );
+
     private:
         /* Our btrees may (rarely) have "unused" keys when items are deleted.
            Skip past them.
@@ -360,11 +400,23 @@ namespace mongo {
         // selective audits on construction
         void audit();
 
-        // set initial bucket
-        void init();
+        // set initial bucket, locating from the key at from:fromOfs if there is one
+        void init( const DiskLoc &from = DiskLoc(), int fromOfs = -1 );
 
         // init start / end keys with a new range
-        void initInterval();
+        void initInterval( const DiskLoc &from = DiskLoc(), int fromOfs = -1 );
+
+        // for a skip scan, move forward until the current key is within _ranges
+        void skipOutOfRangeKeys();
+
+        // position at key, before or after any entries equal to it
+        void seek( const BSONObj &key, bool after );
+
+        /* locate key:loc, starting from the lowest ancestor of bucket from that must hold it
+           rather than from the root.  from:fromOfs is a key before key in scan order - the
+           current position when walking forward through a list of intervals or seeks.
+        */
+        void locateFrom( const DiskLoc &from, int fromOfs, const BSONObj &key, const DiskLoc &loc );
 
         friend class BtreeBucket;
         NamespaceDetails *d;
@@ -383,6 +435,7 @@ namespace mongo {
         DiskLoc locAtKeyOfs;
         BoundList bounds_;
         unsigned boundIndex_;
+        shared_ptr< FieldRangeVector > _ranges;
         const IndexSpec& _spec;
     };
 
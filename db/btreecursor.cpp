@@ -60,6 +60,25 @@ namespace mongo {
         initInterval();
     }
 
+    BtreeCursor::BtreeCursor( NamespaceDetails *_d, int _idxNo, const IndexDetails& _id, const BoundList &_bounds, const shared_ptr< FieldRangeVector > &_fieldRanges, int _direction )
+        :
+            d(_d), idxNo(_idxNo), 
+            endKeyInclusive_( true ),
+            multikey( d->isMultikey( idxNo ) ),
+            indexDetails( _id ),
+            order( _id.keyPattern() ),
+            direction( _direction ),
+            bounds_( _bounds ),
+            boundIndex_(),
+            _ranges( _fieldRanges ),
+            _spec( _id.getSpec() )
+    {
+        audit();
+        startKey = _ranges->startKey();
+        seek( startKey, false );
+        skipOutOfRangeKeys();
+    }
+
     void BtreeCursor::audit() {
         dassert( d->idxNo((IndexDetails&) indexDetails) == idxNo );
 
@@ -75,26 +94,114 @@ namespace mongo {
         }
     }
 
-    void BtreeCursor::init() {
+// Return a value in the set {-1, 0, 1} to represent the sign of parameter i.
+    int sgn( int i ) {
+        if ( i == 0 )
+            return 0;
+        return i > 0 ? 1 : -1;
+    }
+
+    void BtreeCursor::init( const DiskLoc &from, int fromOfs ) {
         if ( _spec.getType() ){
             startKey = _spec.getType()->fixKey( startKey );
             endKey = _spec.getType()->fixKey( endKey );
         }
-        bool found;
-        bucket = indexDetails.head.btree()->
-        locate(indexDetails, indexDetails.head, startKey, order, keyOfs, found, direction > 0 ? minDiskLoc : maxDiskLoc, direction);
-        skipUnusedKeys();
+        locateFrom( from, fromOfs, startKey, direction > 0 ? minDiskLoc : maxDiskLoc );
         checkEnd();        
     }
     
-    void BtreeCursor::initInterval() {
+    /* from:fromOfs stays a valid starting point across empty intervals: they are in scan order */
+    void BtreeCursor::initInterval( const DiskLoc &from, int fromOfs ) {
         do {
             startKey = bounds_[ boundIndex_ ].first;
             endKey = bounds_[ boundIndex_ ].second;
-            init();
+            init( from, fromOfs );
         } while ( !ok() && ++boundIndex_ < bounds_.size() );
     }
 
+    void BtreeCursor::seek( const BSONObj &key, bool after ) {
+        DiskLoc loc = ( after == ( direction > 0 ) ) ? maxDiskLoc : minDiskLoc;
+        if ( ok() )
+            locateFrom( bucket, keyOfs, key, loc );
+        else
+            locateFrom( DiskLoc(), -1, key, loc );
+    }
+
+    /* if from's key is before key, and key is before the last key (in scan order) of some bucket
+       on the path from from up to the root, key's position is inside that bucket's subtree.  for
+       a list of $in values that's usually from itself or its parent, so most seeks read one or
+       two buckets instead of descending the whole tree.
+    */
+    void BtreeCursor::locateFrom( const DiskLoc &from, int fromOfs, const BSONObj &key, const DiskLoc &loc ) {
+        DiskLoc start = indexDetails.head;
+        if ( !from.isNull() && fromOfs >= 0 && fromOfs < from.btree()->n &&
+             sgn( key.woCompare( from.btree()->keyNode( fromOfs ).key, order ) ) == direction ) {
+            for( DiskLoc a = from; !a.isNull(); a = a.btree()->parent ) {
+                BtreeBucket *b = a.btree();
+                if ( b->n > 0 && sgn( key.woCompare( b->keyNode( direction > 0 ? b->n - 1 : 0 ).key, order ) ) == -direction ) {
+                    start = a;
+                    break;
+                }
+            }
+        }
+        bool found;
+        bucket = start.btree()->locate(indexDetails, start, key, order, keyOfs, found, loc, direction);
+        skipUnusedKeys();
+    }
+
+    void BtreeCursor::advancePastFirstField() {
+        killCurrentOp.checkForInterrupt();
+        if ( bucket.isNull() )
+            return;
+        BSONObjBuilder b;
+        b.appendAs( currKey().firstElement(), "" );
+        BSONObjIterator i( order );
+        i.next();
+        while( i.more() ) {
+            // the far end of the remaining fields, in scan order
+            if ( ( i.next().number() >= 0 ) == ( direction > 0 ) )
+                b.appendMaxKey( "" );
+            else
+                b.appendMinKey( "" );
+        }
+        seek( b.obj(), true );
+        if ( _ranges )
+            skipOutOfRangeKeys();
+        else
+            checkEnd();
+    }
+
+    void BtreeCursor::advanceTo( const BSONObj &key, const DiskLoc &loc ) {
+        if ( bucket.isNull() )
+            return;
+        locateFrom( bucket, keyOfs, key, loc );
+        checkEnd();
+    }
+
+    void BtreeCursor::skipOutOfRangeKeys() {
+        BSONObj seekKey;
+        bool after;
+        int steps = 0;
+        while( ok() ) {
+            FieldRangeVector::CheckResult r = _ranges->check( currKey(), seekKey, after );
+            if ( r == FieldRangeVector::InRange )
+                return;
+            if ( r == FieldRangeVector::Done ) {
+                bucket = DiskLoc();
+                return;
+            }
+            /* small gaps are cheaper to walk than to seek over */
+            if ( ++steps <= 3 ) {
+                bucket = bucket.btree()->advance(bucket, keyOfs, direction, "skipOutOfRangeKeys");
+                skipUnusedKeys();
+            }
+            else {
+                seek( seekKey, after );
+                steps = 0;
+            }
+        }
+    }
+
     /* skip unused keys. */
     void BtreeCursor::skipUnusedKeys() {
         int u = 0;
@@ -112,13 +219,6 @@ namespace mongo {
             OCCASIONALLY log() << "btree unused skipped:" << u << '\n';
     }
 
-// Return a value in the set {-1, 0, 1} to represent the sign of parameter i.
-    int sgn( int i ) {
-        if ( i == 0 )
-            return 0;
-        return i > 0 ? 1 : -1;
-    }
-
     // Check if the current key is beyond endKey.
     void BtreeCursor::checkEnd() {
         if ( bucket.isNull() )
@@ -135,11 +235,15 @@ namespace mongo {
         killCurrentOp.checkForInterrupt();
         if ( bucket.isNull() )
             return false;
+        DiskLoc prev = bucket;
+        int prevOfs = keyOfs;
         bucket = bucket.btree()->advance(bucket, keyOfs, direction, "BtreeCursor::advance");
         skipUnusedKeys();
+        if ( _ranges )
+            skipOutOfRangeKeys();
         checkEnd();
-        if( !ok() && ++boundIndex_ < bounds_.size() )
-            initInterval();
+        if( !ok() && !_ranges && ++boundIndex_ < bounds_.size() )
+            initInterval( prev, prevOfs );
         return !bucket.isNull();
     }
 
@@ -180,6 +284,8 @@ namespace mongo {
                        marker key. advance.
                     */
                     skipUnusedKeys();
+                    if ( _ranges )
+                        skipOutOfRangeKeys();
                 }
                 return;
             }
@@ -196,6 +302,8 @@ namespace mongo {
         RARELY log() << "  key seems to have moved in the index, refinding. found:" << found << endl;
         if ( ! bucket.isNull() )
             skipUnusedKeys();
+        if ( _ranges )
+            skipOutOfRangeKeys();
 
     }
 
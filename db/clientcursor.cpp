@@ -29,6 +29,7 @@
 #include "db.h"
 #include "commands.h"
 #include "repl_block.h"
+#include "curop.h"
 
 namespace mongo {
 
@@ -165,6 +166,40 @@ namespace mongo {
             }
         }
     }
+    void ClientCursor::aboutToDelete(const set<DiskLoc>& dls) {
+        recursive_scoped_lock lock(ccmutex);
+
+        vector<ClientCursor*> toAdvance;
+        for ( set<DiskLoc>::const_iterator i = dls.begin(); i != dls.end(); ++i ) {
+            CCByLoc::iterator stop = byLoc.upper_bound(*i);
+            for ( CCByLoc::iterator j = byLoc.lower_bound(*i); j != stop; ++j )
+                toAdvance.push_back(j->second);
+        }
+
+        for ( vector<ClientCursor*>::iterator i = toAdvance.begin(); i != toAdvance.end(); ++i ){
+            ClientCursor* cc = *i;
+            
+            if ( cc->_doingDeletes ) continue;
+
+            Cursor *c = cc->c.get();
+            if ( c->capped() ){
+                delete cc;
+                continue;
+            }
+            
+            c->checkLocation();
+            // unlike one at a time, the next record may be going too
+            do {
+                c->advance();
+            } while ( !c->eof() && dls.count( c->refLoc() ) );
+            if ( c->eof() ) {
+                delete cc;
+            }
+            else {
+                cc->updateLocation();
+            }
+        }
+    }
     void aboutToDelete(const DiskLoc& dl) { ClientCursor::aboutToDelete(dl); }
 
     ClientCursor::~ClientCursor() {
@@ -231,6 +266,7 @@ namespace mongo {
             }
         }
             
+        cc().curop()->debug().stats.nYields++;
         {
             dbtempreleasecond unlock;
             sleepmicros( Client::recommendedYieldMicros() );
@@ -284,6 +284,8 @@ public:
 
         static void informAboutToDeleteBucket(const DiskLoc& b);
         static void aboutToDelete(const DiskLoc& dl);
+        /* for deleting many records at once: cursors are moved past all of them */
+        static void aboutToDelete(const set<DiskLoc>& dls);
     };
 
     
@@ -151,10 +151,21 @@ namespace mongo {
         }
 
         if ( storedForLater.size() ){
+            /* build all the indexes of each collection with one scan of it */
+            bool together = true;
+            try {
+                theDataFileMgr.insertIndexes( vector<BSONObj>( storedForLater.begin() , storedForLater.end() ) );
+            }
+            catch( UserException& e ) {
+                log() << "warning: exception building indexes together in " << from_collection << ' ' << e.what() << ", building one at a time" << endl;
+                together = false;
+            }
+
             for ( list<BSONObj>::iterator i = storedForLater.begin(); i!=storedForLater.end(); i++ ){
                 BSONObj js = *i;
                 try { 
-                    theDataFileMgr.insert(to_collection, js);
+                    if ( ! together )
+                        theDataFileMgr.insert(to_collection, js);
                     if ( logForRepl )
                         logOp("i", to_collection, js);
                 }
@@ -43,6 +43,9 @@ namespace mongo {
         long long oplogSize;   // --oplogSize
         int defaultProfile;    // --profile
         int slowMS;            // --time in ms that is "slow"
+        int indexBuildThreads; // --indexBuildThreads 0 means one per core
+        int queryScanThreads;  // --queryScanThreads 0 means one per core, 1 for no parallel scans
+        int ttlMonitorSleepSecs; // --ttlMonitorSleepSecs
 
         enum { 
             DefaultDBPort = 27017,
@@ -52,7 +55,7 @@ namespace mongo {
 
         CmdLine() : 
             port(DefaultDBPort), rest(false), quiet(false), notablescan(false), prealloc(true), smallfiles(false),
-            quota(false), quotaFiles(8), cpu(false), oplogSize(0), defaultProfile(0), slowMS(100)
+            quota(false), quotaFiles(8), cpu(false), oplogSize(0), defaultProfile(0), slowMS(100), indexBuildThreads(0), queryScanThreads(0), ttlMonitorSleepSecs(60)
         { } 
         
 
@@ -25,12 +25,79 @@
 
 namespace mongo { 
 
+    /* where an operation's time went.  the counters are always kept; the stage times (micros)
+       only if timed, i.e. when the op is explained or profiled, as reading the clock for every
+       document isn't free.
+    */
+    struct OpStats {
+        OpStats(){ reset(); }
+        void reset(){
+            timed = false;
+            nscanned = nscannedObjects = 0;
+            nYields = 0;
+            cursorMicros = matchMicros = sortMicros = projectMicros = lockWaitMicros = 0;
+        }
+        /* adds the work of one query plan or getMore batch */
+        void add( const OpStats& o ){
+            timed = timed || o.timed;
+            nscanned += o.nscanned;
+            nscannedObjects += o.nscannedObjects;
+            nYields += o.nYields;
+            cursorMicros += o.cursorMicros;
+            matchMicros += o.matchMicros;
+            sortMicros += o.sortMicros;
+            projectMicros += o.projectMicros;
+            lockWaitMicros += o.lockWaitMicros;
+        }
+        void append( BSONObjBuilder& b ) const {
+            b.appendNumber( "nscanned" , nscanned );
+            b.appendNumber( "nscannedObjects" , nscannedObjects );
+            b.append( "nYields" , nYields );
+            b.appendNumber( "lockWaitMicros" , lockWaitMicros );
+            if ( timed ){
+                b.appendNumber( "cursorMicros" , cursorMicros );   // creating and advancing cursors: btree or extent walk
+                b.appendNumber( "matchMicros" , matchMicros );     // matching, and fetching the records (page faults)
+                b.appendNumber( "sortMicros" , sortMicros );       // ScanAndOrder
+                b.appendNumber( "projectMicros" , projectMicros ); // building the returned objects
+            }
+        }
+        /* nothing worth recording: a lock wait under a millisecond isn't worth the profile space */
+        bool empty() const {
+            return ! timed && nscanned == 0 && nYields == 0 && lockWaitMicros < 1000;
+        }
+
+        bool timed;
+        long long nscanned;
+        long long nscannedObjects;
+        int nYields;
+        long long cursorMicros;
+        long long matchMicros;
+        long long sortMicros;
+        long long projectMicros;
+        long long lockWaitMicros;
+    };
+
+    /* adds the time from construction to destruction to *micros.  a null micros means not timing. */
+    class StageTimer : boost::noncopyable {
+    public:
+        StageTimer( long long *micros ) : _micros( micros ) , _start( micros ? curTimeMicros64() : 0 ){}
+        ~StageTimer(){
+            if ( _micros )
+                *_micros += curTimeMicros64() - _start;
+        }
+    private:
+        long long *_micros;
+        unsigned long long _start;
+    };
+
     class OpDebug {
     public:
         StringBuilder str;
+        OpStats stats;
         
         void reset(){
             str.reset();
+            stats.reset();
         }
     };
     
@@ -52,6 +119,7 @@ namespace mongo {
         bool _command;
         int _lockType; // see concurrency.h for values
         bool _waitingForLock;
+        unsigned long long _waitingForLockSince;
         int _dbprofile; // 0=off, 1=slow, 2=all
         AtomicUInt _opNum;
         char _ns[Namespace::MaxNsLen+2];
@@ -72,6 +140,7 @@ namespace mongo {
             _dbprofile = 0;
             _end = 0;
             _waitingForLock = false;
+            _waitingForLockSince = 0;
             _message = "";
             _progressMeter.finished();
         }
@@ -131,6 +200,7 @@ namespace mongo {
 
         void waitingForLock( int type ){
             _waitingForLock = true;
+            _waitingForLockSince = curTimeMicros64();
             if ( type > 0 )
                 _lockType = 1;
             else
@@ -138,6 +208,7 @@ namespace mongo {
         }
         void gotLock(){
             _waitingForLock = false;
+            _debug.stats.lockWaitMicros += curTimeMicros64() - _waitingForLockSince;
         }
 
         OpDebug& debug(){
@@ -283,10 +354,16 @@ namespace mongo {
         void kill(AtomicUInt i) { toKill = i; state = On; }
         
         void checkForInterrupt() { 
+            if( state != Off ) 
+                checkForInterrupt( cc().curop()->opNum() );
+        }
+        /* for a thread working on behalf of another client's op, e.g. a parallel index build
+           worker sorting keys: its own cc() isn't the op that gets killed */
+        void checkForInterrupt( AtomicUInt opNum ) { 
             if( state != Off ) { 
                 if( state == All ) 
                     uasserted(11600,"interrupted at shutdown");
-                if( cc().curop()->opNum() == toKill ) { 
+                if( opNum == toKill ) { 
                     state = Off;
                     uasserted(11601,"interrupted");
                 }
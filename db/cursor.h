@@ -97,6 +97,10 @@ namespace mongo {
 
         virtual bool capped() const { return false; }
 
+        /* keys read by the first ok() before there is a current record (see IntersectCursor),
+           which the caller should add to its nscanned. */
+        virtual long long nscannedUpFront() const { return 0; }
+
     };
 
     // strategy object implementing direction of traversal.
@@ -42,6 +42,8 @@
 #include "module.h"
 #include "cmdline.h"
 #include "stats/snapshots.h"
+#include "ttl.h"
+#include "repl_prefetch.h"
 
 namespace mongo {
 
@@ -552,6 +554,7 @@ namespace mongo {
         srand((unsigned) (curTimeMicros() ^ startupSrandTimer.micros()));
 
         snapshotThread.go();
+        ttlMonitor.go();
         listen(listenPort);
 
         // listen() will return when exit code closes its socket.
@@ -661,6 +664,9 @@ int main(int argc, char* argv[], char *envp[] )
         ("syncdelay",po::value<double>(&dataFileSync._sleepsecs)->default_value(60), "seconds between disk syncs (0 for never)")
         ("profile",po::value<int>(), "0=off 1=slow, 2=all")
         ("slowms",po::value<int>(&cmdLine.slowMS)->default_value(100), "value of slow for profile and console log" )
+        ("indexBuildThreads",po::value<int>(&cmdLine.indexBuildThreads)->default_value(0), "threads used to scan a collection when building an index (0 for one per core)" )
+        ("queryScanThreads",po::value<int>(&cmdLine.queryScanThreads)->default_value(0), "threads used by unindexed counts, distincts and sorted queries on large collections (0 for one per core, 1 for none)" )
+        ("ttlMonitorSleepSecs",po::value<int>(&cmdLine.ttlMonitorSleepSecs)->default_value(60), "seconds between passes deleting expired documents of ttl indexes")
         ("maxConns",po::value<int>(), "max number of simultaneous connections")
 #if defined(_WIN32)
         ("install", "install mongodb service")
@@ -681,6 +687,7 @@ int main(int argc, char* argv[], char *envp[] )
         ("pairwith", po::value<string>(), "address of server to pair with")
         ("arbiter", po::value<string>(), "address of arbiter server")
         ("slavedelay", po::value<int>(), "specify delay (in seconds) to be used when applying master ops to slave")
+        ("replPrefetch", po::value<string>(), "when slave: pages to read before applying master ops: none, _id_only or all (default)")
         ("fastsync", "indicate that this instance is starting from a dbpath snapshot of the repl peer")
         ("autoresync", "automatically resync if slave data is stale")
         ("oplogSize", po::value<int>(), "size limit (in MB) for op log")
@@ -848,6 +855,9 @@ int main(int argc, char* argv[], char *envp[] )
         if (params.count("slavedelay")) {
             replSettings.slavedelay = params["slavedelay"].as<int>();
         }
+        if (params.count("replPrefetch")) {
+            uassert( 13135 , "bad --replPrefetch arg: must be none, _id_only or all" , setReplPrefetch( params["replPrefetch"].as<string>() ) );
+        }
         if (params.count("fastsync")) {
             replSettings.fastsync = true;
         }
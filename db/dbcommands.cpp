@@ -36,9 +36,13 @@
 #include "lasterror.h"
 #include "security.h"
 #include "queryoptimizer.h"
+#include "pipeline.h"
+#include "parallelscan.h"
 #include "../scripting/engine.h"
 #include "stats/counters.h"
 #include "background.h"
+#include "dbhelpers.h"
+#include "repl_prefetch.h"
 
 namespace mongo {
 
@@ -121,6 +125,100 @@ namespace mongo {
         }
     } cmdSleep;
 
+    /* getlasterror fsyncs are group committed: while one flush is running, everyone else asking
+       for one waits for the next, which the first of them runs for all of them.  each caller is
+       released by a flush that started after it asked.
+    */
+    class FsyncGroupCommit : boost::noncopyable {
+    public:
+        FsyncGroupCommit() : _started(0), _finished(0), _flushing(false), _waiting(0), _lastFiles(0), _commits(0), _callers(0), _totalMillis(0) {
+            for ( int i = 0; i < NBuckets; i++ )
+                _batchSizes[i] = 0;
+        }
+
+        /* @return number of files flushed */
+        int flush() {
+            scoped_lock lk( _m );
+            long long mine = _started + 1;
+            _waiting++;
+            while ( _finished < mine ) {
+                if ( _flushing ) {
+                    _c.wait( lk.boost() );
+                    continue;
+                }
+
+                // lead: run the flush for everyone waiting
+                _started++;
+                _flushing = true;
+                int batch = _waiting;
+                _waiting = 0;
+                int files = 0;
+                Timer t;
+                lk.boost().unlock();
+                try {
+                    files = MemoryMappedFile::flushAll( true );
+                }
+                catch ( ... ) {
+                    lk.boost().lock();
+                    _flushing = false;
+                    _c.notify_all();
+                    throw;
+                }
+                lk.boost().lock();
+                _finished = _started;
+                _flushing = false;
+                _lastFiles = files;
+                noteCommit( batch , t.millis() );
+                _c.notify_all();
+            }
+            return _lastFiles;
+        }
+
+        void append( BSONObjBuilder& b ) {
+            scoped_lock lk( _m );
+            b.appendNumber( "commits" , _commits );
+            b.appendNumber( "callers" , _callers );
+            b.appendNumber( "average_ms" , _commits ? _totalMillis / double( _commits ) : 0.0 );
+            BSONObjBuilder sizes( b.subobjStart( "batchSizes" ) );
+            for ( int i = 0; i < NBuckets; i++ ) {
+                stringstream ss;
+                ss << ( 1 << i );
+                if ( i == NBuckets - 1 )
+                    ss << '+';
+                else if ( i > 0 )
+                    ss << '-' << ( ( 1 << ( i + 1 ) ) - 1 );
+                sizes.appendNumber( ss.str().c_str() , _batchSizes[i] );
+            }
+            sizes.done();
+        }
+
+    private:
+        enum { NBuckets = 8 }; // 1, 2-3, 4-7, ... 128+
+
+        void noteCommit( int batch , int ms ) {
+            _commits++;
+            _callers += batch;
+            _totalMillis += ms;
+            int i = 0;
+            while ( i < NBuckets - 1 && ( batch >> ( i + 1 ) ) )
+                i++;
+            _batchSizes[i]++;
+        }
+
+        mongo::mutex _m;
+        boost::condition _c;
+        long long _started;
+        long long _finished;
+        bool _flushing;
+        int _waiting; // callers for the next flush
+        int _lastFiles;
+
+        long long _commits;
+        long long _callers;
+        long long _totalMillis;
+        long long _batchSizes[ NBuckets ];
+    } fsyncGroupCommit;
+
     class CmdGetLastError : public Command {
     public:
         virtual LockType locktype(){ return NONE; } 
@@ -147,7 +245,7 @@ namespace mongo {
 
             if ( cmdObj["fsync"].trueValue() ){
                 log() << "fsync from getlasterror" << endl;
-                result.append( "fsyncFiles" , MemoryMappedFile::flushAll( true ) );
+                result.append( "fsyncFiles" , fsyncGroupCommit.flush() );
             }
             
             BSONElement e = cmdObj["w"];
@@ -157,22 +255,12 @@ namespace mongo {
 
                 int w = e.numberInt();
 
-                long long passes = 0;
-                char buf[32];
-                while ( 1 ){
-                    if ( opReplicatedEnough( c.getLastOp() , w ) )
-                        break;
-                    
-                    if ( timeout > 0 && t.millis() >= timeout ){
-                        result.append( "wtimeout" , true );
-                        errmsg = "timed out waiting for slaves";
-                        result.append( "waited" , t.millis() );
-                        return false;
-                    }
-
-                    assert( sprintf( buf , "w block pass: %lld" , ++passes ) < 30 );
-                    c.curop()->setMessage( buf );
-                    sleepmillis(1);
+                c.curop()->setMessage( "waiting for replication" );
+                if ( ! waitForReplication( c.getLastOp() , w , timeout ) ){
+                    result.append( "wtimeout" , true );
+                    errmsg = "timed out waiting for slaves";
+                    result.append( "waited" , t.millis() );
+                    return false;
                 }
                 result.appendNumber( "wtime" , t.millis() );
             }
@@ -415,10 +503,28 @@ namespace mongo {
                 globalFlushCounters.append( bb );
                 bb.done();
             }
+
+            {
+                BSONObjBuilder bb( result.subobjStart( "fsyncGroupCommit" ) );
+                fsyncGroupCommit.append( bb );
+                bb.done();
+            }
+
+            {
+                BSONObjBuilder bb( result.subobjStart( "ttl" ) );
+                globalTTLCounters.append( bb );
+                bb.done();
+            }
             
             if ( anyReplEnabled() ){
                 BSONObjBuilder bb( result.subobjStart( "repl" ) );
                 appendReplicationInfo( bb , authed , cmdObj["repl"].numberInt() );
+                {
+                    BSONObjBuilder apply( bb.subobjStart( "apply" ) );
+                    apply.append( "prefetch" , replPrefetchName() );
+                    globalReplApplyCounters.append( apply );
+                    apply.done();
+                }
                 bb.done();
             }
             
@@ -799,10 +905,8 @@ namespace mongo {
                 return false;
             }
 
-            for ( list<BSONObj>::iterator i=all.begin(); i!=all.end(); i++ ){
-                BSONObj o = *i;
-                db.insert( Namespace( toDeleteNs.c_str() ).getSisterNS( "system.indexes" ).c_str() , o );
-            }
+            /* one scan of the collection for all of them */
+            theDataFileMgr.insertIndexes( vector<BSONObj>( all.begin() , all.end() ) );
 
             result.append( "ok" , 1 );
             result.append( "nIndexes" , (int)all.size() );
@@ -811,6 +915,61 @@ namespace mongo {
         }
     } cmdReIndex;
 
+    /* { createIndexes : <collection> , indexes : [ { key : { a : 1 } , name : "a_1" } , ... ] }
+       unlike separate inserts into system.indexes, the new indexes are built with a single scan
+       of the collection.
+    */
+    class CmdCreateIndexes : public Command {
+    public:
+        virtual bool logTheOp() {
+            return true;
+        }
+        virtual bool slaveOk() {
+            return false;
+        }
+        virtual LockType locktype(){ return WRITE; } 
+        virtual void help( stringstream& help ) const {
+            help << "build several indexes of a collection together\n"
+                 << "{ createIndexes : <collection> , indexes : [ { key : {...} , name : <name> } , ... ] }";
+        }
+        CmdCreateIndexes() : Command("createIndexes") { }
+        bool run(const char *ns, BSONObj& jsobj, string& errmsg, BSONObjBuilder& result, bool /*fromRepl*/) {
+            string toIndexNs = cc().database()->name + '.' + jsobj.getField(name.c_str()).valuestr();
+
+            BSONElement e = jsobj.getField("indexes");
+            if ( e.type() != Array ){
+                errmsg = "indexes must be an array";
+                return false;
+            }
+
+            vector<BSONObj> specs;
+            BSONObjIterator i( e.embeddedObject() );
+            while ( i.more() ){
+                BSONElement x = i.next();
+                if ( x.type() != Object ){
+                    errmsg = "bad index spec";
+                    return false;
+                }
+                BSONObj spec = x.embeddedObject();
+                if ( spec["ns"].eoo() ){
+                    BSONObjBuilder b;
+                    b.append( "ns" , toIndexNs );
+                    b.appendElements( spec );
+                    spec = b.obj();
+                }
+                else if ( toIndexNs != spec.getStringField( "ns" ) ){
+                    errmsg = "index spec ns doesn't match collection";
+                    return false;
+                }
+                specs.push_back( spec );
+            }
+
+            log() << "CMD: createIndexes " << toIndexNs << " n: " << specs.size() << endl;
+            result.append( "nIndexesAdded" , theDataFileMgr.insertIndexes( specs ) );
+            return true;
+        }
+    } cmdCreateIndexes;
+
     class CmdListDatabases : public Command {
     public:
         virtual bool logTheOp() {
@@ -1499,6 +1658,19 @@ namespace mongo {
     } cmdGroup;
 
 
+    class ParallelDistinctOp : public ParallelMatchOp {
+    public:
+        ParallelDistinctOp( const BSONObj& query , const string& key ) : ParallelMatchOp( query ) , _key( key ){}
+        virtual ParallelScanOp * clone() const { return new ParallelDistinctOp( _query , _key ); }
+        BSONElementSet values;
+    protected:
+        virtual void matched( const BSONObj& o , const DiskLoc& loc ){
+            o.getFieldsDotted( _key.c_str() , values );
+        }
+    private:
+        string _key;
+    };
+
     class DistinctCommand : public Command {
     public:
         DistinctCommand() : Command("distinct"){}
@@ -1508,6 +1680,69 @@ namespace mongo {
             help << "{ distinct : 'collection name' , key : 'a.b' }";
         }
 
+        /* an index whose first field is key, where the query (if any) is only on key and can be
+           checked against the index keys.  -1 if there is none.
+        */
+        int distinctIndex( NamespaceDetails *d , const string& key , const BSONObj& query ){
+            BSONObjIterator q( query );
+            while ( q.more() ){
+                if ( key != q.next().fieldName() )
+                    return -1;
+            }
+
+            for ( int i = 0; i < d->nIndexes; i++ ){
+                IndexDetails& idx = d->idx( i );
+                BSONElement first = idx.keyPattern().firstElement();
+                if ( key != first.fieldName() || ! first.isNumber() )
+                    continue;
+                if ( ! idx.getSpec().usableFor( query ) )
+                    continue;
+                // one array element matching tells us nothing about the whole array
+                if ( ! query.isEmpty() && 
+                     ( d->isMultikey( i ) || CoveredIndexMatcher( query , idx.keyPattern() ).needRecord() ) )
+                    continue;
+                return i;
+            }
+            return -1;
+        }
+
+        /* walks the index from one value of key to the next, reading the values from the keys.
+           only null and undefined keys need their records, as those are also what missing fields
+           and empty arrays index as.
+        */
+        void distinctFromIndex( NamespaceDetails *d , int idxNo , const string& ns , const string& key ,
+                                const BSONObj& query , BSONElementSet& values ){
+            IndexDetails& idx = d->idx( idxNo );
+            FieldRangeSet frs( ns.c_str() , query );
+            shared_ptr< FieldRangeVector > ranges( new FieldRangeVector( frs , idx.keyPattern() , 1 ) );
+            BtreeCursor cursor( d , idxNo , idx , frs.indexBounds( idx.keyPattern() , 1 ) , ranges , 1 );
+
+            auto_ptr<CoveredIndexMatcher> matcher;
+            if ( ! query.isEmpty() )
+                matcher.reset( new CoveredIndexMatcher( query , idx.keyPattern() ) );
+
+            while ( cursor.ok() ){
+                BSONElement e = cursor.currKey().firstElement();
+                if ( matcher.get() && ! matcher->matchesCurrent( &cursor ) ){
+                    cursor.advancePastFirstField();
+                    continue;
+                }
+
+                if ( e.type() != jstNULL && e.type() != Undefined ){
+                    values.insert( e );
+                    cursor.advancePastFirstField();
+                    continue;
+                }
+
+                // stop fetching once a real null turns up
+                cursor.current().getFieldsDotted( key.c_str() , values );
+                if ( values.count( e ) )
+                    cursor.advancePastFirstField();
+                else
+                    cursor.advance();
+            }
+        }
+
         bool run(const char *dbname, BSONObj& cmdObj, string& errmsg, BSONObjBuilder& result, bool fromRepl ){
             string ns = cc().database()->name + '.' + cmdObj.getField(name).valuestr();
 
@@ -1517,6 +1752,24 @@ namespace mongo {
             BSONObj query = getQuery( cmdObj );
             
             BSONElementSet values;
+            NamespaceDetails *d = nsdetails( ns.c_str() );
+            int idxNo = d ? distinctIndex( d , key , query ) : -1;
+            if ( idxNo >= 0 ){
+                distinctFromIndex( d , idxNo , ns , key , query , values );
+                return appendValues( values , result );
+            }
+
+            int nThreads = parallelQueryThreads( ns.c_str() , d , query , BSONObj() );
+            if ( nThreads > 1 ){
+                ParallelCollectionScan scan( ns.c_str() , d , nThreads );
+                scan.run( ParallelDistinctOp( query , key ) );
+                for ( unsigned i=0; i<scan.ops().size(); i++ ){
+                    const BSONElementSet& s = static_cast< ParallelDistinctOp* >( scan.ops()[i].get() )->values;
+                    values.insert( s.begin() , s.end() );
+                }
+                return appendValues( values , result );
+            }
+
             auto_ptr<Cursor> cursor = QueryPlanSet(ns.c_str() , query , BSONObj() ).getBestGuess()->newCursor();
             auto_ptr<CoveredIndexMatcher> matcher;
             if ( ! query.isEmpty() )
@@ -1534,8 +1787,12 @@ namespace mongo {
                 o.getFieldsDotted( key.c_str(), values );
             }
 
+            return appendValues( values , result );
+        }
+
+        bool appendValues( const BSONElementSet& values , BSONObjBuilder& result ){
             BSONArrayBuilder b( result.subarrayStart( "values" ) );
-            for ( BSONElementSet::iterator i = values.begin() ; i != values.end(); i++ ){
+            for ( BSONElementSet::const_iterator i = values.begin() ; i != values.end(); i++ ){
                 b.append( *i );
             }
             BSONObj arr = b.done();
@@ -1548,14 +1805,136 @@ namespace mongo {
 
     } distinctCmd;
 
+    class PipelineCommand : public Command {
+    public:
+        PipelineCommand() : Command("aggregate"){}
+        virtual bool slaveOk() { return true; }
+        virtual LockType locktype(){ return READ; } 
+        virtual void help( stringstream &help ) const {
+            help << "{ aggregate : 'collection name' , pipeline : [ { $match : {...} } , { $group : { _id : '$a' , n : { $sum : 1 } } } , ... ] }\n"
+                 << "stages: $match $project $group ($sum $avg $min $max $count $push) $sort $skip $limit";
+        }
+
+        bool run(const char *dbname, BSONObj& cmdObj, string& errmsg, BSONObjBuilder& result, bool fromRepl ){
+            string ns = cc().database()->name + '.' + cmdObj.firstElement().valuestrsafe();
+
+            if ( cmdObj["pipeline"].type() != Array ){
+                errmsg = "pipeline has to be an array";
+                return false;
+            }
+            Pipeline pipeline( cmdObj["pipeline"].embeddedObject() );
+
+            // a leading $match (and $sort) is answered by the query optimizer
+            BSONObj query = pipeline.takeMatch();
+            QueryPlanSet plans( ns.c_str() , query , pipeline.leadingSort() );
+            QueryPlanSet::PlanPtr plan = plans.getBestGuess();
+            if ( ! plan->scanAndOrderRequired() )
+                pipeline.takeSort();
+
+            auto_ptr<Cursor> cursor = plan->newCursor();
+            auto_ptr<CoveredIndexMatcher> matcher;
+            if ( ! query.isEmpty() )
+                matcher.reset( new CoveredIndexMatcher( query , cursor->indexKeyPattern() ) );
+
+            while ( cursor->ok() ){
+                if ( ( matcher.get() && ! matcher->matchesCurrent( cursor.get() ) ) ||
+                     cursor->getsetdup( cursor->currLoc() ) ){
+                    cursor->advance();
+                    continue;
+                }
+
+                BSONObj o = cursor->current();
+                cursor->advance();
+
+                if ( ! pipeline.add( o ) )
+                    break;
+            }
+
+            pipeline.done( result );
+            return true;
+        }
+
+    } pipelineCmd;
+
+    /* the first match of a queue findandmodify, read from where the last one for the same query
+       and sort stopped.  needs an index that gives the sort order as a single range; false if
+       there isn't one, and the caller does an ordinary query instead.
+    */
+    static bool queueFindOne( const char *ns, const BSONObj& query, const BSONObj& sort, BSONObj& obj ) {
+        NamespaceDetails *d = nsdetails( ns );
+        if ( !d )
+            return false;
+        NamespaceDetailsTransient& nsdt = NamespaceDetailsTransient::get_w( ns );
+        BSONObj querySort = BSON( "q" << query << "s" << sort );
+        NamespaceDetailsTransient::QueuePosition *pp = nsdt.findQueuePosition( querySort );
+
+        FieldRangeSet frs( ns, query );
+        if ( !pp || pp->idxNo >= d->nIndexes ) {
+            // no position is kept when no index fits: the caller does an ordinary query
+            int idxNo = -1;
+            int direction = 1;
+            bool optimal = false;
+            for ( int i = 0; i < d->nIndexes && !optimal; i++ ) {
+                if ( d->idx( i ).getSpec().getType() )
+                    continue;
+                QueryPlan plan( d, i, frs, sort );
+                if ( plan.scanAndOrderRequired() || plan.unhelpful() || plan.skipScan() || plan.indexBounds().size() != 1 )
+                    continue;
+                if ( idxNo < 0 || plan.optimal() ) {
+                    idxNo = i;
+                    direction = plan.direction();
+                    optimal = plan.optimal();
+                }
+            }
+            if ( idxNo < 0 )
+                return false;
+            pp = &nsdt.addQueuePosition( querySort, idxNo, direction );
+        }
+        NamespaceDetailsTransient::QueuePosition& p = *pp;
+
+        IndexDetails& idx = d->idx( p.idxNo );
+        QueryPlan plan( d, p.idxNo, frs, sort );
+        BoundList bounds = plan.indexBounds();
+        BtreeCursor c( d, p.idxNo, idx, bounds[ 0 ].first, bounds[ 0 ].second, true, p.direction );
+        if ( !p.key.isEmpty() && c.ok() ) {
+            int cmp = p.key.woCompare( c.currKey(), idx.keyPattern() );
+            if ( cmp == 0 )
+                cmp = p.loc.compare( c.currLoc() );
+            if ( cmp * p.direction > 0 )
+                c.advanceTo( p.key, p.loc );
+        }
+
+        CoveredIndexMatcher matcher( query, idx.keyPattern() );
+        for ( ; c.ok(); c.advance() ) {
+            if ( !matcher.matches( c.currKey(), c.currLoc() ) || c.getsetdup( c.currLoc() ) )
+                continue;
+            p.key = c.currKey().getOwned();
+            p.loc = c.currLoc();
+            obj = c.current().getOwned(); // the record is about to change
+            return true;
+        }
+        // nothing left: the next call starts at the end of the range, unless a write comes first
+        p.key = bounds[ 0 ].second;
+        p.loc = p.direction > 0 ? maxDiskLoc : minDiskLoc;
+        obj = BSONObj();
+        return true;
+    }
+
     /* Find and Modify an object returning either the old (default) or new value*/
     class CmdFindAndModify : public Command {
     public:
         /* {findandmodify: "collection", query: {processed:false}, update: {$set: {processed:true}}, new: true}
          * {findandmodify: "collection", query: {processed:false}, remove: true, sort: {priority:-1}}
          * 
+         * {findandmodify: "collection", query: {state:"ready"}, sort: {priority:-1}, update: {$set: {state:"running"}}, queue: true}
+         * 
          * either update or remove is required, all other fields have default values
          * output is in the "value" field
+         *
+         * queue: true is for taking jobs off a queue.  the sort must come from an index.  the
+         * next call for the same query and sort resumes where the last one found its object,
+         * rather than rescanning the entries taken already, and the modification is applied
+         * directly - in place when it can be.
          */
         CmdFindAndModify() : Command("findandmodify") { }
         virtual bool logTheOp() {
@@ -1578,6 +1957,14 @@ namespace mongo {
             BSONObj fieldsHolder (cmdObj.getObjectField("fields"));
             const BSONObj* fields = (fieldsHolder.isEmpty() ? NULL : &fieldsHolder);
 
+            if (cmdObj["queue"].trueValue()){
+                uassert(13134, "queue findandmodify needs a sort", sort.isABSONObj());
+                BSONObj found;
+                if (queueFindOne(ns.c_str(), cmdObj.getObjectField("query"), sort.embeddedObject(), found))
+                    return queueModify(ns.c_str(), cmdObj, found, fields, errmsg, result);
+                // no index gives the sort: an ordinary findandmodify
+            }
+
             BSONObj out = db.findOne(ns, q, fields);
             if (out.firstElement().eoo()){
                 errmsg = "No matching object found";
@@ -1602,6 +1989,48 @@ namespace mongo {
 
             return true;
         }
+    private:
+        bool queueModify(const char *ns, BSONObj& cmdObj, const BSONObj& found, const BSONObj* fields, string& errmsg, BSONObjBuilder& result) {
+            if (found.isEmpty()){
+                errmsg = "No matching object found";
+                return false;
+            }
+
+            BSONObj q = BSON( "_id" << found["_id"] );
+            BSONObj out = found;
+
+            if (cmdObj["remove"].trueValue()){
+                uassert(12515, "can't remove and update", cmdObj["update"].eoo());
+                deleteObjects(ns, q, true, true);
+            } else {
+                BSONElement update = cmdObj["update"];
+                uassert(12516, "must specify remove or update", !update.eoo());
+                // an _id query: updateObjects() goes straight to the record
+                updateObjects(ns, update.embeddedObjectUserCheck(), q, false, false, true, cc().curop()->debug());
+
+                if (cmdObj["new"].trueValue() && !Helpers::findById(cc(), ns, q, out))
+                    Helpers::findOne(ns, q, out);
+            }
+
+            result.append("value", fields ? selectFields(out, *fields) : out);
+            return true;
+        }
+
+        /* as a query would return them: _id is always included */
+        static BSONObj selectFields(const BSONObj& o, const BSONObj& fields) {
+            FieldMatcher m;
+            m.add(fields);
+            BSONObjBuilder b;
+            BSONObjIterator i(o);
+            while (i.more()){
+                BSONElement e = i.next();
+                if (strcmp(e.fieldName(), "_id") == 0)
+                    b.append(e);
+                else
+                    m.append(b, e);
+            }
+            return b.obj();
+        }
     } cmdFindAndModify;
     
     /* Returns client's uri */
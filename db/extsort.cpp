@@ -27,24 +27,24 @@
 
 namespace mongo {
     
-    BSONObj BSONObjExternalSorter::extSortOrder;
-    unsigned long long BSONObjExternalSorter::_compares = 0;
+    AtomicUInt BSONObjExternalSorter::_sorterNumber;
     
     BSONObjExternalSorter::BSONObjExternalSorter( const BSONObj & order , long maxFileSize )
         : _order( order.getOwned() ) , _maxFilesize( maxFileSize ) , 
-          _arraySize(1000000), _cur(0), _curSizeSoFar(0), _sorted(0){
+          _arraySize(1000000), _cur(0), _curSizeSoFar(0), _sorted(0), _compares(0){
+        if ( currentClient.get() && cc().curop() )
+            _opNum = cc().curop()->opNum();
         
         stringstream rootpath;
         rootpath << dbpath;
         if ( dbpath[dbpath.size()-1] != '/' )
             rootpath << "/";
-        rootpath << "_tmp/esort." << time(0) << "." << rand() << "/";
+        rootpath << "_tmp/esort." << time(0) << "." << rand() << "." << _sorterNumber++ << "/";
         _root = rootpath.str();
         
         log(1) << "external sort root: " << _root.string() << endl;
 
         create_directories( _root );
-        _compares = 0;
     }
     
     BSONObjExternalSorter::~BSONObjExternalSorter(){
@@ -58,11 +58,8 @@ namespace mongo {
     }
 
     void BSONObjExternalSorter::_sortInMem(){
-        // extSortComp needs to use glbals
-        // qsort_r only seems available on bsd, which is what i really want to use
-        dblock l;
-        extSortOrder = _order;
-        _cur->sort( BSONObjExternalSorter::extSortComp );
+        // MyCmp carries the order, so several sorters can sort at once (e.g. parallel index build)
+        _cur->sort( MyCmp( _order , &_compares , _opNum ) );
     }
     
     void BSONObjExternalSorter::sort(){
@@ -215,6 +212,54 @@ namespace mongo {
         return best;
     }
 
+    // -----------------------------------
+
+    BSONObjExternalSorter::MergeIterator::MergeIterator( const vector<BSONObjExternalSorter*>& sorters ){
+        assert( sorters.size() );
+        _cmp = MyCmp( sorters[0]->_order );
+        for ( unsigned i=0; i<sorters.size(); i++ ){
+            uassert( 13103 , "not sorted" , sorters[i]->_sorted );
+            _its.push_back( new Iterator( sorters[i] ) );
+            _stash.push_back( pair<Data,bool>( Data( BSONObj() , DiskLoc() ) , false ) );
+        }
+    }
+
+    BSONObjExternalSorter::MergeIterator::~MergeIterator(){
+        for ( vector<Iterator*>::iterator i=_its.begin(); i!=_its.end(); i++ )
+            delete *i;
+        _its.clear();
+    }
+
+    bool BSONObjExternalSorter::MergeIterator::more(){
+        for ( unsigned i=0; i<_its.size(); i++ )
+            if ( _stash[i].second || _its[i]->more() )
+                return true;
+        return false;
+    }
+
+    BSONObjExternalSorter::Data BSONObjExternalSorter::MergeIterator::next(){
+        Data best;
+        int slot = -1;
+
+        for ( unsigned i=0; i<_stash.size(); i++ ){
+            if ( ! _stash[i].second ){
+                if ( _its[i]->more() )
+                    _stash[i] = pair<Data,bool>( _its[i]->next() , true );
+                else
+                    continue;
+            }
+
+            if ( slot == -1 || _cmp( _stash[i].first , best ) ){
+                best = _stash[i].first;
+                slot = i;
+            }
+        }
+
+        assert( slot >= 0 );
+        _stash[slot].second = false;
+        return best;
+    }
+
     // -----------------------------------
     
     BSONObjExternalSorter::FileIterator::FileIterator( string file ){
@@ -23,6 +23,7 @@
 #include "namespace.h"
 #include "curop.h"
 #include "../util/array.h"
+#include "../util/atomic_int.h"
 
 namespace mongo {
 
@@ -36,18 +37,6 @@ namespace mongo {
         typedef pair<BSONObj,DiskLoc> Data;
 
     private:
-        static BSONObj extSortOrder;
-
-        static int extSortComp( const void *lv, const void *rv ){
-            RARELY killCurrentOp.checkForInterrupt();
-            _compares++;
-            Data * l = (Data*)lv;
-            Data * r = (Data*)rv;
-            int cmp = l->first.woCompare( r->first , extSortOrder );
-            if ( cmp )
-                return cmp;
-            return l->second.compare( r->second );
-        };
 
         class FileIterator : boost::noncopyable {
         public:
@@ -61,12 +50,16 @@ namespace mongo {
             char * _end;
         };
 
+        /* if compares is given, counts into it and every so often checks whether opNum was
+           killed.  several sorters may sort at once in different threads (parallel index build),
+           so the count is the sorter's own rather than shared. */
         class MyCmp {
         public:
-            MyCmp( const BSONObj & order = BSONObj() ) : _order( order ){}
+            MyCmp( const BSONObj & order = BSONObj() , unsigned long long * compares = 0 , AtomicUInt opNum = AtomicUInt() )
+                : _order( order ) , _compares( compares ) , _opNum( opNum ){}
             bool operator()( const Data &l, const Data &r ) const {
-                RARELY killCurrentOp.checkForInterrupt();
-                _compares++;
+                if ( _compares && ( ++*_compares & 0xfff ) == 0 )
+                    killCurrentOp.checkForInterrupt( _opNum );
                 int x = l.first.woCompare( r.first , _order );
                 if ( x )
                     return x < 0;
@@ -75,6 +68,8 @@ namespace mongo {
 
         private:
             BSONObj _order;
+            unsigned long long * _compares;
+            AtomicUInt _opNum;
         };
 
     public:
@@ -98,6 +93,22 @@ namespace mongo {
             InMemory::iterator _it;
             
         };
+
+        /* merges the output of several sorters, e.g. one per worker of a parallel scan, into
+           a single ordered stream.  the sorters must all use the same order and already be sorted.
+         */
+        class MergeIterator : boost::noncopyable {
+        public:
+            MergeIterator( const vector<BSONObjExternalSorter*>& sorters );
+            ~MergeIterator();
+            bool more();
+            Data next();
+
+        private:
+            MyCmp _cmp;
+            vector<Iterator*> _its;
+            vector< pair<Data,bool> > _stash;
+        };
         
         BSONObjExternalSorter( const BSONObj & order = BSONObj() , long maxFileSize = 1024 * 1024 * 100 );
         ~BSONObjExternalSorter();
@@ -144,6 +155,8 @@ namespace mongo {
         list<string> _files;
         bool _sorted;
 
-        static unsigned long long _compares;
+        unsigned long long _compares;
+        AtomicUInt _opNum; // of the client that made us, which may not be the one sorting
+        static AtomicUInt _sorterNumber;
     };
 }
@@ -0,0 +1,316 @@
+// histogram.cpp
+
+/**
+*    Copyright (C) 2008 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "histogram.h"
+#include "pdfile.h"
+#include "btree.h"
+#include "curop.h"
+#include "query.h"
+#include "clientcursor.h"
+#include "commands.h"
+#include "cmdline.h"
+
+namespace mongo {
+
+    Histogram::Histogram( const BSONObj& o ) : _o( o.getOwned() ) , _nrecords( _o["nrecords"].numberLong() ){
+        BSONObjIterator b( _o.getObjectField( "bounds" ) );
+        while ( b.more() )
+            _bounds.push_back( b.next() );
+        BSONObjIterator c( _o.getObjectField( "counts" ) );
+        while ( c.more() )
+            _counts.push_back( c.next().numberLong() );
+        BSONObjIterator d( _o.getObjectField( "distinct" ) );
+        while ( d.more() )
+            _distinct.push_back( d.next().numberLong() );
+
+        if ( _counts.empty() || _bounds.size() != _counts.size() + 1 || _distinct.size() != _counts.size() ){
+            // not something analyze wrote - no estimates
+            _bounds.clear();
+            _counts.clear();
+            _distinct.clear();
+        }
+    }
+
+    static BSONObj firstField( const BSONObj& key ){
+        BSONObjBuilder b;
+        b.appendAs( key.firstElement() , "" );
+        return b.obj();
+    }
+
+    /* halves the number of closed buckets by joining neighbours.  a value that ends one bucket
+       and starts the next is only counted once in the joined bucket's distinct values.
+    */
+    static void joinBuckets( vector< BSONObj >& bounds , vector< BSONObj >& firsts , vector< long long >& counts , vector< long long >& distinct ){
+        vector< BSONObj > b( 1 , bounds[0] ) , f;
+        vector< long long > c , d;
+        for ( unsigned i=0; i<counts.size(); i+=2 ){
+            long long n = counts[i];
+            long long nd = distinct[i];
+            unsigned last = i;
+            if ( i + 1 < counts.size() ){
+                n += counts[i+1];
+                nd += distinct[i+1];
+                if ( bounds[i+1].firstElement().woCompare( firsts[i+1].firstElement() , false ) == 0 )
+                    nd--;
+                last = i + 1;
+            }
+            b.push_back( bounds[last+1] );
+            f.push_back( firsts[i] );
+            c.push_back( n );
+            d.push_back( nd );
+        }
+        bounds.swap( b );
+        firsts.swap( f );
+        counts.swap( c );
+        distinct.swap( d );
+    }
+
+    BSONObj Histogram::build( const char *ns , NamespaceDetails *d , int idxNo , int nBuckets ){
+        IndexDetails& idx = d->idx( idxNo );
+        BSONObj keyPattern = idx.keyPattern();
+        FieldRangeSet frs( ns , BSONObj() );
+        auto_ptr< ClientCursor > cc;
+        {
+            auto_ptr< Cursor > c( new BtreeCursor( d , idxNo , idx , frs.indexBounds( keyPattern , 1 ) , 1 ) );
+            cc.reset( new ClientCursor( QueryOption_NoCursorTimeout , c , ns ) );
+        }
+        Cursor *c = cc->c.get();
+
+        /* a multikey index has more keys than records, and we don't know how many until we've
+           walked them.  start from the record count and, whenever the buckets reach twice
+           nBuckets, join neighbours and double the step.
+        */
+        long long step = d->nrecords / nBuckets;
+        if ( step < 1 )
+            step = 1;
+
+        vector< BSONObj > bounds;
+        vector< BSONObj > firsts; // first key of each bucket
+        vector< long long > counts;
+        vector< long long > distinct;
+        BSONObj prev;
+        BSONObj first;
+        long long n = 0;
+        long long count = 0;
+        long long nDistinct = 0;
+        while ( c->ok() ){
+            BSONObj key = c->currKey();
+            if ( n == 0 )
+                bounds.push_back( firstField( key ) );
+            if ( count == step ){
+                bounds.push_back( firstField( prev ) );
+                firsts.push_back( first );
+                counts.push_back( count );
+                distinct.push_back( nDistinct );
+                count = nDistinct = 0;
+                if ( counts.size() >= 2 * (unsigned) nBuckets ){
+                    joinBuckets( bounds , firsts , counts , distinct );
+                    step *= 2;
+                }
+            }
+            if ( count == 0 )
+                first = firstField( key );
+            if ( count == 0 || key.firstElement().woCompare( prev.firstElement() , false ) != 0 )
+                nDistinct++;
+            prev = key;
+            count++;
+            n++;
+            c->advance();
+            if ( n % 1024 == 0 && c->ok() ){
+                killCurrentOp.checkForInterrupt();
+                // let writers in.  prev points into a bucket, which may move meanwhile
+                prev = prev.getOwned();
+                if ( ! cc->yield() ){
+                    cc.release(); // the index or collection was dropped, and the cursor with it
+                    return BSONObj();
+                }
+            }
+        }
+        if ( count ){
+            bounds.push_back( firstField( prev ) );
+            counts.push_back( count );
+            distinct.push_back( nDistinct );
+        }
+
+        if ( keyPattern.firstElement().number() < 0 ){
+            reverse( bounds.begin() , bounds.end() );
+            reverse( counts.begin() , counts.end() );
+            reverse( distinct.begin() , distinct.end() );
+        }
+
+        BSONObjBuilder b;
+        b.append( "ns" , ns );
+        b.append( "key" , keyPattern );
+        b.append( "nrecords" , d->nrecords );
+        b.append( "n" , n );
+        {
+            BSONArrayBuilder a( b.subarrayStart( "bounds" ) );
+            for ( unsigned i=0; i<bounds.size(); i++ )
+                a.append( bounds[i].firstElement() );
+            a.done();
+        }
+        {
+            BSONArrayBuilder a( b.subarrayStart( "counts" ) );
+            for ( unsigned i=0; i<counts.size(); i++ )
+                a.append( counts[i] );
+            a.done();
+        }
+        {
+            BSONArrayBuilder a( b.subarrayStart( "distinct" ) );
+            for ( unsigned i=0; i<distinct.size(); i++ )
+                a.append( distinct[i] );
+            a.done();
+        }
+        return b.obj();
+    }
+
+    bool Histogram::current( NamespaceDetails *d ) const {
+        return ! _counts.empty() && d->nrecords <= 2 * _nrecords && _nrecords <= 2 * d->nrecords;
+    }
+
+    double Histogram::estimate( const FieldRange& r ) const {
+        double n = 0;
+        for ( vector< FieldInterval >::const_iterator i = r.intervals().begin(); i != r.intervals().end(); ++i )
+            n += estimate( *i );
+        return n;
+    }
+
+    /* buckets entirely in the interval count in full, a point in a bucket counts as one of its
+       distinct values, and the rest of a partly covered bucket is interpolated for numbers and
+       taken as half otherwise.
+    */
+    double Histogram::estimate( const FieldInterval& i ) const {
+        const FieldBound& l = i.lower_;
+        const FieldBound& u = i.upper_;
+        bool point = l.bound_.woCompare( u.bound_ , false ) == 0;
+        double n = 0;
+        for ( unsigned b=0; b<_counts.size(); b++ ){
+            const BSONElement& lb = _bounds[b];
+            const BSONElement& ub = _bounds[b+1];
+
+            int ul = u.bound_.woCompare( lb , false );
+            int lu = l.bound_.woCompare( ub , false );
+            if ( ul < 0 || ( ul == 0 && ! u.inclusive_ ) || lu > 0 || ( lu == 0 && ! l.inclusive_ ) )
+                continue;
+
+            int ll = l.bound_.woCompare( lb , false );
+            int uu = u.bound_.woCompare( ub , false );
+            if ( ( ll < 0 || ( ll == 0 && l.inclusive_ ) ) && ( uu > 0 || ( uu == 0 && u.inclusive_ ) ) ){
+                n += _counts[b];
+                continue;
+            }
+
+            if ( point ){
+                n += (double) _counts[b] / _distinct[b];
+                continue;
+            }
+
+            double f = 0.5;
+            if ( lb.isNumber() && ub.isNumber() && ub.number() > lb.number() ){
+                double lo = l.bound_.isNumber() ? max( l.bound_.number() , lb.number() ) : lb.number();
+                double hi = u.bound_.isNumber() ? min( u.bound_.number() , ub.number() ) : ub.number();
+                f = ( hi - lo ) / ( ub.number() - lb.number() );
+                if ( f < 0 )
+                    f = 0;
+                if ( f > 1 )
+                    f = 1;
+            }
+            n += f * _counts[b];
+        }
+        return n;
+    }
+
+    /* { analyze : <collection> [ , buckets : <n> ] } */
+    class AnalyzeCommand : public Command {
+    public:
+        AnalyzeCommand() : Command( "analyze" ){}
+        virtual bool slaveOk(){ return true; }
+        // walks the indexes in a read lock, yielding, and only takes the write lock to store the results
+        virtual LockType locktype(){ return NONE; }
+        virtual void help( stringstream& help ) const {
+            help << "builds histograms of a collection's indexes for the query optimizer\n"
+                 << "{ analyze : <collection> [ , buckets : <n> ] }";
+        }
+
+        bool run(const char *dbname, BSONObj& cmdObj, string& errmsg, BSONObjBuilder& result, bool fromRepl ){
+            string db = nsToDatabase( dbname );
+            string ns = db + "." + cmdObj.firstElement().valuestrsafe();
+            int nBuckets = cmdObj["buckets"].isNumber() ? cmdObj["buckets"].numberInt() : 100;
+            if ( nBuckets < 1 || nBuckets > 1000 ){
+                errmsg = "buckets must be from 1 to 1000";
+                return false;
+            }
+            if ( !cmdLine.quiet )
+                log() << "CMD: analyze " << ns << endl;
+
+            vector< BSONObj > histograms;
+            {
+                readlock lk( ns );
+                // build() yields to writers: an index dropped meanwhile starts the walk over
+                for ( int tries=0; ; tries++ ){
+                    Client::Context ctx( ns );
+                    NamespaceDetails *d = nsdetails( ns.c_str() );
+                    if ( ! d ){
+                        errmsg = tries ? "ns dropped during analyze" : "ns not found";
+                        return false;
+                    }
+                    histograms.clear();
+                    bool complete = true;
+                    for ( int i=0; i<d->nIndexes && complete; i++ ){
+                        // special indexes (geo) have keys the histograms don't understand
+                        if ( d->idx( i ).getSpec().getType() )
+                            continue;
+                        BSONObj h = Histogram::build( ns.c_str() , d , i , nBuckets );
+                        if ( h.isEmpty() )
+                            complete = false;
+                        else
+                            histograms.push_back( h );
+                    }
+                    if ( complete )
+                        break;
+                    if ( tries == 2 ){
+                        errmsg = "indexes kept changing during analyze";
+                        return false;
+                    }
+                }
+            }
+
+            writelock lk( ns );
+            Client::Context ctx( ns );
+            if ( ! nsdetails( ns.c_str() ) ){
+                errmsg = "ns dropped during analyze";
+                return false;
+            }
+            string hns = db + ".system.histograms";
+            deleteObjects( hns.c_str() , BSON( "ns" << ns ) , false , false , true );
+            for ( unsigned i=0; i<histograms.size(); i++ )
+                theDataFileMgr.insert( hns.c_str() , histograms[i].objdata() , histograms[i].objsize() , true );
+
+            {
+                scoped_lock lk( NamespaceDetailsTransient::_qcMutex );
+                NamespaceDetailsTransient::get_inlock( ns.c_str() ).histogramsChanged();
+            }
+
+            result.append( "ns" , ns );
+            result.append( "nIndexes" , (int) histograms.size() );
+            return true;
+        }
+    } analyzeCmd;
+
+} // namespace mongo
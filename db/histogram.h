@@ -0,0 +1,66 @@
+// histogram.h
+
+/**
+*    Copyright (C) 2008 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* equi-depth histograms of the first field of an index's keys, for the query optimizer.
+
+   the analyze command walks each index of a collection and stores one document per index in
+   <db>.system.histograms:
+     { ns : "test.foo" , key : { a : 1 } , nrecords : 10000 , n : 10000 ,
+       bounds : [ 0 , 17 , 40 , ... ] , counts : [ 100 , 100 , ... ] , distinct : [ 12 , 20 , ... ] }
+   bucket i holds counts[i] keys, distinct[i] of them different, from bounds[i] to bounds[i+1].
+   bounds are ascending even when the index field is descending.
+*/
+
+#pragma once
+
+#include "../stdafx.h"
+#include "jsobj.h"
+#include "queryutil.h"
+
+namespace mongo {
+
+    class NamespaceDetails;
+    class IndexDetails;
+
+    class Histogram : boost::noncopyable {
+    public:
+        /* @param o a system.histograms document */
+        Histogram( const BSONObj& o );
+
+        /* walks the index and builds its document, with about nBuckets buckets.  you must hold
+           the read lock once: it is released every so often for writers.
+           @return empty if the index or collection was dropped while the lock was released */
+        static BSONObj build( const char *ns , NamespaceDetails *d , int idxNo , int nBuckets );
+
+        /* estimated number of keys whose first field is in the range */
+        double estimate( const FieldRange& r ) const;
+
+        /* false if the collection changed so much since analyze that the estimates are useless */
+        bool current( NamespaceDetails *d ) const;
+
+    private:
+        double estimate( const FieldInterval& i ) const;
+
+        BSONObj _o;
+        long long _nrecords;
+        vector< BSONElement > _bounds;
+        vector< long long > _counts;
+        vector< long long > _distinct;
+    };
+
+} // namespace mongo
@@ -182,6 +182,21 @@ namespace mongo {
             uasserted(10098 , s.c_str());
         }
 
+        BSONElement filter = io["filter"];
+        if ( ! filter.eoo() ) {
+            uassert(13108, "index filter must be an object", filter.type() == Object);
+            uassert(13109, "_id index can't have a filter", !IndexDetails::isIdIndexPattern(key));
+            set<string> names;
+            IndexSpec::filterFieldNames(filter.embeddedObject(), names);
+            uassert(13110, "$where not allowed in an index filter", names.count("$where") == 0);
+        }
+
+        BSONElement expire = io["expireAfterSeconds"];
+        if ( ! expire.eoo() ) {
+            uassert(13131, "expireAfterSeconds must be a non-negative number", expire.isNumber() && expire.number() >= 0);
+            uassert(13132, "an index with expireAfterSeconds must be on a single field", key.nFields() == 1);
+        }
+
         if ( sourceNS.empty() || key.isEmpty() ) {
             log(2) << "bad add index attempt name:" << (name?name:"") << "\n  ns:" <<
                 sourceNS << "\n  idxobj:" << io.toString() << endl;
@@ -202,6 +217,8 @@ namespace mongo {
             assert( sourceCollection );
         }
 
+        uassert(13133, "capped collections can't have ttl indexes", expire.eoo() || !sourceCollection->capped);
+
         if ( sourceCollection->findIndexByName(name) >= 0 ) {
             // index already exists.
             return false;
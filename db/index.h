@@ -119,6 +119,12 @@ namespace mongo {
                 isIdIndex();
         }
 
+        /* if set, btree buckets keep the number of keys below them, so ranges can be counted
+           without walking them */
+        bool counted() const {
+            return info.obj()["counted"].trueValue();
+        }
+
         /* if set, when building index, if any duplicates, drop the duplicating object */
         bool dropDups() const {
             return info.obj().getBoolField( "dropDups" );
@@ -22,6 +22,7 @@
 #include "btree.h"
 #include "query.h"
 #include "background.h"
+#include "matcher.h"
 
 namespace mongo {
 
@@ -76,6 +77,12 @@ namespace mongo {
         _nullObj = b.obj();
         _nullElt = _nullObj.firstElement();
         
+        BSONElement f = info["filter"];
+        if ( f.type() == Object && ! f.embeddedObject().isEmpty() ){
+            _filterObj = f.embeddedObject().getOwned();
+            _filter.reset( new Matcher( _filterObj ) );
+        }
+
         if ( pluginName.size() ){
             IndexPlugin * plugin = IndexPlugin::get( pluginName );
             if ( ! plugin ){
@@ -90,6 +97,8 @@ namespace mongo {
 
     
     void IndexSpec::getKeys( const BSONObj &obj, BSONObjSetDefaultOrder &keys ) const {
+        if ( _filter && ! _filter->matches( obj ) )
+            return;
         if ( _indexType.get() ){
             _indexType->getKeys( obj , keys );
             return;
@@ -205,6 +214,71 @@ namespace mongo {
         return HELPFUL;
     }
 
+    void IndexSpec::filterFieldNames( const BSONObj& filter , set<string>& names ){
+        BSONObjIterator i( filter );
+        while ( i.more() ){
+            BSONElement e = i.next();
+            if ( strcmp( e.fieldName() , "$or" ) == 0 && e.type() == Array ){
+                BSONObjIterator j( e.embeddedObject() );
+                while ( j.more() ){
+                    BSONElement clause = j.next();
+                    if ( clause.type() == Object )
+                        filterFieldNames( clause.embeddedObject() , names );
+                }
+            }
+            else {
+                names.insert( e.fieldName() );
+            }
+        }
+    }
+
+    /* true if e is matched against an array by trying each of its elements, the way an equality is -
+       so whatever element made an equality match also satisfies e.  not so for $ne, $nin, $size...
+    */
+    static bool anyElementCondition( const BSONElement& e ){
+        if ( e.type() != Object || e.embeddedObject().firstElement().fieldName()[0] != '$' )
+            return true; // equality
+        BSONObjIterator i( e.embeddedObject() );
+        while ( i.more() ){
+            BSONElement o = i.next();
+            const char *op = o.fieldName();
+            if ( strcmp( op , "$gt" ) && strcmp( op , "$gte" ) && strcmp( op , "$lt" ) && 
+                 strcmp( op , "$lte" ) && strcmp( op , "$in" ) &&
+                 ! ( strcmp( op , "$exists" ) == 0 && o.trueValue() ) )
+                return false;
+        }
+        return true;
+    }
+
+    /* conservative: each condition of the filter must either be in the query as is, or be a
+       condition that accepts the value of an equality on the same field in the query.
+    */
+    bool IndexSpec::usableFor( const BSONObj& query ) const {
+        if ( _filterObj.isEmpty() )
+            return true;
+        BSONObjIterator i( _filterObj );
+        while ( i.more() ){
+            BSONElement f = i.next();
+            BSONElement q = query.getField( f.fieldName() );
+            if ( q.eoo() )
+                return false;
+            if ( q.woCompare( f ) == 0 )
+                continue;
+            if ( f.fieldName()[0] == '$' || ! anyElementCondition( f ) )
+                return false;
+            if ( q.type() == Array || q.type() == RegEx || 
+                 ( q.type() == Object && q.embeddedObject().firstElement().fieldName()[0] == '$' ) )
+                return false; // not an equality
+            BSONObjBuilder fb , qb;
+            fb.appendAs( f , "x" );
+            qb.appendAs( q , "x" );
+            Matcher m( fb.obj() );
+            if ( ! m.matches( qb.obj() ) )
+                return false;
+        }
+        return true;
+    }
+
     IndexSuitability IndexType::suitability( const BSONObj& query , const BSONObj& order ) const {
         return _spec->_suitability( query , order );
     }
@@ -29,6 +29,7 @@ namespace mongo {
     class IndexType; // TODO: this name sucks
     class IndexPlugin;
     class IndexDetails;
+    class Matcher;
 
     enum IndexSuitability { USELESS = 0 , HELPFUL = 1 , OPTIMAL = 2 };
 
@@ -142,6 +143,17 @@ namespace mongo {
 
         IndexSuitability suitability( const BSONObj& query , const BSONObj& order ) const ;
 
+        /* the index's filter, e.g. { state : { $ne : "done" } }.  only objects matching it are 
+           indexed - getKeys() gives no keys at all for the others.  empty if there is none.
+        */
+        const BSONObj& filter() const { return _filterObj; }
+
+        /* true if every object matching query is in the index, i.e. the query implies the filter */
+        bool usableFor( const BSONObj& query ) const;
+
+        /* the fields a filter looks at, including those inside $or */
+        static void filterFieldNames( const BSONObj& filter , set<string>& names );
+
     protected:
 
         IndexSuitability _suitability( const BSONObj& query , const BSONObj& order ) const ;
@@ -159,6 +171,9 @@ namespace mongo {
         
         shared_ptr<IndexType> _indexType;
 
+        BSONObj _filterObj;
+        shared_ptr<Matcher> _filter;
+
         const IndexDetails * _details;
         
         void _init();
@@ -364,7 +364,13 @@ namespace mongo {
                 mongolock lk(true);
                 if ( dbHolder.isLoaded( nsToDatabase( currentOp.getNS() ) , dbpath ) ){
                     Client::Context c( currentOp.getNS() );
-                    profile(ss.str().c_str(), ms);
+                    BSONObj stats;
+                    if ( ! debug.stats.empty() ) {
+                        BSONObjBuilder b;
+                        debug.stats.append( b );
+                        stats = b.obj();
+                    }
+                    profile(ss.str().c_str(), ms, stats);
                 }
                 else {
                     mongo::log() << "note: not profiling because db went away - probably a close on: " << currentOp.getNS() << endl;
@@ -530,12 +536,19 @@ namespace mongo {
 
         writelock lk(ns);
         Client::Context ctx(ns);		
+        vector< BSONObj > objs;
+        bool tooLarge = false;
         while ( d.moreJSObjs() ) {
             BSONObj js = d.nextJsObj();
-            uassert( 10059 , "object to insert too large", js.objsize() <= MaxBSONObjectSize);
-            theDataFileMgr.insert(ns, js, false);
-            logOp("i", ns, js);
+            if ( js.objsize() > MaxBSONObjectSize ) {
+                tooLarge = true;
+                break;
+            }
+            objs.push_back( js );
         }
+        // the objects before one that's too large are still inserted
+        theDataFileMgr.insertBatchAndLog(ns, objs);
+        uassert( 10059 , "object to insert too large", !tooLarge );
     }
 
     class JniMessagingPort : public AbstractMessagingPort {
@@ -26,12 +26,14 @@
 
 namespace mongo {
 
-    void profile( const char *str, int millis)
+    void profile( const char *str, int millis, const BSONObj& stats )
     {
         BSONObjBuilder b;
         b.appendDate("ts", jsTime());
         b.append("info", str);
         b.append("millis", (double) millis);
+        if ( ! stats.isEmpty() )
+            b.append("stats", stats);
         BSONObj p = b.done();
         theDataFileMgr.insert(cc().database()->profileName.c_str(),
                               p.objdata(), p.objsize(), true);
@@ -29,7 +29,9 @@ namespace mongo {
        do when database->profile is set
     */
 
+    /* stats: where the time went, see OpStats.  left out if empty */
     void profile(const char *str,
-                 int millis);
+                 int millis,
+                 const BSONObj& stats = BSONObj());
 
 } // namespace mongo
@@ -85,6 +85,98 @@ namespace mongo {
         where = 0;
     }
 
+    static inline unsigned fnv( unsigned h, const char *p, int len ) {
+        for( int i = 0; i < len; ++i ) {
+            h ^= (unsigned char) p[ i ];
+            h *= 16777619;
+        }
+        return h;
+    }
+
+    unsigned ElementHashSet::hash( const BSONElement &e ) {
+        unsigned h = 2166136261U ^ ( e.canonicalType() * 0x9e3779b1 );
+        switch( e.type() ) {
+        case NumberInt:
+        case NumberLong:
+        case NumberDouble: {
+            double d = e.number();
+            // -0 == 0, and compareElementValues() has every nan and infinity equal
+            if ( d == 0 || !( d <= numeric_limits< double >::max() && d >= -numeric_limits< double >::max() ) )
+                return h;
+            return fnv( h, (const char *) &d, sizeof( d ) );
+        }
+        case Date:
+        case Timestamp: {
+            unsigned long long t = e.date();
+            return fnv( h, (const char *) &t, sizeof( t ) );
+        }
+        case Bool:
+            return fnv( h, e.value(), 1 );
+        case jstOID:
+            return fnv( h, e.value(), 12 );
+        case Code:
+        case Symbol:
+        case String:
+            return fnv( h, e.valuestr(), strlen( e.valuestr() ) );
+        case BinData:
+            // length, subtype and bytes
+            return fnv( h, e.value(), 4 + 1 + *(int *)( e.value() ) );
+        default:
+            // MinKey, MaxKey, null and undefined: one value per type
+            return h;
+        }
+    }
+
+    bool ElementHashSet::hashable( const BSONElement &e ) {
+        switch( e.type() ) {
+        case NumberInt:
+        case NumberLong:
+        case NumberDouble:
+        case Date:
+        case Timestamp:
+        case Bool:
+        case jstOID:
+        case Code:
+        case Symbol:
+        case String:
+        case BinData:
+        case MinKey:
+        case MaxKey:
+        case jstNULL:
+        case Undefined:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    void ElementHashSet::insert( const BSONElement &e ) {
+        if ( count( e ) )
+            return;
+        if ( ( _n + 1 ) * 2 > _slots.size() ) {
+            vector< BSONElement > old( _slots.size() * 2 );
+            old.swap( _slots );
+            _n = 0;
+            for( vector< BSONElement >::const_iterator i = old.begin(); i != old.end(); ++i )
+                if ( !i->eoo() )
+                    insert( *i );
+        }
+        unsigned mask = _slots.size() - 1;
+        unsigned i = hash( e ) & mask;
+        while( !_slots[ i ].eoo() )
+            i = ( i + 1 ) & mask;
+        _slots[ i ] = e;
+        ++_n;
+    }
+
+    bool ElementHashSet::count( const BSONElement &e ) const {
+        unsigned mask = _slots.size() - 1;
+        for( unsigned i = hash( e ) & mask; !_slots[ i ].eoo(); i = ( i + 1 ) & mask )
+            if ( equal( _slots[ i ], e ) )
+                return true;
+        return false;
+    }
+
     ElementMatcher::ElementMatcher( BSONElement _e , int _op, bool _isNot ) : toMatch( _e ) , compareOp( _op ), isNot( _isNot ) {
         if ( _op == BSONObj::opMOD ){
             BSONObj o = _e.embeddedObject();
@@ -107,6 +199,8 @@ namespace mongo {
         : toMatch( _e ) , compareOp( _op ), isNot( _isNot ) {
         
         myset.reset( new set<BSONElement,element_lt>() );
+        if ( _op == BSONObj::opIN )
+            myhashset.reset( new ElementHashSet() );
         
         BSONObjIterator i( array );
         while ( i.more() ) {
@@ -130,6 +224,8 @@ namespace mongo {
                 string prefix = simpleRegex(rm.regex, rm.flags, &purePrefix);
                 if (purePrefix)
                     rm.prefix = prefix;
+            } else if ( myhashset && ElementHashSet::hashable( ie ) ) {
+                myhashset->insert(ie);
             } else {
                 myset->insert(ie);
             }
@@ -373,6 +469,125 @@ namespace mongo {
         }
         
         constrainIndexKey_ = constrainIndexKey;
+
+        if ( constrainIndexKey_.isEmpty() && !where && nRegex == 0 && _orMatchers.empty() ) {
+            _compiled.reset( new CompiledMatcher() );
+            if ( !_compiled->compile( basics ) )
+                _compiled.reset();
+        }
+    }
+
+    bool CompiledMatcher::compile( const vector< ElementMatcher > &basics ) {
+        for( vector< ElementMatcher >::const_iterator i = basics.begin(); i != basics.end(); ++i ) {
+            switch( i->compareOp ) {
+                case BSONObj::Equality:
+                case BSONObj::LT:
+                case BSONObj::LTE:
+                case BSONObj::GT:
+                case BSONObj::GTE:
+                    break;
+                default:
+                    return false;
+            }
+            const BSONElement &m = i->toMatch;
+            if ( i->isNot || m.type() == Array || strchr( m.fieldName(), '.' ) )
+                return false;
+
+            Op op;
+            op.compareOp = i->compareOp;
+            op.toMatch = m;
+            op.number = 0;
+            op.numberNan = false;
+            if ( m.type() == NumberInt || m.type() == NumberDouble ) {
+                op.kind = CmpNumber;
+                op.number = m.number();
+                op.numberNan = !( op.number <= numeric_limits< double >::max() &&
+                                  op.number >= -numeric_limits< double >::max() );
+            }
+            else if ( m.type() == String || m.type() == Symbol ) {
+                op.kind = CmpString;
+            }
+            else {
+                op.kind = CmpOther;
+            }
+            bool missingOk = m.type() == jstNULL || m.type() == Undefined;
+
+            vector< Field >::iterator f = _fields.begin();
+            while( f != _fields.end() && f->name != m.fieldName() )
+                ++f;
+            if ( f == _fields.end() ) {
+                if ( _fields.size() == 31 )
+                    return false;
+                Field field;
+                field.name = m.fieldName();
+                field.missingOk = true;
+                _fields.push_back( field );
+                f = _fields.end() - 1;
+            }
+            f->missingOk = f->missingOk && missingOk;
+            f->ops.push_back( op );
+        }
+        return true;
+    }
+
+    /* same results as valuesMatch() for a non array value, without the generic dispatch */
+    inline bool CompiledMatcher::test( const Op &op, const BSONElement &e ) {
+        int c;
+        switch( op.kind ) {
+            case CmpNumber: {
+                if ( !e.isNumber() )
+                    return false;
+                double left = e.number();
+                bool lNan = !( left <= numeric_limits< double >::max() &&
+                               left >= -numeric_limits< double >::max() );
+                if ( lNan || op.numberNan )
+                    c = lNan == op.numberNan ? 0 : ( lNan ? -1 : 1 );
+                else
+                    c = left < op.number ? -1 : ( left == op.number ? 0 : 1 );
+                break;
+            }
+            case CmpString:
+                if ( e.type() != String && e.type() != Symbol )
+                    return false;
+                c = strcmp( e.valuestr(), op.toMatch.valuestr() );
+                break;
+            default:
+                if ( e.canonicalType() != op.toMatch.canonicalType() )
+                    return false;
+                c = compareElementValues( e, op.toMatch );
+        }
+        if ( op.compareOp == BSONObj::Equality )
+            return c == 0;
+        if ( c < -1 ) c = -1;
+        if ( c > 1 ) c = 1;
+        return ( op.compareOp & ( 1 << ( c + 1 ) ) ) != 0;
+    }
+
+    int CompiledMatcher::matches( const BSONObj &o ) const {
+        const unsigned n = _fields.size();
+        const unsigned all = ( 1U << n ) - 1;
+        unsigned seen = 0;
+        BSONObjIterator i( o );
+        while( seen != all && i.more() ) {
+            BSONElement e = i.next();
+            const char *name = e.fieldName();
+            for( unsigned f = 0; f < n; ++f ) {
+                const Field &field = _fields[ f ];
+                if ( ( seen & ( 1U << f ) ) || field.name[ 0 ] != name[ 0 ] || strcmp( field.name.c_str(), name ) != 0 )
+                    continue;
+                seen |= 1U << f;
+                if ( e.type() == Array )
+                    return 0;
+                for( vector< Op >::const_iterator j = field.ops.begin(); j != field.ops.end(); ++j )
+                    if ( !test( *j, e ) )
+                        return -1;
+                break;
+            }
+        }
+        for( unsigned f = 0; f < n; ++f )
+            if ( !( seen & ( 1U << f ) ) && !_fields[ f ].missingOk )
+                return -1;
+        return 1;
     }
     
     inline bool regexMatches(const RegexMatcher& rm, const BSONElement& e) {
@@ -399,9 +614,10 @@ namespace mongo {
         
         if ( op == BSONObj::opIN ) {
             // { $in : [1,2,3] }
-            int count = bm.myset->count(l);
-            if ( count )
-                return count;
+            if ( bm.myhashset->count(l) )
+                return 1;
+            if ( bm.myset->size() && bm.myset->count(l) )
+                return 1;
             if ( bm.myregex.get() ) {
                 for( vector<RegexMatcher>::const_iterator i = bm.myregex->begin(); i != bm.myregex->end(); ++i ) {
                     if ( regexMatches( *i, l ) ) {
@@ -679,6 +895,12 @@ namespace mongo {
     /* See if an object matches the query.
     */
     bool Matcher::matches(const BSONObj& jsobj , MatchDetails * details ) {
+        if ( _compiled.get() ) {
+            int ret = _compiled->matches( jsobj );
+            if ( ret != 0 )
+                return ret > 0;
+        }
+
         /* assuming there is usually only one thing to match.  if more this
         could be slow sometimes. */
 
@@ -51,6 +51,26 @@ namespace mongo {
         }
     };
 
+    /* the values of an $in, hashed so that membership is one probe rather than a walk down a
+       set<> of woCompare calls.  values element_lt considers equal (1, 1.0, NumberLong(1)) hash
+       alike.  values of types without a cheap normal form (objects, arrays, code with scope...)
+       aren't hashable() and stay in a set<>.
+    */
+    class ElementHashSet : boost::noncopyable {
+    public:
+        ElementHashSet() : _n() { _slots.resize( 16 ); }
+        void insert( const BSONElement &e );
+        bool count( const BSONElement &e ) const;
+        unsigned size() const { return _n; }
+        static bool hashable( const BSONElement &e );
+    private:
+        static unsigned hash( const BSONElement &e );
+        static bool equal( const BSONElement &l, const BSONElement &r ) {
+            return l.canonicalType() == r.canonicalType() && compareElementValues( l, r ) == 0;
+        }
+        vector< BSONElement > _slots; // open addressing, eoo() when free
+        unsigned _n;
+    };
     
     class ElementMatcher {
     public:
@@ -68,6 +88,7 @@ namespace mongo {
         int compareOp;
         bool isNot;
         shared_ptr< set<BSONElement,element_lt> > myset;
+        shared_ptr< ElementHashSet > myhashset; // $in values that are hashable(), the rest in myset
         shared_ptr< vector<RegexMatcher> > myregex;
         
         // these are for specific operators
@@ -104,6 +125,35 @@ namespace mongo {
         const char * elemMatchKey; // warning, this may go out of scope if matched object does
     };
 
+    /* A query made only of comparisons on top level fields, e.g.
+         { a : 5 , b : { $gt : 3 , $lt : 9 } }
+       compiled so that one pass over an object finds every field the query references and
+       each comparison is typed up front.  Anything else is left to Matcher's interpreter.
+    */
+    class CompiledMatcher : boost::noncopyable {
+    public:
+        /** @return false if some predicate can't be compiled */
+        bool compile( const vector< ElementMatcher > &basics );
+        /** 1 match, -1 mismatch, 0 an array value was found: the caller must interpret */
+        int matches( const BSONObj &o ) const;
+    private:
+        enum Kind { CmpNumber, CmpString, CmpOther };
+        struct Op {
+            int compareOp;
+            Kind kind;
+            double number;
+            bool numberNan;
+            BSONElement toMatch;
+        };
+        struct Field {
+            string name;
+            bool missingOk;
+            vector< Op > ops;
+        };
+        static bool test( const Op &op, const BSONElement &e );
+        vector< Field > _fields;
+    };
+
     /* Match BSON objects against a query pattern.
 
        e.g.
@@ -189,6 +239,8 @@ namespace mongo {
         vector< shared_ptr< BSONObjBuilder > > _builders;
         vector< shared_ptr< Matcher > > _orMatchers;
 
+        auto_ptr< CompiledMatcher > _compiled; // set if the whole query compiled
+
         friend class CoveredIndexMatcher;
     };
     
@@ -28,6 +28,7 @@
 #include "query.h"
 #include "queryutil.h"
 #include "json.h"
+#include "histogram.h"
 
 namespace mongo {
 
@@ -623,6 +624,70 @@ namespace mongo {
         clearQueryCache();
         _keysComputed = false;
         _indexSpecs.clear();
+        _histogramsLoaded = false;
+        _histograms.clear();
+        _queuePositions.clear();
+    }
+
+    NamespaceDetailsTransient::QueuePosition& NamespaceDetailsTransient::addQueuePosition( const BSONObj& querySort, int idxNo, int direction ) {
+        if ( _queuePositions.size() >= MaxQueuePositions && !_queuePositions.count( querySort ) ) {
+            map< BSONObj, QueuePosition, BSONObjCmp >::iterator oldest = _queuePositions.begin();
+            for( map< BSONObj, QueuePosition, BSONObjCmp >::iterator i = _queuePositions.begin(); i != _queuePositions.end(); ++i )
+                if ( i->second.lastUsed < oldest->second.lastUsed )
+                    oldest = i;
+            _queuePositions.erase( oldest );
+        }
+        QueuePosition& p = _queuePositions[ querySort.getOwned() ];
+        p = QueuePosition();
+        p.idxNo = idxNo;
+        p.direction = direction;
+        p.lastUsed = ++_queueUses;
+        return p;
+    }
+
+    void NamespaceDetailsTransient::_queueDocumentWritten( const BSONObj& obj, const DiskLoc& loc ) {
+        NamespaceDetails *d = nsdetails( _ns.c_str() );
+        if ( !d )
+            return;
+        for( map< BSONObj, QueuePosition, BSONObjCmp >::iterator i = _queuePositions.begin(); i != _queuePositions.end(); ++i ) {
+            QueuePosition& p = i->second;
+            if ( p.key.isEmpty() || p.idxNo >= d->nIndexes )
+                continue;
+            IndexDetails& idx = d->idx( p.idxNo );
+            BSONObj keyPattern = idx.keyPattern();
+            BSONObjSetDefaultOrder keys;
+            idx.getKeysFromObject( obj, keys );
+            for( BSONObjSetDefaultOrder::iterator k = keys.begin(); k != keys.end(); ++k ) {
+                int c = k->woCompare( p.key, keyPattern );
+                if ( c == 0 )
+                    c = loc.compare( p.loc );
+                if ( c * p.direction < 0 ) {
+                    p.key = k->getOwned();
+                    p.loc = loc;
+                }
+            }
+        }
+    }
+
+    /* read with a plain collection scan: the query optimizer would need the qcMutex we hold */
+    void NamespaceDetailsTransient::loadHistograms() {
+        _histogramsLoaded = true;
+        _histograms.clear();
+        string hns = Namespace( _ns.c_str() ).getSisterNS( "system.histograms" );
+        if ( !nsdetails( hns.c_str() ) )
+            return;
+        for( auto_ptr< Cursor > c = theDataFileMgr.findAll( hns.c_str() ); c->ok(); c->advance() ) {
+            BSONObj o = c->current();
+            if ( strcmp( o.getStringField( "ns" ), _ns.c_str() ) == 0 )
+                _histograms[ o.getObjectField( "key" ).toString() ].reset( new Histogram( o ) );
+        }
+    }
+
+    shared_ptr< Histogram > NamespaceDetailsTransient::histogram( const BSONObj &keyPattern ) {
+        if ( !_histogramsLoaded )
+            loadHistograms();
+        map< string, shared_ptr< Histogram > >::const_iterator i = _histograms.find( keyPattern.toString() );
+        return i == _histograms.end() ? shared_ptr< Histogram >() : i->second;
     }
     
 /*    NamespaceDetailsTransient& NamespaceDetailsTransient::get(const char *ns) {
@@ -650,8 +715,12 @@ namespace mongo {
         if ( ! d )
             return;
         NamespaceDetails::IndexIterator i = d->ii();
-        while( i.more() )
-            i.next().keyPattern().getFieldNames(_indexKeys);
+        while( i.more() ) {
+            IndexDetails& idx = i.next();
+            idx.keyPattern().getFieldNames(_indexKeys);
+            // an update to a filter field can add the object to, or drop it from, the index
+            IndexSpec::filterFieldNames(idx.info.obj().getObjectField("filter"), _indexKeys);
+        }
     }
 
     void NamespaceDetailsTransient::cllStart( int logSizeMb ) {
@@ -259,7 +259,7 @@ namespace mongo {
         unsigned long long reservedA;
         long long extraOffset; // where the $extra info is located (bytes relative to this)
     public:
-        int backgroundIndexBuildInProgress; // 1 if in prog
+        int backgroundIndexBuildInProgress; // # of indexes being built in the background, 0 if none
         char reserved[76];
 
         /* when a background index build is in progress, we don't count the index in nIndexes until 
@@ -282,9 +282,9 @@ namespace mongo {
                 return _indexes[idxNo];
             return extra()->details[idxNo-NIndexesBase];
         }
-        IndexDetails& backgroundIdx() { 
-            DEV assert(backgroundIndexBuildInProgress);
-            return idx(nIndexes);
+        IndexDetails& backgroundIdx( int i = 0 ) { 
+            DEV assert(i < backgroundIndexBuildInProgress);
+            return idx(nIndexes + i);
         }
 
         class IndexIterator { 
@@ -464,6 +464,8 @@ namespace mongo {
 
        todo: cleanup code, need abstractions and separation
     */
+    class Histogram;
+
     class NamespaceDetailsTransient : boost::noncopyable {
         /* general ------------------------------------------------------------- */
     private:
@@ -471,7 +473,7 @@ namespace mongo {
         void reset();
         static std::map< string, shared_ptr< NamespaceDetailsTransient > > _map;
     public:
-        NamespaceDetailsTransient(const char *ns) : _ns(ns), _keysComputed(false), _qcWriteCount(), _cll_enabled() { }
+        NamespaceDetailsTransient(const char *ns) : _ns(ns), _keysComputed(false), _qcWriteCount(), _queueUses(0), _histogramsLoaded(false), _cll_enabled() { }
         /* _get() is not threadsafe -- see get_inlock() comments */
         static NamespaceDetailsTransient& _get(const char *ns);
         /* use get_w() when doing write operations */
@@ -551,6 +553,59 @@ namespace mongo {
             _qcCache[ pattern ] = make_pair( indexKey, nScanned );
         }
 
+        /* queue positions for findandmodify with queue:true --------------------- */
+        /* assumed to be in write lock for this */
+    public:
+        /* where the last queue findandmodify for a query and sort stopped in index idxNo.  no
+           entry before key:loc in scan order matches the query, so the next one resumes there.
+        */
+        struct QueuePosition {
+            QueuePosition() : idxNo( -1 ), direction( 1 ), lastUsed( 0 ) { }
+            int idxNo;
+            int direction;
+            BSONObj key;
+            DiskLoc loc;
+            unsigned long long lastUsed;
+        };
+        /* every write checks each position, so only the most recently used are kept */
+        enum { MaxQueuePositions = 32 };
+    private:
+        map< BSONObj, QueuePosition, BSONObjCmp > _queuePositions; // by { q : query , s : sort }
+        unsigned long long _queueUses;
+        void _queueDocumentWritten( const BSONObj& obj, const DiskLoc& loc );
+    public:
+        /* @return 0 if there is no position for this query and sort */
+        QueuePosition* findQueuePosition( const BSONObj& querySort ) {
+            map< BSONObj, QueuePosition, BSONObjCmp >::iterator i = _queuePositions.find( querySort );
+            if ( i == _queuePositions.end() )
+                return 0;
+            i->second.lastUsed = ++_queueUses;
+            return &i->second;
+        }
+        /* replaces the least recently used position when there are MaxQueuePositions */
+        QueuePosition& addQueuePosition( const BSONObj& querySort, int idxNo, int direction );
+        /* an inserted or updated document may match now: positions after it move back to it */
+        void queueDocumentWritten( const BSONObj& obj, const DiskLoc& loc ) {
+            if ( _queuePositions.empty() )
+                return;
+            _queueDocumentWritten( obj, loc );
+        }
+
+        /* histograms from the analyze command, see histogram.h --------------------- */
+    private:
+        bool _histogramsLoaded;
+        map< string, shared_ptr< Histogram > > _histograms; // by index key pattern
+        void loadHistograms();
+    public:
+        /* the histogram of an index, empty if there isn't one.  you must be in the qcMutex */
+        shared_ptr< Histogram > histogram( const BSONObj &keyPattern );
+        /* analyze replaced them.  you must be in the qcMutex */
+        void histogramsChanged() {
+            _histogramsLoaded = false;
+            _histograms.clear();
+            clearQueryCache();
+        }
+
         /* for collection-level logging -- see CmdLogCollection ----------------- */ 
         /* assumed to be in write lock for this */
     private:
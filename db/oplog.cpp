@@ -53,18 +53,8 @@ namespace mongo {
          when set, indicates this is the first thing we have logged for this database.
          thus, the slave does not need to copy down all the data when it sees this.
     */
-    static void _logOp(const char *opstr, const char *ns, const char *logNS, const BSONObj& obj, BSONObj *o2, bool *bb, const OpTime &ts ) {
-        if ( strncmp(ns, "local.", 6) == 0 ){
-            if ( strncmp(ns, "local.slaves", 12) == 0 ){
-                resetSlaveCache();
-            }
-            return;
-        }
-
-        DEV assertInWriteLock();
-        
-        Client::Context context;
-        
+    /* write one entry into the oplog d, whose database is the current context */
+    static void _logOpRecord(NamespaceDetails *d, const char *logNS, const char *opstr, const char *ns, const BSONObj& obj, BSONObj *o2, bool *bb, const OpTime &ts ) {
         /* we jump through a bunch of hoops here to avoid copying the obj buffer twice --
            instead we do a single copy to the destination position in the memory mapped file.
         */
@@ -81,20 +71,7 @@ namespace mongo {
         int posz = partial.objsize();
         int len = posz + obj.objsize() + 1 + 2 /*o:*/;
 
-        Record *r;
-        if ( strncmp( logNS, "local.", 6 ) == 0 ) { // For now, assume this is olog main
-            if ( localOplogMainDetails == 0 ) {
-                Client::Context ctx("local.", dbpath, 0, false);
-                localOplogDB = ctx.db();
-                localOplogMainDetails = nsdetails(logNS);
-            }
-            Client::Context ctx( "" , localOplogDB, false );
-            r = theDataFileMgr.fast_oplog_insert(localOplogMainDetails, logNS, len);
-        } else {
-            Client::Context ctx( logNS, dbpath, 0, false );
-            assert( nsdetails( logNS ) );
-            r = theDataFileMgr.fast_oplog_insert( nsdetails( logNS ), logNS, len);
-        }
+        Record *r = theDataFileMgr.fast_oplog_insert(d, logNS, len);
 
         char *p = r->data;
         memcpy(p, partial.objdata(), posz);
@@ -111,6 +88,37 @@ namespace mongo {
             BSONObj temp(r);
             log( 6 ) << "logging op:" << temp << endl;
         }
+    }
+
+    static void openLocalOplog( const char *logNS ) {
+        if ( localOplogMainDetails == 0 ) {
+            Client::Context ctx("local.", dbpath, 0, false);
+            localOplogDB = ctx.db();
+            localOplogMainDetails = nsdetails(logNS);
+        }
+    }
+
+    static void _logOp(const char *opstr, const char *ns, const char *logNS, const BSONObj& obj, BSONObj *o2, bool *bb, const OpTime &ts ) {
+        if ( strncmp(ns, "local.", 6) == 0 ){
+            if ( strncmp(ns, "local.slaves", 12) == 0 ){
+                resetSlaveCache();
+            }
+            return;
+        }
+
+        DEV assertInWriteLock();
+        
+        Client::Context context;
+        
+        if ( strncmp( logNS, "local.", 6 ) == 0 ) { // For now, assume this is olog main
+            openLocalOplog( logNS );
+            Client::Context ctx( "" , localOplogDB, false );
+            _logOpRecord(localOplogMainDetails, logNS, opstr, ns, obj, o2, bb, ts);
+        } else {
+            Client::Context ctx( logNS, dbpath, 0, false );
+            assert( nsdetails( logNS ) );
+            _logOpRecord(nsdetails( logNS ), logNS, opstr, ns, obj, o2, bb, ts);
+        }
         
         context.getClient()->setLastOp( ts );
     }
@@ -136,6 +144,33 @@ namespace mongo {
         }
     }    
 
+    void logInserts(const char *ns, const vector< BSONObj >& objs) {
+        if ( objs.empty() )
+            return;
+        if ( replSettings.master && strncmp(ns, "local.", 6) != 0 ) {
+            DEV assertInWriteLock();
+            Client::Context context;
+            const char *logNS = "local.oplog.$main";
+            openLocalOplog( logNS );
+            Client::Context ctx( "" , localOplogDB, false );
+            OpTime ts;
+            for ( unsigned i = 0; i < objs.size(); i++ ) {
+                ts = OpTime::now();
+                _logOpRecord(localOplogMainDetails, logNS, "i", ns, objs[i], 0, 0, ts);
+            }
+            context.getClient()->setLastOp( ts );
+        }
+        NamespaceDetailsTransient &t = NamespaceDetailsTransient::get_w( ns );
+        if ( t.cllEnabled() ) {
+            try {
+                for ( unsigned i = 0; i < objs.size(); i++ )
+                    _logOp("i", ns, t.cllNS().c_str(), objs[i], 0, 0, OpTime::now());
+            } catch ( const DBException & ) {
+                t.cllInvalidate();
+            }
+        }
+    }
+
     void createOplog() {
         dblock lk;
 
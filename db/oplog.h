@@ -46,6 +46,9 @@ namespace mongo {
     */
     void logOp(const char *opstr, const char *ns, const BSONObj& obj, BSONObj *patt = 0, bool *b = 0);
 
+    /* logOp("i", ns, o) for each of objs, in order, switching to the oplog's database once */
+    void logInserts(const char *ns, const vector< BSONObj >& objs);
+
     void logKeepalive();
     
     void oplogCheckCloseDatabase( Database * db );
@@ -0,0 +1,206 @@
+// parallelscan.cpp
+
+/**
+*    Copyright (C) 2008 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "parallelscan.h"
+#include "client.h"
+#include "curop.h"
+#include "cmdline.h"
+#include "queryoptimizer.h"
+#include "../util/thread_pool.h"
+
+namespace mongo {
+
+    /* below this many records a scan isn't worth the thread handoff */
+    static const long long ParallelScanMinRecords = 10000;
+    static const int ParallelScanMaxThreads = 16;
+
+    int parallelScanThreads( NamespaceDetails *d , int requested ){
+        if ( d->nrecords < ParallelScanMinRecords || d->firstExtent == d->lastExtent )
+            return 1;
+        int n = requested;
+        if ( n <= 0 ){
+#if BOOST_VERSION >= 103500
+            n = boost::thread::hardware_concurrency();
+#else
+            n = 1;
+#endif
+        }
+        if ( n < 1 )
+            n = 1;
+        if ( n > ParallelScanMaxThreads )
+            n = ParallelScanMaxThreads;
+        return n;
+    }
+
+    static bool hasWhere( const BSONObj& query ){
+        BSONObjIterator i( query );
+        while ( i.more() ){
+            BSONElement e = i.next();
+            if ( strcmp( e.fieldName() , "$where" ) == 0 )
+                return true;
+            if ( strcmp( e.fieldName() , "$or" ) == 0 && e.type() == Array ){
+                BSONObjIterator j( e.embeddedObject() );
+                while ( j.more() ){
+                    BSONElement f = j.next();
+                    if ( f.type() == Object && hasWhere( f.embeddedObject() ) )
+                        return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    int parallelQueryThreads( const char *ns , NamespaceDetails *d , const BSONObj& query , const BSONObj& order ){
+        if ( ! d || cmdLine.queryScanThreads == 1 || cmdLine.notablescan )
+            return 1;
+        int n = parallelScanThreads( d , cmdLine.queryScanThreads );
+        if ( n == 1 || hasWhere( query ) )
+            return 1;
+
+        QueryPlanSet qps( ns , query , order );
+        if ( qps.nPlans() != 1 || ! qps.fbs().matchPossible() )
+            return 1;
+        QueryPlanSet::PlanPtr p = qps.getBestGuess();
+        if ( strcmp( p->indexKey().firstElement().fieldName() , "$natural" ) != 0 )
+            return 1;
+        // a $natural order is only kept by a single threaded scan
+        if ( ! order.isEmpty() && ! p->scanAndOrderRequired() )
+            return 1;
+        return n;
+    }
+
+    ParallelCollectionScan::ParallelCollectionScan( const char *ns , NamespaceDetails *d , int nThreads )
+        : _ns( ns ) , _d( d ) , _db( cc().database() ) , _errCode( 0 ) , _stop( false ){
+        assert( dbMutex.getState() != 0 );
+        assert( _db );
+        _nThreads = parallelScanThreads( d , nThreads );
+    }
+
+    DiskLoc ParallelCollectionScan::nextExtent(){
+        scoped_lock lk( _m );
+        if ( _stop || _ext.isNull() )
+            return DiskLoc();
+        DiskLoc e = _ext;
+        _ext = e.ext()->xnext;
+        return e;
+    }
+
+    void ParallelCollectionScan::scanExtents( ParallelScanOp * op ){
+        while ( 1 ){
+            DiskLoc el = nextExtent();
+            if ( el.isNull() )
+                break;
+            Extent *e = el.ext();
+            DiskLoc loc = e->firstRecord;
+            while ( ! loc.isNull() ){
+                if ( _stop )
+                    return;
+                Record *r = loc.rec();
+                op->next( BSONObj( r ) , loc );
+                _nscanned++;
+                if ( r->nextOfs == DiskLoc::NullOfs )
+                    break;
+                loc = DiskLoc( loc.a() , r->nextOfs );
+            }
+        }
+        op->finish();
+    }
+
+    /* workers have no lock of their own; the thread that called run() holds dbMutex for them.
+       a Client is still needed as DiskLoc::rec() and friends go through cc().database()
+     */
+    void ParallelCollectionScan::work( ParallelScanOp * op , bool inPool ){
+        if ( ! inPool ){
+            scanExtents( op );
+            return;
+        }
+
+        Client::initThread( "parallelscan" );
+        try {
+            Client::Context ctx( _ns , _db , false );
+            scanExtents( op );
+        }
+        catch ( DBException& e ){
+            scoped_lock lk( _m );
+            if ( _errMsg.empty() ){
+                _errCode = e.getCode();
+                _errMsg = e.what();
+            }
+            _stop = true;
+        }
+        catch ( std::exception& e ){
+            scoped_lock lk( _m );
+            if ( _errMsg.empty() )
+                _errMsg = e.what();
+            _stop = true;
+        }
+        cc().shutdown();
+        currentClient.reset();
+    }
+
+    void ParallelCollectionScan::run( const ParallelScanOp& prototype , ProgressMeter * pm ){
+        _ops.clear();
+        _nscanned = 0;
+        _stop = false;
+        _ext = _d->firstExtent;
+
+        for ( int i=0; i<_nThreads; i++ )
+            _ops.push_back( shared_ptr<ParallelScanOp>( prototype.clone() ) );
+
+        log(1) << "parallel scan " << _ns << " threads:" << _nThreads << endl;
+
+        if ( _nThreads == 1 ){
+            // in our own thread, so interrupts and errors surface directly
+            work( _ops[0].get() , false );
+            if ( pm )
+                pm->hit( _nscanned );
+            return;
+        }
+
+        ThreadPool pool( _nThreads );
+        for ( int i=0; i<_nThreads; i++ )
+            pool.schedule( &ParallelCollectionScan::work , this , _ops[i].get() , true );
+
+        unsigned reported = 0;
+        try {
+            while ( pool.tasks_remaining() ){
+                sleepmillis( 10 );
+                killCurrentOp.checkForInterrupt();
+                unsigned done = _nscanned;
+                if ( pm && done > reported ){
+                    pm->hit( done - reported );
+                    reported = done;
+                }
+            }
+        }
+        catch ( ... ){
+            _stop = true;
+            pool.join();
+            throw;
+        }
+        pool.join();
+
+        if ( pm && _nscanned > reported )
+            pm->hit( _nscanned - reported );
+
+        if ( ! _errMsg.empty() )
+            uasserted( _errCode ? _errCode : 13102 , _errMsg );
+    }
+
+} // namespace mongo
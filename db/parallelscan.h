@@ -0,0 +1,118 @@
+// parallelscan.h
+
+/**
+*    Copyright (C) 2008 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* scan all the records of a collection with several threads.
+
+   the extent chain is the unit of work: each worker repeatedly claims the next unscanned
+   extent and walks its records.  the caller must hold dbMutex (read or write) for the whole
+   scan - the workers read the datafiles on its behalf and take no locks of their own.
+*/
+
+#pragma once
+
+#include "../stdafx.h"
+#include "jsobj.h"
+#include "pdfile.h"
+#include "matcher.h"
+#include "../util/atomic_int.h"
+
+namespace mongo {
+
+    class ProgressMeter;
+
+    /* the work done for each record by one worker of a ParallelCollectionScan.
+       the prototype passed to run() is clone()d once per worker, in the calling thread;
+       each copy then only sees the records of the extents its worker claimed.
+    */
+    class ParallelScanOp {
+    public:
+        virtual ~ParallelScanOp() {}
+        virtual ParallelScanOp * clone() const = 0;
+
+        /* called for each record, in the worker's thread */
+        virtual void next( const BSONObj& o , const DiskLoc& loc ) = 0;
+
+        /* called once in the worker's thread after its last record.
+           good place for expensive per worker wrap up, e.g. sorting what was gathered.
+        */
+        virtual void finish() {}
+    };
+
+    class ParallelCollectionScan : boost::noncopyable {
+    public:
+        /* @param nThreads <= 0 means pick based on the number of cores */
+        ParallelCollectionScan( const char *ns , NamespaceDetails *d , int nThreads = 0 );
+
+        /* throws if a worker failed or the current op was killed.
+           @param pm if set, advanced by the number of records scanned
+        */
+        void run( const ParallelScanOp& prototype , ProgressMeter * pm = 0 );
+
+        /* the per worker copies of the prototype, valid after run() */
+        const vector< shared_ptr<ParallelScanOp> >& ops() const { return _ops; }
+
+        unsigned long long nscanned() const { return _nscanned; }
+        int nThreads() const { return _nThreads; }
+
+    private:
+        void work( ParallelScanOp * op , bool inPool );
+        void scanExtents( ParallelScanOp * op );
+        DiskLoc nextExtent();
+
+        string _ns;
+        NamespaceDetails *_d;
+        Database *_db;
+        int _nThreads;
+
+        mongo::mutex _m; // protects _ext, _errCode and _errMsg
+        DiskLoc _ext;
+        int _errCode;
+        string _errMsg;
+
+        volatile bool _stop;
+        AtomicUInt _nscanned;
+        vector< shared_ptr<ParallelScanOp> > _ops;
+    };
+
+    /* number of threads to use for scanning a collection of the given size */
+    int parallelScanThreads( NamespaceDetails *d , int requested );
+
+    /* a ParallelScanOp for the records that match a query.  every worker gets its own
+       Matcher, built by clone() in the calling thread.
+    */
+    class ParallelMatchOp : public ParallelScanOp {
+    public:
+        ParallelMatchOp( const BSONObj& query ) : _query( query ) , _matcher( new Matcher( query ) ){}
+        virtual void next( const BSONObj& o , const DiskLoc& loc ){
+            if ( _matcher->matches( o ) )
+                matched( o , loc );
+        }
+    protected:
+        virtual void matched( const BSONObj& o , const DiskLoc& loc ) = 0;
+        BSONObj _query;
+    private:
+        auto_ptr< Matcher > _matcher;
+    };
+
+    /* number of threads to answer query (with order, if any) with a ParallelCollectionScan.
+       1 unless the query optimizer's only plan is a table scan, the collection is big enough,
+       and nothing in the query runs javascript.  see --queryScanThreads
+    */
+    int parallelQueryThreads( const char *ns , NamespaceDetails *d , const BSONObj& query , const BSONObj& order );
+
+} // namespace mongo
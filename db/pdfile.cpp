@@ -40,6 +40,7 @@ _ disallow system* manipulations from the database.
 #include "namespace.h"
 #include "queryutil.h"
 #include "extsort.h"
+#include "parallelscan.h"
 #include "curop.h"
 #include "background.h"
 
@@ -716,37 +717,47 @@ namespace mongo {
         ClientCursor::invalidate(name.c_str());
         Top::global.collectionDropped( name );
         dropNS(name);        
+
+        // the analyze command's histograms would describe a new collection of the same name
+        string hns = Namespace( name.c_str() ).getSisterNS( "system.histograms" );
+        if ( nsdetails( hns.c_str() ) )
+            deleteObjects( hns.c_str(), BSON( "ns" << name ), false, false, true );
     }
     
     int nUnindexes = 0;
 
+    /* unindex one key of obj, the record at dl. */
+    static void _unindexKey(IndexDetails& id, BSONObj& j, const BSONObj& obj, const DiskLoc& dl, bool logMissing) {
+        if ( otherTraceLevel >= 5 ) {
+            out() << "_unindexRecord() " << obj.toString();
+            out() << "\n  unindex:" << j.toString() << endl;
+        }
+        nUnindexes++;
+        bool ok = false;
+        try {
+            ok = id.head.btree()->unindex(id.head, id, j, dl);
+        }
+        catch (AssertionException& e) {
+            problem() << "Assertion failure: _unindex failed " << id.indexNamespace() << endl;
+            out() << "Assertion failure: _unindex failed: " << e.what() << '\n';
+            out() << "  obj:" << obj.toString() << '\n';
+            out() << "  key:" << j.toString() << '\n';
+            out() << "  dl:" << dl.toString() << endl;
+            sayDbContext();
+        }
+
+        if ( !ok && logMissing ) {
+            out() << "unindex failed (key too big?) " << id.indexNamespace() << '\n';
+        }
+    }
+
     /* unindex all keys in index for this record. */
     static void _unindexRecord(IndexDetails& id, BSONObj& obj, const DiskLoc& dl, bool logMissing = true) {
         BSONObjSetDefaultOrder keys;
         id.getKeysFromObject(obj, keys);
         for ( BSONObjSetDefaultOrder::iterator i=keys.begin(); i != keys.end(); i++ ) {
             BSONObj j = *i;
-            if ( otherTraceLevel >= 5 ) {
-                out() << "_unindexRecord() " << obj.toString();
-                out() << "\n  unindex:" << j.toString() << endl;
-            }
-            nUnindexes++;
-            bool ok = false;
-            try {
-                ok = id.head.btree()->unindex(id.head, id, j, dl);
-            }
-            catch (AssertionException& e) {
-                problem() << "Assertion failure: _unindex failed " << id.indexNamespace() << endl;
-                out() << "Assertion failure: _unindex failed: " << e.what() << '\n';
-                out() << "  obj:" << obj.toString() << '\n';
-                out() << "  key:" << j.toString() << '\n';
-                out() << "  dl:" << dl.toString() << endl;
-                sayDbContext();
-            }
-
-            if ( !ok && logMissing ) {
-                out() << "unindex failed (key too big?) " << id.indexNamespace() << '\n';
-            }
+            _unindexKey(id, j, obj, dl, logMissing);
         }
     }
 
@@ -756,12 +767,22 @@ namespace mongo {
         int n = d->nIndexes;
         for ( int i = 0; i < n; i++ )
             _unindexRecord(d->idx(i), obj, dl, !noWarn);
-        if( d->backgroundIndexBuildInProgress ) {
+        for ( int i = n; i < d->nIndexesBeingBuilt(); i++ ) {
             // always pass nowarn here, as this one may be missing for valid reasons as we are concurrently building it
-            _unindexRecord(d->idx(n), obj, dl, false); 
+            _unindexRecord(d->idx(i), obj, dl, false); 
         }
     }
 
+    /* index order for a batch's new keys: key, then recordLoc as the btree breaks ties */
+    struct KeyLocLess {
+        KeyLocLess( const BSONObj& order ) : _order( order ) {}
+        bool operator()( const pair< BSONObj, DiskLoc >& l, const pair< BSONObj, DiskLoc >& r ) const {
+            int x = l.first.woCompare( r.first, _order );
+            return x ? x < 0 : l.second.compare( r.second ) < 0;
+        }
+        BSONObj _order;
+    };
+
     /* deletes a record, just the pdfile portion -- no index cleanup, no cursor cleanup, etc. 
        caller must check if capped
     */
@@ -831,6 +852,36 @@ namespace mongo {
         NamespaceDetailsTransient::get_w( ns ).notifyOfWriteOp();
     }
 
+    /* the keys of all the records are removed from one index at a time, in key order, so each
+       index is walked once from left to right rather than jumped around in per record. */
+    void DataFileMgr::deleteRecords(const char *ns, const vector<DiskLoc>& locs)
+    {
+        NamespaceDetails* d = nsdetails(ns);
+        uassert( 13130 , "can't remove from a capped collection" , ! d->capped );
+
+        ClientCursor::aboutToDelete( set<DiskLoc>( locs.begin(), locs.end() ) );
+
+        for ( int i = 0; i < d->nIndexesBeingBuilt(); i++ ) {
+            IndexDetails& idx = d->idx(i);
+            vector< pair< BSONObj, DiskLoc > > keys;
+            for ( unsigned j = 0; j < locs.size(); j++ ) {
+                BSONObjSetDefaultOrder s;
+                idx.getKeysFromObject( locs[j].obj(), s );
+                for ( BSONObjSetDefaultOrder::iterator k = s.begin(); k != s.end(); ++k )
+                    keys.push_back( make_pair( *k, locs[j] ) );
+            }
+            sort( keys.begin(), keys.end(), KeyLocLess( idx.keyPattern() ) );
+            // as in unindexRecord(), keys may be missing from an index still being built
+            bool logMissing = i < d->nIndexes;
+            for ( unsigned k = 0; k < keys.size(); k++ )
+                _unindexKey( idx, keys[k].first, keys[k].second.obj(), keys[k].second, logMissing );
+        }
+
+        for ( unsigned j = 0; j < locs.size(); j++ )
+            _deleteRecord(d, ns, locs[j].rec(), locs[j]);
+        NamespaceDetailsTransient::get_w( ns ).notifyOfWriteOp();
+    }
+
 
     /** Note: if the object shrinks a lot, we don't free up space, we leave extra at end of the record.
      */
@@ -920,6 +971,7 @@ namespace mongo {
 
         //	update in place
         memcpy(toupdate->data, objNew.objdata(), objNew.objsize());
+        nsdt->queueDocumentWritten(objNew, dl);
         return dl;
     }
 
@@ -987,117 +1039,170 @@ namespace mongo {
         }
     }
 
-    // throws DBException
-    unsigned long long fastBuildIndex(const char *ns, NamespaceDetails *d, IndexDetails& idx, int idxNo) {
-        assert( d->backgroundIndexBuildInProgress == 0 );
-        CurOp * op = cc().curop();
-
-        Timer t;
+    /* one worker's share of the key extraction for fastBuildIndexes: gathers and sorts, for each
+       index being built, the keys of the records in the extents its thread claims.
+    */
+    class IndexKeysScanOp : public ParallelScanOp {
+    public:
+        IndexKeysScanOp( NamespaceDetails *d , const vector<int>& idxNos , long maxFileSize ) 
+            : _d( d ) , _idxNos( idxNos ) , _maxFileSize( maxFileSize ) , 
+              _nkeys( idxNos.size() , 0 ) , _multikey( idxNos.size() , false ) {
+        }
+        virtual ParallelScanOp * clone() const {
+            IndexKeysScanOp * op = new IndexKeysScanOp( _d , _idxNos , _maxFileSize );
+            for ( unsigned i=0; i<_idxNos.size(); i++ ){
+                shared_ptr<BSONObjExternalSorter> sorter( new BSONObjExternalSorter( _d->idx( _idxNos[i] ).keyPattern() , _maxFileSize ) );
+                sorter->hintNumObjects( _d->nrecords );
+                op->_sorters.push_back( sorter );
+            }
+            return op;
+        }
+        virtual void next( const BSONObj& o , const DiskLoc& loc ){
+            for ( unsigned j=0; j<_idxNos.size(); j++ ){
+                BSONObjSetDefaultOrder keys;
+                _d->idx( _idxNos[j] ).getKeysFromObject(o, keys);
+                if ( keys.size() > 1 )
+                    _multikey[j] = true;
+                for ( BSONObjSetDefaultOrder::iterator i=keys.begin(); i != keys.end(); i++ ) {
+                    _sorters[j]->add(*i, loc);
+                    _nkeys[j]++;
+                }
+            }
+        }
+        virtual void finish(){
+            for ( unsigned j=0; j<_sorters.size(); j++ )
+                _sorters[j]->sort();
+        }
+
+        /* j is the position in idxNos, not the index number */
+        BSONObjExternalSorter * sorter( int j ) const { return _sorters[j].get(); }
+        unsigned long long nkeys( int j ) const { return _nkeys[j]; }
+        bool multikey( int j ) const { return _multikey[j]; }
+    private:
+        NamespaceDetails *_d;
+        vector<int> _idxNos;
+        long _maxFileSize;
+        vector< shared_ptr<BSONObjExternalSorter> > _sorters;
+        vector<unsigned long long> _nkeys;
+        vector<bool> _multikey;
+    };
 
-        log() << "Buildindex " << ns << " idxNo:" << idxNo << ' ' << idx.info.obj().toString() << endl;
+    /* total ram the sorters of one index build may hold before spilling to disk.  there is a
+       sorter per worker per index, so the build uses fewer workers rather than let each sorter
+       go below IndexBuildSorterMinMemory; past IndexBuildSortMemory / IndexBuildSorterMinMemory
+       indexes it is one worker, and the sorters get smaller.
+    */
+    const long IndexBuildSortMemory = 1024 * 1024 * 100;
+    const long IndexBuildSorterMinMemory = 1024 * 1024 * 16;
 
+    /* bottom up load of one index from the merged, sorted keys of all the scan's workers.
+       keys rejected as duplicates are added to dupsToDrop when the index is dropDups.
+    */
+    static void loadIndex( IndexDetails& idx , vector<BSONObjExternalSorter*>& sorters , unsigned long long nkeys , set<DiskLoc>& dupsToDrop ) {
+        CurOp * op = cc().curop();
+        Timer t;
         bool dupsAllowed = !idx.unique();
         bool dropDups = idx.dropDups();
-        BSONObj order = idx.keyPattern();
 
-        idx.head.Null();
-        
-        if ( logLevel > 1 ) printMemInfo( "before index start" );
+        BtreeBuilder btBuilder(dupsAllowed, idx);
+        BSONObjExternalSorter::MergeIterator i( sorters );
+        ProgressMeter & pm = op->setMessage( "index: (2/3) btree bottom up" , nkeys , 10 );
+        while( i.more() ) { 
+            RARELY killCurrentOp.checkForInterrupt();
+            BSONObjExternalSorter::Data d = i.next();
 
-        /* get and sort all the keys ----- */
-        unsigned long long n = 0;
-        auto_ptr<Cursor> c = theDataFileMgr.findAll(ns);
-        BSONObjExternalSorter sorter(order);
-        sorter.hintNumObjects( d->nrecords );
-        unsigned long long nkeys = 0;
-        ProgressMeter & pm = op->setMessage( "index: (1/3) external sort" , d->nrecords , 10 );
-        while ( c->ok() ) {
-            BSONObj o = c->current();
-            DiskLoc loc = c->currLoc();
-
-            BSONObjSetDefaultOrder keys;
-            idx.getKeysFromObject(o, keys);
-            int k = 0;
-            for ( BSONObjSetDefaultOrder::iterator i=keys.begin(); i != keys.end(); i++ ) {
-                if( ++k == 2 )
-                    d->setIndexIsMultikey(idxNo);
-                //cout<<"SORTER ADD " << i->toString() << ' ' << loc.toString() << endl;
-                sorter.add(*i, loc);
-                nkeys++;
-            }
-            
-            c->advance();
-            n++;
-            pm.hit();
-            if ( logLevel > 1 && n % 10000 == 0 ){
-                printMemInfo( "\t iterating objects" );
+            try { 
+                btBuilder.addKey(d.first, d.second);
             }
+            catch( AssertionException& e ) { 
+                if ( dupsAllowed ){
+                    // unknow exception??
+                    throw;
+                }
+                
+                if( e.interrupted() )
+                    throw;
 
-        };
+                if ( ! dropDups )
+                    throw;
+
+                /* we could queue these on disk, but normally there are very few dups, so instead we 
+                   keep in ram and have a limit.
+                */
+                dupsToDrop.insert(d.second);
+                uassert( 10092 , "too may dups on index build with dropDups=true", dupsToDrop.size() < 1000000 );
+            }
+            pm.hit();
+        }
         pm.finished();
+        op->setMessage( "index: (3/3) btree-middle" );
+        log(t.seconds() > 10 ? 0 : 1 ) << "\t done building bottom layer, going to commit" << endl;
+        btBuilder.commit();
+        wassert( btBuilder.getn() == nkeys || dropDups ); 
+    }
 
-        if ( logLevel > 1 ) printMemInfo( "before final sort" );
-        sorter.sort();
-        if ( logLevel > 1 ) printMemInfo( "after final sort" );
-        
-        log(t.seconds() > 5 ? 0 : 1) << "\t external sort used : " << sorter.numFiles() << " files " << " in " << t.seconds() << " secs" << endl;
+    /* builds the indexes idxNos of d with one scan of the collection.
+       the collection is split by extent across up to cmdLine.indexBuildThreads workers (fewer
+       with many indexes, see IndexBuildSortMemory), each of which extracts and sorts its own
+       keys for every index; each index is then loaded from the merge of the workers' sorted runs.
+       throws DBException
+    */
+    unsigned long long fastBuildIndexes(const char *ns, NamespaceDetails *d, const vector<int>& idxNos) {
+        assert( d->backgroundIndexBuildInProgress == 0 );
+        CurOp * op = cc().curop();
 
-        list<DiskLoc> dupsToDrop;
+        Timer t;
 
-        /* build index --- */ 
-        {
-            BtreeBuilder btBuilder(dupsAllowed, idx);
-            BSONObj keyLast;
-            auto_ptr<BSONObjExternalSorter::Iterator> i = sorter.iterator();
-            pm = op->setMessage( "index: (2/3) btree bottom up" , nkeys , 10 );
-            while( i->more() ) { 
-                RARELY killCurrentOp.checkForInterrupt();
-                BSONObjExternalSorter::Data d = i->next();
+        for ( unsigned j=0; j<idxNos.size(); j++ ){
+            IndexDetails& idx = d->idx( idxNos[j] );
+            log() << "Buildindex " << ns << " idxNo:" << idxNos[j] << ' ' << idx.info.obj().toString() << endl;
+            idx.head.Null();
+        }
+        
+        if ( logLevel > 1 ) printMemInfo( "before index start" );
 
-                try { 
-                    btBuilder.addKey(d.first, d.second);
-                }
-                catch( AssertionException& e ) { 
-                    if ( dupsAllowed ){
-                        // unknow exception??
-                        throw;
-                    }
-                    
-                    if( e.interrupted() )
-                        throw;
+        /* get and sort all the keys ----- */
+        long nThreads = parallelScanThreads( d , cmdLine.indexBuildThreads );
+        nThreads = max( min( nThreads , IndexBuildSortMemory / ( IndexBuildSorterMinMemory * (long)idxNos.size() ) ) , 1L );
+        ParallelCollectionScan scan( ns , d , nThreads );
+        long maxFileSize = IndexBuildSortMemory / ( scan.nThreads() * (long)idxNos.size() );
+        ProgressMeter & pm = op->setMessage( "index: (1/3) external sort" , d->nrecords , 10 );
+        scan.run( IndexKeysScanOp( d , idxNos , maxFileSize ) , &pm );
+        pm.finished();
 
-                    if ( ! dropDups )
-                        throw;
+        if ( logLevel > 1 ) printMemInfo( "after final sort" );
 
-                    /* we could queue these on disk, but normally there are very few dups, so instead we 
-                       keep in ram and have a limit.
-                    */
-                    dupsToDrop.push_back(d.second);
-                    uassert( 10092 , "too may dups on index build with dropDups=true", dupsToDrop.size() < 1000000 );
-                }
-                pm.hit();
+        /* build indexes --- */ 
+        set<DiskLoc> dupsToDrop;
+        for ( unsigned j=0; j<idxNos.size(); j++ ){
+            unsigned long long nkeys = 0;
+            int nfiles = 0;
+            vector<BSONObjExternalSorter*> sorters;
+            for ( unsigned i=0; i<scan.ops().size(); i++ ){
+                IndexKeysScanOp * keysOp = (IndexKeysScanOp*)scan.ops()[i].get();
+                if ( keysOp->multikey( j ) )
+                    d->setIndexIsMultikey( idxNos[j] );
+                nkeys += keysOp->nkeys( j );
+                nfiles += keysOp->sorter( j )->numFiles();
+                sorters.push_back( keysOp->sorter( j ) );
             }
-            pm.finished();
-            op->setMessage( "index: (3/3) btree-middle" );
-            log(t.seconds() > 10 ? 0 : 1 ) << "\t done building bottom layer, going to commit" << endl;
-            btBuilder.commit();
-            wassert( btBuilder.getn() == nkeys || dropDups ); 
+            log(t.seconds() > 5 ? 0 : 1) << "\t external sort used : " << nfiles << " files " << " threads: " << scan.nThreads() << " in " << t.seconds() << " secs" << endl;
+            loadIndex( d->idx( idxNos[j] ) , sorters , nkeys , dupsToDrop );
         }
         
         log(1) << "\t fastBuildIndex dupsToDrop:" << dupsToDrop.size() << endl;
 
-        for( list<DiskLoc>::iterator i = dupsToDrop.begin(); i != dupsToDrop.end(); i++ )
+        /* all the new indexes are complete at this point, so deleteRecord() cleans a dup out of 
+           every one of them at once - even those where it was not a dup */
+        for( set<DiskLoc>::iterator i = dupsToDrop.begin(); i != dupsToDrop.end(); i++ )
             theDataFileMgr.deleteRecord( ns, i->rec(), *i, false, true );
 
-        return n;
+        return scan.nscanned();
     }
 
     class BackgroundIndexBuildJob : public BackgroundOperation { 
 
-        unsigned long long addExistingToIndex(const char *ns, NamespaceDetails *d, IndexDetails& idx, int idxNo) {
-            bool dupsAllowed = !idx.unique();
-            bool dropDups = idx.dropDups();
-
+        unsigned long long addExistingToIndexes(const char *ns, NamespaceDetails *d, const vector<int>& idxNos) {
             ProgressMeter& progress = cc().curop()->setMessage( "bg index build" , d->nrecords );
 
             unsigned long long n = 0;
@@ -1110,14 +1215,17 @@ namespace mongo {
 
             while ( cc->c->ok() ) {
                 BSONObj js = cc->c->current();
+                unsigned j = 0;
                 try { 
-                    _indexRecord(d, idxNo, js, cc->c->currLoc(), dupsAllowed);
+                    for ( ; j < idxNos.size(); j++ )
+                        _indexRecord(d, idxNos[j], js, cc->c->currLoc(), !d->idx(idxNos[j]).unique());
                     cc->c->advance();
                 } catch( AssertionException& e ) { 
                     if( e.interrupted() )
                         throw;
 
-                    if ( dropDups ) {
+                    if ( d->idx(idxNos[j]).dropDups() ) {
+                        /* deleteRecord also removes the keys already added to the other new indexes */
                         DiskLoc toDelete = cc->c->currLoc();
                         bool ok = cc->c->advance();
                         cc->updateLocation();
@@ -1154,14 +1262,14 @@ namespace mongo {
            that way on a crash/restart, we don't think we are still building one. */
         set<NamespaceDetails*> bgJobsInProgress;
 
-        void prep(const char *ns, NamespaceDetails *d) {
+        void prep(const char *ns, NamespaceDetails *d, int nIndexes) {
             assertInWriteLock();
             bgJobsInProgress.insert(d);
-            d->backgroundIndexBuildInProgress = 1;
-            d->nIndexes--;
+            d->backgroundIndexBuildInProgress = nIndexes;
+            d->nIndexes -= nIndexes;
         }
         void done(const char *ns, NamespaceDetails *d) {
-            d->nIndexes++;
+            d->nIndexes += d->backgroundIndexBuildInProgress;
             d->backgroundIndexBuildInProgress = 0;
             NamespaceDetailsTransient::get_w(ns).addedIndex(); // clear query optimizer cache
             assertInWriteLock();
@@ -1170,18 +1278,22 @@ namespace mongo {
     public:
         BackgroundIndexBuildJob(const char *ns) : BackgroundOperation(ns) { }
 
-        unsigned long long go(string ns, NamespaceDetails *d, IndexDetails& idx, int idxNo) { 
+        /* idxNos must be the last indexes of d, in order */
+        unsigned long long go(string ns, NamespaceDetails *d, const vector<int>& idxNos) { 
             unsigned long long n = 0;
 
-            prep(ns.c_str(), d);
-            assert( idxNo == d->nIndexes );
+            prep(ns.c_str(), d, idxNos.size());
+            assert( idxNos[0] == d->nIndexes );
             try { 
-                idx.head = BtreeBucket::addBucket(idx);
-                n = addExistingToIndex(ns.c_str(), d, idx, idxNo);
+                for ( unsigned j=0; j<idxNos.size(); j++ ){
+                    IndexDetails& idx = d->idx( idxNos[j] );
+                    idx.head = BtreeBucket::addBucket(idx);
+                }
+                n = addExistingToIndexes(ns.c_str(), d, idxNos);
             }
             catch(...) { 
                 if( cc().database() && nsdetails(ns.c_str()) == d ) {
-                    assert( idxNo == d->nIndexes );
+                    assert( idxNos[0] == d->nIndexes );
                     done(ns.c_str(), d);
                 }
                 else {
@@ -1189,15 +1301,18 @@ namespace mongo {
                 }
                 throw;
             }
-            assert( idxNo == d->nIndexes );
+            assert( idxNos[0] == d->nIndexes );
             done(ns.c_str(), d);
             return n;
         }
     };
 
-    // throws DBException
-    static void buildAnIndex(string ns, NamespaceDetails *d, IndexDetails& idx, int idxNo, bool background) { 
-        log() << "building new index on " << idx.keyPattern() << " for " << ns << ( background ? " background" : "" ) << endl;
+    /* idxNos are new indexes of d, already added with addIndex(), in order and at the end of the 
+       index list.  throws DBException
+    */
+    static void buildIndexes(string ns, NamespaceDetails *d, const vector<int>& idxNos, bool background) { 
+        for ( unsigned j=0; j<idxNos.size(); j++ )
+            log() << "building new index on " << d->idx( idxNos[j] ).keyPattern() << " for " << ns << ( background ? " background" : "" ) << endl;
         Timer t;
 		unsigned long long n;
 
@@ -1207,16 +1322,45 @@ namespace mongo {
 
         assert( !BackgroundOperation::inProgForNs(ns.c_str()) ); // should have been checked earlier, better not be...
         if( !background ) {
-			n = fastBuildIndex(ns.c_str(), d, idx, idxNo);
-			assert( !idx.head.isNull() );
+			n = fastBuildIndexes(ns.c_str(), d, idxNos);
+            for ( unsigned j=0; j<idxNos.size(); j++ )
+                assert( !d->idx( idxNos[j] ).head.isNull() );
 		}
 		else {
             BackgroundIndexBuildJob j(ns.c_str());
-            n = j.go(ns, d, idx, idxNo);
+            n = j.go(ns, d, idxNos);
 		}
         log() << "done for " << n << " records " << t.millis() / 1000.0 << "secs" << endl;
     }
 
+    static void buildAnIndex(string ns, NamespaceDetails *d, IndexDetails& idx, int idxNo, bool background) { 
+        buildIndexes( ns , d , vector<int>( 1 , idxNo ) , background );
+    }
+
+    /* drop new indexes whose build failed, keeping the original error as the last error */
+    static void rollbackIndexBuild(string ns, NamespaceDetails *d, const vector<string>& names) {
+        // save our error msg string as an exception or dropIndexes will overwrite our message
+        LastError *le = lastError.get();
+        int savecode = 0;
+        string saveerrmsg;
+        if ( le ) {
+            savecode = le->code;
+            saveerrmsg = le->msg;
+        }
+
+        for ( unsigned j=0; j<names.size(); j++ ) {
+            BSONObjBuilder b;
+            string errmsg;
+            bool ok = dropIndexes(d, ns.c_str(), names[j].c_str(), errmsg, b, true);
+            if( !ok ) {
+                log() << "failed to drop index after a unique key error building it: " << errmsg << ' ' << ns << ' ' << names[j] << endl;
+            }
+        }
+
+        assert( le && !saveerrmsg.empty() );
+        raiseError(savecode,saveerrmsg.c_str());
+    }
+
     /* add keys to indexes for a new record */
     static void indexRecord(NamespaceDetails *d, BSONObj obj, DiskLoc loc) {
         int n = d->nIndexesBeingBuilt();
@@ -1303,6 +1447,53 @@ namespace mongo {
 
     bool prepareToBuildIndex(const BSONObj& io, bool god, string& sourceNS, NamespaceDetails *&sourceCollection);
 
+    /* space for a new record of lenWHdr bytes (len without header and padding), adding an extent
+       if the collection is out of room.  reserve is the size of records still to come in the same
+       batch, which the new extent makes room for too.
+       @return null if the collection is capped and full
+    */
+    static DiskLoc allocRecord(NamespaceDetails *d, const char *ns, int len, int lenWHdr, long long reserve = 0) {
+        DiskLoc extentLoc;
+        DiskLoc loc = d->alloc(ns, lenWHdr, extentLoc);
+        if ( loc.isNull() && d->capped == 0 ) { // size capped doesn't grow
+            log(1) << "allocating new extent for " << ns << " padding:" << d->paddingFactor << " lenWHdr: " << lenWHdr << endl;
+            int sz = followupExtentSize(lenWHdr, d->lastExtentSize);
+            long long max = MongoDataFile::maxSize() - DataFileHeader::HeaderSize;
+            if ( reserve > 0 && lenWHdr + reserve > sz )
+                sz = (int) ( ( lenWHdr + reserve < max ? lenWHdr + reserve : max ) & 0xffffff00 );
+            cc().database()->allocExtent(ns, sz, false);
+            loc = d->alloc(ns, lenWHdr, extentLoc);
+            if ( loc.isNull() ){
+                log() << "WARNING: alloc() failed after allocating new extent. lenWHdr: " << lenWHdr << " last extent size:" << d->lastExtentSize << "; trying again\n";
+                for ( int zzz=0; zzz<10 && lenWHdr > d->lastExtentSize; zzz++ ){
+                    log() << "try #" << zzz << endl;
+                    cc().database()->allocExtent(ns, followupExtentSize(len, d->lastExtentSize), false);
+                    loc = d->alloc(ns, lenWHdr, extentLoc);
+                    if ( ! loc.isNull() )
+                        break;
+                }
+            }
+        }
+        return loc;
+    }
+
+    /* link a new record in at the end of its extent */
+    static void addRecordToExtent(Record *r, const DiskLoc& loc) {
+        Extent *e = r->myExtent(loc);
+        if ( e->lastRecord.isNull() ) {
+            e->firstRecord = e->lastRecord = loc;
+            r->prevOfs = r->nextOfs = DiskLoc::NullOfs;
+        }
+        else {
+
+            Record *oldlast = e->lastRecord.rec();
+            r->prevOfs = e->lastRecord.getOfs();
+            r->nextOfs = DiskLoc::NullOfs;
+            oldlast->nextOfs = loc.getOfs();
+            e->lastRecord = loc;
+        }
+    }
+
     // We are now doing two btree scans for all unique indexes (one here, and one when we've
     // written the record to the collection.  This could be made more efficient inserting
     // dummy data here, keeping pointers to the btree nodes holding the dummy data and then
@@ -1394,7 +1585,6 @@ namespace mongo {
             BSONElementManipulator::lookForTimestamps( io );
         }
 
-        DiskLoc extentLoc;
         int lenWHdr = len + Record::HeaderSize;
         lenWHdr = (int) (lenWHdr * d->paddingFactor);
         if ( lenWHdr == 0 ) {
@@ -1410,29 +1600,11 @@ namespace mongo {
             checkNoIndexConflicts( d, BSONObj( reinterpret_cast<const char *>( obuf ) ) );
         }
         
-        DiskLoc loc = d->alloc(ns, lenWHdr, extentLoc);
+        DiskLoc loc = allocRecord(d, ns, len, lenWHdr);
         if ( loc.isNull() ) {
-            // out of space
-            if ( d->capped == 0 ) { // size capped doesn't grow
-                log(1) << "allocating new extent for " << ns << " padding:" << d->paddingFactor << " lenWHdr: " << lenWHdr << endl;
-                cc().database()->allocExtent(ns, followupExtentSize(lenWHdr, d->lastExtentSize), false);
-                loc = d->alloc(ns, lenWHdr, extentLoc);
-                if ( loc.isNull() ){
-                    log() << "WARNING: alloc() failed after allocating new extent. lenWHdr: " << lenWHdr << " last extent size:" << d->lastExtentSize << "; trying again\n";
-                    for ( int zzz=0; zzz<10 && lenWHdr > d->lastExtentSize; zzz++ ){
-                        log() << "try #" << zzz << endl;
-                        cc().database()->allocExtent(ns, followupExtentSize(len, d->lastExtentSize), false);
-                        loc = d->alloc(ns, lenWHdr, extentLoc);
-                        if ( ! loc.isNull() )
-                            break;
-                    }
-                }
-            }
-            if ( loc.isNull() ) {
-                log() << "out of space in datafile " << ns << " capped:" << d->capped << endl;
-                assert(d->capped);
-                return DiskLoc();
-            }
+            log() << "out of space in datafile " << ns << " capped:" << d->capped << endl;
+            assert(d->capped);
+            return DiskLoc();
         }
 
         Record *r = loc.rec();
@@ -1447,26 +1619,17 @@ namespace mongo {
             if( obuf )
                 memcpy(r->data, obuf, len);
         }
-        Extent *e = r->myExtent(loc);
-        if ( e->lastRecord.isNull() ) {
-            e->firstRecord = e->lastRecord = loc;
-            r->prevOfs = r->nextOfs = DiskLoc::NullOfs;
-        }
-        else {
-
-            Record *oldlast = e->lastRecord.rec();
-            r->prevOfs = e->lastRecord.getOfs();
-            r->nextOfs = DiskLoc::NullOfs;
-            oldlast->nextOfs = loc.getOfs();
-            e->lastRecord = loc;
-        }
+        addRecordToExtent(r, loc);
 
         d->nrecords++;
         d->datasize += r->netLength();
 
         // we don't bother clearing those stats for the god tables - also god is true when adidng a btree bucket
-        if ( !god )
-            NamespaceDetailsTransient::get_w( ns ).notifyOfWriteOp();
+        if ( !god ) {
+            NamespaceDetailsTransient& nsdt = NamespaceDetailsTransient::get_w( ns );
+            nsdt.notifyOfWriteOp();
+            nsdt.queueDocumentWritten( BSONObj( r ), loc );
+        }
         
         if ( tableToIndex ) {
             BSONObj info = loc.obj();
@@ -1478,26 +1641,8 @@ namespace mongo {
             try {
                 buildAnIndex(tabletoidxns, tableToIndex, idx, idxNo, background);
             } catch( DBException& ) {
-                // save our error msg string as an exception or dropIndexes will overwrite our message
-                LastError *le = lastError.get();
-                int savecode = 0;
-                string saveerrmsg;
-                if ( le ) {
-                    savecode = le->code;
-                    saveerrmsg = le->msg;
-                }
-
                 // roll back this index
-                string name = idx.indexName();
-                BSONObjBuilder b;
-                string errmsg;
-                bool ok = dropIndexes(tableToIndex, tabletoidxns.c_str(), name.c_str(), errmsg, b, true);
-                if( !ok ) {
-                    log() << "failed to drop index after a unique key error building it: " << errmsg << ' ' << tabletoidxns << ' ' << name << endl;
-                }
-
-                assert( le && !saveerrmsg.empty() );
-                raiseError(savecode,saveerrmsg.c_str());
+                rollbackIndexBuild(tabletoidxns, tableToIndex, vector<string>( 1 , idx.indexName() ));
                 throw;
             }
         }
@@ -1529,6 +1674,221 @@ namespace mongo {
         return loc;
     }
 
+    /* the batched part of insertBatchAndLog(): inserts objs[from] onwards, stopping before the
+       first one that may fail - an _id array, keys that can't be extracted, a duplicate in a
+       unique index - so that insert() can fail on it the usual way.
+       @return number inserted
+    */
+    static unsigned insertBatch(const char *ns, NamespaceDetails *d, vector<BSONObj>& objs, unsigned from) {
+        int nIndexes = d->nIndexes;
+        vector< vector< pair< BSONObj, unsigned > > > keys( nIndexes ); // per index: key, object
+        vector< BSONObjSetDefaultOrder > uniqueKeys( nIndexes );
+        vector< bool > multikey( nIndexes );
+        vector< BSONObj > toStore;
+        long long bytes = 0;
+        for ( unsigned j = from; j < objs.size(); j++ ) {
+            BSONObj o = objs[j];
+            BSONElement idField = o.getField( "_id" );
+            if ( idField.type() == Array )
+                break;
+            BSONElementManipulator::lookForTimestamps( o );
+            if ( idField.eoo() ) {
+                BSONObjBuilder b;
+                OID oid;
+                oid.init();
+                b.appendOID( "_id", &oid );
+                b.appendElements( o );
+                o = b.obj();
+            }
+
+            vector< BSONObjSetDefaultOrder > objKeys( nIndexes );
+            bool ok = true;
+            try {
+                for ( int i = 0; i < nIndexes && ok; i++ ) {
+                    IndexDetails& idx = d->idx(i);
+                    idx.getKeysFromObject( o, objKeys[i] );
+                    if ( !idx.unique() )
+                        continue;
+                    for ( BSONObjSetDefaultOrder::iterator k = objKeys[i].begin(); k != objKeys[i].end(); ++k ) {
+                        if ( uniqueKeys[i].count( *k ) || idx.head.btree()->exists( idx, idx.head, *k, idx.keyPattern() ) ) {
+                            ok = false;
+                            break;
+                        }
+                    }
+                }
+            }
+            catch ( DBException& ) {
+                ok = false;
+            }
+            if ( !ok )
+                break;
+
+            for ( int i = 0; i < nIndexes; i++ ) {
+                if ( objKeys[i].size() > 1 )
+                    multikey[i] = true;
+                for ( BSONObjSetDefaultOrder::iterator k = objKeys[i].begin(); k != objKeys[i].end(); ++k ) {
+                    keys[i].push_back( make_pair( *k, toStore.size() ) );
+                    if ( d->idx(i).unique() )
+                        uniqueKeys[i].insert( *k );
+                }
+            }
+            toStore.push_back( o );
+            bytes += o.objsize() + Record::HeaderSize;
+        }
+        if ( toStore.empty() )
+            return 0;
+
+        /* the records, with any new extent sized for the rest of the batch, then each index's
+           keys for the batch, in key order.  a failure in either - out of disk or quota while
+           allocating, say - takes back every record written so far.
+        */
+        vector< DiskLoc > locs;
+        try {
+            for ( unsigned j = 0; j < toStore.size(); j++ ) {
+                d->paddingFits();
+                int len = toStore[j].objsize();
+                bytes -= len + Record::HeaderSize;
+                int lenWHdr = (int) ( ( len + Record::HeaderSize ) * d->paddingFactor );
+                if ( lenWHdr == 0 ) {
+                    // old datafiles, backward compatible here.
+                    assert( d->paddingFactor == 0 );
+                    d->paddingFactor = 1.0;
+                    lenWHdr = len + Record::HeaderSize;
+                }
+                DiskLoc loc = allocRecord( d, ns, len, lenWHdr, (long long) ( bytes * d->paddingFactor ) );
+                assert( !loc.isNull() ); // only capped collections run out, and they aren't batched
+                Record *r = loc.rec();
+                memcpy( r->data, toStore[j].objdata(), len );
+                addRecordToExtent( r, loc );
+                d->nrecords++;
+                d->datasize += r->netLength();
+                objs[ from + j ] = BSONObj( r );
+                locs.push_back( loc );
+            }
+
+            for ( int i = 0; i < nIndexes; i++ ) {
+                IndexDetails& idx = d->idx(i);
+                if ( multikey[i] )
+                    d->setIndexIsMultikey(i);
+                vector< pair< BSONObj, DiskLoc > > sorted;
+                sorted.reserve( keys[i].size() );
+                for ( unsigned k = 0; k < keys[i].size(); k++ )
+                    sorted.push_back( make_pair( keys[i][k].first, locs[ keys[i][k].second ] ) );
+                sort( sorted.begin(), sorted.end(), KeyLocLess( idx.keyPattern() ) );
+                BtreeBucket::bt_insertSorted( idx, sorted, !idx.unique() );
+            }
+        }
+        catch ( DBException& ) {
+            // leave collection and indexes consistent
+            for ( unsigned j = 0; j < locs.size(); j++ ) {
+                BSONObj o = objs[ from + j ];
+                for ( int i = 0; i < nIndexes; i++ ) {
+                    try {
+                        _unindexRecord( d->idx(i), o, locs[j], false );
+                    }
+                    catch(...) {
+                        log(3) << "unindex fails on rollback of batch insert\n";
+                    }
+                }
+                objs[ from + j ] = toStore[j];
+                theDataFileMgr._deleteRecord( d, ns, locs[j].rec(), locs[j] );
+            }
+            throw;
+        }
+
+        NamespaceDetailsTransient& nsdt = NamespaceDetailsTransient::get_w( ns );
+        nsdt.notifyOfWriteOp();
+        for ( unsigned j = 0; j < locs.size(); j++ )
+            nsdt.queueDocumentWritten( objs[ from + j ], locs[ j ] );
+        return locs.size();
+    }
+
+    void DataFileMgr::insertBatchAndLog(const char *ns, vector<BSONObj>& objs) {
+        unsigned i = 0;
+        while ( i < objs.size() ) {
+            NamespaceDetails *d = nsdetails(ns);
+            unsigned n = 0;
+            if ( objs.size() - i > 1 && d && !d->capped && d->nIndexesBeingBuilt() == d->nIndexes &&
+                 strchr(ns, '$') == 0 && strstr(ns, ".system.") == 0 && strncmp(ns, "local.", 6) != 0 )
+                n = insertBatch( ns, d, objs, i );
+            if ( n ) {
+                logInserts( ns, vector< BSONObj >( objs.begin() + i, objs.begin() + i + n ) );
+                i += n;
+                continue;
+            }
+            // the first insert into a collection creates it; anything insertBatch() won't do
+            insert( ns, objs[i] );
+            logOp( "i", ns, objs[i] );
+            i++;
+        }
+    }
+
+    /* the new indexes of one collection for insertIndexes() */
+    static int insertCollectionIndexes(const string& sysIndexes, const vector<BSONObj>& specs) {
+        bool background = true;
+        for ( unsigned i = 0; i < specs.size(); i++ )
+            background = background && specs[i]["background"].trueValue();
+
+        NamespaceDetails *tableToIndex = 0;
+        string tabletoidxns;
+        vector<int> idxNos;
+        vector<string> names;
+        for ( unsigned i = 0; i < specs.size(); i++ ) {
+            /* the _id index goes through ensureHaveIdIndex(), which builds it on its own.  do that
+               first so it can't land in the middle of the batch. */
+            if ( IndexDetails::isIdIndexPattern( specs[i].getObjectField("key") ) )
+                theDataFileMgr.insert(sysIndexes.c_str(), specs[i].objdata(), specs[i].objsize());
+        }
+        for ( unsigned i = 0; i < specs.size(); i++ ) {
+            if ( IndexDetails::isIdIndexPattern( specs[i].getObjectField("key") ) )
+                continue;
+            NamespaceDetails *d = 0;
+            if( !prepareToBuildIndex(specs[i], false, tabletoidxns, d) )
+                continue;
+            assert( tableToIndex == 0 || tableToIndex == d );
+            tableToIndex = d;
+
+            DiskLoc loc = theDataFileMgr.insert(sysIndexes.c_str(), specs[i].objdata(), specs[i].objsize(), false, BSONElement(), false);
+            massert( 13104 , "couldn't insert index spec", !loc.isNull() );
+
+            idxNos.push_back( tableToIndex->nIndexes );
+            IndexDetails& idx = tableToIndex->addIndex(tabletoidxns.c_str(), false); // increments nIndexes
+            idx.info = loc;
+            names.push_back( idx.indexName() );
+        }
+        if ( idxNos.empty() )
+            return 0;
+
+        if ( !background )
+            NamespaceDetailsTransient::get_w(tabletoidxns.c_str()).addedIndex(); // clear transient info caches so they refresh
+        try {
+            buildIndexes(tabletoidxns, tableToIndex, idxNos, background);
+        } catch( DBException& ) {
+            rollbackIndexBuild(tabletoidxns, tableToIndex, names);
+            throw;
+        }
+        return idxNos.size();
+    }
+
+    int DataFileMgr::insertIndexes(const vector<BSONObj>& specs) {
+        string sysIndexes = cc().database()->name + ".system.indexes";
+
+        /* group by collection, keeping the order of the specs within each */
+        vector<string> order;
+        map< string, vector<BSONObj> > byNs;
+        for ( unsigned i = 0; i < specs.size(); i++ ) {
+            string ns = specs[i].getStringField("ns");
+            if ( byNs.count( ns ) == 0 )
+                order.push_back( ns );
+            byNs[ns].push_back( specs[i] );
+        }
+
+        int n = 0;
+        for ( unsigned i = 0; i < order.size(); i++ )
+            n += insertCollectionIndexes( sysIndexes , byNs[order[i]] );
+        return n;
+    }
+
     /* special version of insert for transaction logging -- streamlined a bit.
        assumes ns is capped and no indexes
     */
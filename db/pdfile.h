@@ -108,9 +108,29 @@ namespace mongo {
             const char *buf, int len, OpDebug& debug);
         // The object o may be updated if modified on insert.                                
         void insertAndLog( const char *ns, const BSONObj &o, bool god = false );
+        /* insert and log each of objs, in order, as insert() and logOp() would, stopping with an
+           exception at the first that fails.  for a collection that exists, runs of them are
+           stored as a batch: the records are allocated together, each index's new keys are added
+           in key order and the oplog entries are written in one pass.  if storing a batch fails
+           (no space, quota) the whole batch is rolled back, so only the objects before that batch
+           are inserted and logged.  objs are replaced by the stored objects.
+        */
+        void insertBatchAndLog( const char *ns, vector<BSONObj>& objs );
         DiskLoc insert(const char *ns, BSONObj &o, bool god = false);
         DiskLoc insert(const char *ns, const void *buf, int len, bool god = false, const BSONElement &writeId = BSONElement(), bool mayAddIndex = true);
+
+        /* insert several index specs ({ ns : ..., key : ..., name : ... }, as for system.indexes) and
+           build the new indexes of each collection together, with one scan of it.  specs of indexes 
+           that already exist are skipped.  a collection's indexes are built in the background only if 
+           all its specs ask for it.  
+           throws DBException; if the build fails all the new indexes of that collection are dropped.
+           @return number of indexes added
+        */
+        int insertIndexes(const vector<BSONObj>& specs);
         void deleteRecord(const char *ns, Record *todelete, const DiskLoc& dl, bool cappedOK = false, bool noWarn = false);
+        /* deletes many records of ns at once, unindexing them index by index in key order.
+           the records must be distinct. */
+        void deleteRecords(const char *ns, const vector<DiskLoc>& locs);
         static auto_ptr<Cursor> findAll(const char *ns, const DiskLoc &startLoc = DiskLoc());
 
         /* special version of insert for transaction logging -- streamlined a bit.
@@ -0,0 +1,586 @@
+// pipeline.cpp
+
+/**
+*    Copyright (C) 2008 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "pipeline.h"
+#include "matcher.h"
+
+namespace mongo {
+
+    /* what $group and $sort may buffer */
+    static const int PipelineMemoryLimit = 64 * 1024 * 1024;
+
+    static BSONObj wrap( const BSONElement &e ) {
+        BSONObjBuilder b( e.size() + 8 );
+        b.appendAs( e , "" );
+        return b.obj();
+    }
+
+    PipelineValue::PipelineValue( const BSONElement &e ) {
+        if ( e.type() == String && e.valuestr()[0] == '$' ) {
+            _path = e.valuestr() + 1;
+            uassert( 13113 , "empty field path in aggregation" , ! _path.empty() );
+        }
+        else {
+            _constant = wrap( e );
+        }
+    }
+
+    BSONElement PipelineValue::get( const BSONObj &o ) const {
+        if ( isPath() )
+            return o.getFieldDotted( _path.c_str() );
+        return _constant.firstElement();
+    }
+
+    /* one $sum/$avg/$min/$max/$count/$push for one group.
+       partial results (from a shard) are merged on mongos; $avg sends { sum , count } for that.
+    */
+    class Accumulator {
+    public:
+        enum Op { Sum , Avg , Min , Max , Count , Push };
+
+        Accumulator( Op op ) : _op( op ) , _sawDouble( false ) , _sawLong( false ) , _lsum( 0 ) , _dsum( 0 ) , _n( 0 ) {}
+
+        /** @return how much memory was added */
+        int add( const BSONElement &e ) {
+            switch( _op ) {
+            case Count:
+                _n++;
+                return 0;
+            case Sum:
+            case Avg:
+                if ( e.isNumber() ) {
+                    addNumber( e );
+                    _n++;
+                }
+                return 0;
+            case Min:
+            case Max: {
+                if ( e.eoo() )
+                    return 0;
+                if ( ! _best.isEmpty() ) {
+                    int c = e.woCompare( _best.firstElement() , false );
+                    if ( _op == Min ? c >= 0 : c <= 0 )
+                        return 0;
+                }
+                int old = _best.objsize();
+                _best = wrap( e );
+                return _best.objsize() - old;
+            }
+            case Push:
+                if ( e.eoo() )
+                    return 0;
+                _pushed.push_back( wrap( e ) );
+                return _pushed.back().objsize();
+            }
+            return 0;
+        }
+
+        int merge( const BSONElement &partial ) {
+            switch( _op ) {
+            case Count:
+                _n += partial.numberLong();
+                return 0;
+            case Sum:
+                if ( partial.isNumber() )
+                    addNumber( partial );
+                return 0;
+            case Avg: {
+                if ( partial.type() != Object )
+                    return 0;
+                BSONObj p = partial.embeddedObject();
+                if ( p["sum"].isNumber() )
+                    addNumber( p["sum"] );
+                _n += p["count"].numberLong();
+                return 0;
+            }
+            case Min:
+            case Max:
+                return add( partial );
+            case Push: {
+                if ( partial.type() != Array )
+                    return 0;
+                int size = 0;
+                BSONObjIterator i( partial.embeddedObject() );
+                while ( i.more() )
+                    size += add( i.next() );
+                return size;
+            }
+            }
+            return 0;
+        }
+
+        void append( BSONObjBuilder &b , const char *name , bool partial ) const {
+            switch( _op ) {
+            case Count:
+                appendNumber( b , name , false , _n > 0x7fffffff , 0 , _n );
+                break;
+            case Sum:
+                appendSum( b , name );
+                break;
+            case Avg:
+                if ( partial ) {
+                    BSONObjBuilder sub( b.subobjStart( name ) );
+                    appendSum( sub , "sum" );
+                    sub.append( "count" , _n );
+                    sub.done();
+                }
+                else if ( _n == 0 )
+                    b.appendNull( name );
+                else
+                    b.append( name , ( _dsum + _lsum ) / _n );
+                break;
+            case Min:
+            case Max:
+                if ( ! _best.isEmpty() )
+                    b.appendAs( _best.firstElement() , name );
+                else if ( ! partial )
+                    b.appendNull( name );
+                break;
+            case Push: {
+                BSONArrayBuilder a( b.subarrayStart( name ) );
+                for( vector< BSONObj >::const_iterator i = _pushed.begin(); i != _pushed.end(); ++i )
+                    a.append( i->firstElement() );
+                a.done();
+                break;
+            }
+            }
+        }
+
+    private:
+        void addNumber( const BSONElement &e ) {
+            if ( e.type() == NumberDouble ) {
+                _sawDouble = true;
+                _dsum += e.number();
+            }
+            else {
+                if ( e.type() == NumberLong )
+                    _sawLong = true;
+                _lsum += e.numberLong();
+            }
+        }
+
+        void appendSum( BSONObjBuilder &b , const char *name ) const {
+            appendNumber( b , name , _sawDouble , _sawLong || _lsum > 0x7fffffff || _lsum < -0x7fffffff , _dsum , _lsum );
+        }
+
+        /* ints stay ints unless they overflow */
+        static void appendNumber( BSONObjBuilder &b , const char *name , bool isDouble , bool isLong , double d , long long l ) {
+            if ( isDouble )
+                b.append( name , d + l );
+            else if ( isLong )
+                b.append( name , l );
+            else
+                b.append( name , (int)l );
+        }
+
+        Op _op;
+        bool _sawDouble;
+        bool _sawLong;
+        long long _lsum;
+        double _dsum;
+        long long _n;
+        BSONObj _best;
+        vector< BSONObj > _pushed;
+    };
+
+    class MatchStage : public PipelineStage {
+    public:
+        MatchStage( const BSONObj &query ) : _query( query.getOwned() ) , _matcher( _query ) {}
+        virtual bool add( const BSONObj &o ) {
+            if ( ! _matcher.matches( o ) )
+                return true;
+            return passOn( o );
+        }
+    private:
+        BSONObj _query;
+        Matcher _matcher;
+    };
+
+    /* { a : 1 , total : "$x.y" , _id : 0 } */
+    class ProjectStage : public PipelineStage {
+    public:
+        ProjectStage( const BSONObj &spec ) : _includeId( true ) {
+            BSONObjIterator i( spec );
+            while ( i.more() ) {
+                BSONElement e = i.next();
+                string name = e.fieldName();
+                uassert( 13114 , "$project field names can't contain '.', use { name : \"$a.b\" }" , name.find( '.' ) == string::npos );
+                if ( e.type() == String ) {
+                    uassert( 13115 , "$project values have to be 1, 0 or a \"$field\"" , e.valuestr()[0] == '$' );
+                    if ( name == "_id" )
+                        _includeId = false;
+                    _fields.push_back( make_pair( name , PipelineValue( e ) ) );
+                }
+                else if ( e.isNumber() || e.type() == Bool ) {
+                    if ( e.trueValue() ) {
+                        if ( name != "_id" )
+                            _fields.push_back( make_pair( name , PipelineValue( BSON( "" << "$" + name ).firstElement() ) ) );
+                    }
+                    else {
+                        uassert( 13116 , "only _id can be excluded by $project" , name == "_id" );
+                        _includeId = false;
+                    }
+                }
+                else {
+                    uassert( 13115 , "$project values have to be 1, 0 or a \"$field\"" , 0 );
+                }
+            }
+        }
+        virtual bool add( const BSONObj &o ) {
+            BSONObjBuilder b;
+            if ( _includeId ) {
+                BSONElement id = o["_id"];
+                if ( ! id.eoo() )
+                    b.append( id );
+            }
+            for( vector< pair< string , PipelineValue > >::const_iterator i = _fields.begin(); i != _fields.end(); ++i ) {
+                BSONElement v = i->second.get( o );
+                if ( ! v.eoo() )
+                    b.appendAs( v , i->first.c_str() );
+            }
+            return passOn( b.obj() );
+        }
+    private:
+        bool _includeId;
+        vector< pair< string , PipelineValue > > _fields;
+    };
+
+    /* { _id : "$a" | { x : "$a" , y : "$b" } | constant , name : { $sum : "$x" } , ... }
+       Partial: on a shard, the output is merged by mongos.  Merge: on mongos, the input is partial results.
+    */
+    class GroupStage : public PipelineStage {
+    public:
+        enum Mode { Normal , Partial , Merge };
+
+        GroupStage( const BSONObj &spec , Mode mode ) : _mode( mode ) , _size( 0 ) {
+            BSONElement id = spec["_id"];
+            uassert( 13117 , "$group needs an _id" , ! id.eoo() );
+            if ( id.type() == Object ) {
+                BSONObjIterator i( id.embeddedObject() );
+                while ( i.more() ) {
+                    BSONElement e = i.next();
+                    _idFields.push_back( make_pair( string( e.fieldName() ) , PipelineValue( e ) ) );
+                }
+            }
+            else {
+                _id = PipelineValue( id );
+            }
+
+            BSONObjIterator i( spec );
+            while ( i.more() ) {
+                BSONElement e = i.next();
+                if ( strcmp( e.fieldName() , "_id" ) == 0 )
+                    continue;
+                uassert( 13118 , (string)"$group field has to be { $op : value }: " + e.fieldName() , e.type() == Object && e.embeddedObject().nFields() == 1 );
+                BSONElement a = e.embeddedObject().firstElement();
+                string op = a.fieldName();
+                Accumulator::Op o;
+                if ( op == "$sum" ) o = Accumulator::Sum;
+                else if ( op == "$avg" ) o = Accumulator::Avg;
+                else if ( op == "$min" ) o = Accumulator::Min;
+                else if ( op == "$max" ) o = Accumulator::Max;
+                else if ( op == "$count" ) o = Accumulator::Count;
+                else if ( op == "$push" ) o = Accumulator::Push;
+                else {
+                    uassert( 13119 , (string)"unknown $group operator: " + op , 0 );
+                    o = Accumulator::Sum;
+                }
+                _names.push_back( e.fieldName() );
+                _ops.push_back( o );
+                _values.push_back( PipelineValue( a ) );
+            }
+        }
+
+        virtual bool add( const BSONObj &o ) {
+            BSONObj key = getKey( o );
+            Groups::iterator g = _groups.find( key );
+            if ( g == _groups.end() ) {
+                vector< Accumulator > accumulators;
+                for( unsigned i = 0; i < _ops.size(); ++i )
+                    accumulators.push_back( Accumulator( _ops[i] ) );
+                g = _groups.insert( make_pair( key , accumulators ) ).first;
+                _size += key.objsize() + 64 * _ops.size();
+            }
+            vector< Accumulator > &accumulators = g->second;
+            for( unsigned i = 0; i < accumulators.size(); ++i ) {
+                if ( _mode == Merge )
+                    _size += accumulators[i].merge( o[ _names[i] ] );
+                else
+                    _size += accumulators[i].add( _values[i].get( o ) );
+            }
+            uassert( 13120 , "$group uses too much memory" , _size < PipelineMemoryLimit );
+            return true;
+        }
+
+        virtual void done() {
+            for( Groups::const_iterator g = _groups.begin(); g != _groups.end(); ++g ) {
+                BSONObjBuilder b;
+                b.append( g->first.firstElement() );
+                for( unsigned i = 0; i < g->second.size(); ++i )
+                    g->second[i].append( b , _names[i].c_str() , _mode == Partial );
+                if ( ! passOn( b.obj() ) )
+                    break;
+            }
+            _groups.clear();
+            PipelineStage::done();
+        }
+
+    private:
+        BSONObj getKey( const BSONObj &o ) const {
+            BSONObjBuilder b;
+            if ( _mode == Merge ) {
+                b.append( o["_id"] );
+            }
+            else if ( ! _idFields.empty() ) {
+                BSONObjBuilder sub( b.subobjStart( "_id" ) );
+                for( vector< pair< string , PipelineValue > >::const_iterator i = _idFields.begin(); i != _idFields.end(); ++i ) {
+                    BSONElement v = i->second.get( o );
+                    if ( v.eoo() )
+                        sub.appendNull( i->first.c_str() );
+                    else
+                        sub.appendAs( v , i->first.c_str() );
+                }
+                sub.done();
+            }
+            else {
+                BSONElement v = _id.get( o );
+                if ( v.eoo() )
+                    b.appendNull( "_id" );
+                else
+                    b.appendAs( v , "_id" );
+            }
+            return b.obj();
+        }
+
+        typedef map< BSONObj , vector< Accumulator > , BSONObjCmp > Groups;
+
+        Mode _mode;
+        PipelineValue _id;
+        vector< pair< string , PipelineValue > > _idFields;
+        vector< string > _names;
+        vector< Accumulator::Op > _ops;
+        vector< PipelineValue > _values;
+        Groups _groups;
+        int _size;
+    };
+
+    class SortStage : public PipelineStage {
+    public:
+        SortStage( const BSONObj &order ) : _order( order.getOwned() ) , _size( 0 ) {
+            uassert( 13121 , "$sort needs at least one field" , ! _order.isEmpty() );
+        }
+        virtual bool add( const BSONObj &o ) {
+            _items.push_back( make_pair( o.extractFields( _order , true ) , o.getOwned() ) );
+            _size += _items.back().first.objsize() + o.objsize();
+            uassert( 13122 , "$sort uses too much memory, add a $limit or an index" , _size < PipelineMemoryLimit );
+            return true;
+        }
+        virtual void done() {
+            stable_sort( _items.begin() , _items.end() , Cmp( _order ) );
+            for( vector< pair< BSONObj , BSONObj > >::const_iterator i = _items.begin(); i != _items.end(); ++i )
+                if ( ! passOn( i->second ) )
+                    break;
+            _items.clear();
+            PipelineStage::done();
+        }
+    private:
+        class Cmp {
+        public:
+            Cmp( const BSONObj &order ) : _order( order ) {}
+            bool operator()( const pair< BSONObj , BSONObj > &l , const pair< BSONObj , BSONObj > &r ) const {
+                return l.first.woCompare( r.first , _order ) < 0;
+            }
+        private:
+            BSONObj _order;
+        };
+        BSONObj _order;
+        vector< pair< BSONObj , BSONObj > > _items;
+        int _size;
+    };
+
+    class SkipStage : public PipelineStage {
+    public:
+        SkipStage( long long n ) : _n( n ) {}
+        virtual bool add( const BSONObj &o ) {
+            if ( _n > 0 ) {
+                _n--;
+                return true;
+            }
+            return passOn( o );
+        }
+    private:
+        long long _n;
+    };
+
+    class LimitStage : public PipelineStage {
+    public:
+        LimitStage( long long n ) : _n( n ) {
+            uassert( 13123 , "$limit has to be positive" , _n > 0 );
+        }
+        virtual bool add( const BSONObj &o ) {
+            if ( _n <= 0 )
+                return false;
+            _n--;
+            return passOn( o ) && _n > 0;
+        }
+    private:
+        long long _n;
+    };
+
+    class OutputStage : public PipelineStage {
+    public:
+        OutputStage() : _size( 0 ) {}
+        virtual bool add( const BSONObj &o ) {
+            _size += o.objsize();
+            uassert( 13124 , "aggregation result is too large" , _size < 4000000 ); // has to fit in the command result
+            _results.push_back( o.getOwned() );
+            return true;
+        }
+        void append( BSONObjBuilder &result ) {
+            BSONArrayBuilder a( result.subarrayStart( "result" ) );
+            for( list< BSONObj >::const_iterator i = _results.begin(); i != _results.end(); ++i )
+                a.append( *i );
+            a.done();
+        }
+    private:
+        list< BSONObj > _results;
+        int _size;
+    };
+
+    static bool knownStage( const string &op ) {
+        return op == "$match" || op == "$project" || op == "$group" || op == "$sort" || op == "$skip" || op == "$limit";
+    }
+
+    Pipeline::Pipeline( const BSONObj &stages ) {
+        BSONObjIterator i( stages );
+        while ( i.more() ) {
+            BSONElement e = i.next();
+            uassert( 13125 , "pipeline stages have to be objects" , e.type() == Object && ! e.embeddedObject().isEmpty() );
+            BSONObj stage = e.embeddedObject();
+            uassert( 13126 , (string)"unknown pipeline stage: " + stage.firstElement().fieldName() , knownStage( stage.firstElement().fieldName() ) );
+            _specs.push_back( stage.getOwned() );
+        }
+    }
+
+    Pipeline::~Pipeline() {
+        for( vector< PipelineStage* >::iterator i = _stages.begin(); i != _stages.end(); ++i )
+            delete *i;
+    }
+
+    BSONObj Pipeline::takeMatch() {
+        assert( _stages.empty() );
+        if ( _specs.empty() || strcmp( _specs.front().firstElement().fieldName() , "$match" ) != 0 )
+            return BSONObj();
+        BSONObj query = _specs.front().firstElement().embeddedObjectUserCheck();
+        _specs.pop_front();
+        return query;
+    }
+
+    BSONObj Pipeline::leadingSort() const {
+        if ( _specs.empty() || strcmp( _specs.front().firstElement().fieldName() , "$sort" ) != 0 )
+            return BSONObj();
+        return _specs.front().firstElement().embeddedObjectUserCheck();
+    }
+
+    void Pipeline::takeSort() {
+        assert( _stages.empty() );
+        if ( ! leadingSort().isEmpty() )
+            _specs.pop_front();
+    }
+
+    void Pipeline::link() {
+        for( list< BSONObj >::const_iterator i = _specs.begin(); i != _specs.end(); ++i ) {
+            BSONElement e = i->firstElement();
+            string op = e.fieldName();
+            PipelineStage *s;
+            if ( op == "$match" )
+                s = new MatchStage( e.embeddedObjectUserCheck() );
+            else if ( op == "$project" )
+                s = new ProjectStage( e.embeddedObjectUserCheck() );
+            else if ( op == "$group" )
+                s = new GroupStage( e.embeddedObjectUserCheck() ,
+                                    (*i)["$partial"].trueValue() ? GroupStage::Partial :
+                                    (*i)["$merge"].trueValue() ? GroupStage::Merge : GroupStage::Normal );
+            else if ( op == "$sort" )
+                s = new SortStage( e.embeddedObjectUserCheck() );
+            else if ( op == "$skip" )
+                s = new SkipStage( e.numberLong() );
+            else
+                s = new LimitStage( e.numberLong() );
+            if ( ! _stages.empty() )
+                _stages.back()->setNext( s );
+            _stages.push_back( s );
+        }
+        PipelineStage *out = new OutputStage();
+        if ( ! _stages.empty() )
+            _stages.back()->setNext( out );
+        _stages.push_back( out );
+    }
+
+    bool Pipeline::add( const BSONObj &o ) {
+        if ( _stages.empty() )
+            link();
+        return _stages.front()->add( o );
+    }
+
+    void Pipeline::done( BSONObjBuilder &result ) {
+        if ( _stages.empty() )
+            link();
+        _stages.front()->done();
+        static_cast< OutputStage* >( _stages.back() )->append( result );
+    }
+
+    void Pipeline::split( const BSONObj &stages , BSONObj &shardStages , BSONObj &mergeStages ) {
+        BSONArrayBuilder shard;
+        BSONArrayBuilder merge;
+        bool prefix = true;
+        bool sortOnShards = false;
+        BSONObjIterator i( stages );
+        while ( i.more() ) {
+            BSONObj stage = i.next().embeddedObjectUserCheck();
+            string op = stage.firstElement().fieldName();
+            if ( prefix && ( op == "$match" || op == "$project" ) ) {
+                shard.append( stage );
+                continue;
+            }
+            if ( prefix ) {
+                prefix = false;
+                if ( op == "$group" ) {
+                    BSONObj spec = stage.firstElement().embeddedObjectUserCheck();
+                    shard.append( BSON( "$group" << spec << "$partial" << true ) );
+                    merge.append( BSON( "$group" << spec << "$merge" << true ) );
+                    continue;
+                }
+                // every shard sorts and limits its part, mongos does it again over all of them
+                if ( op == "$sort" || op == "$limit" )
+                    shard.append( stage );
+                sortOnShards = op == "$sort";
+            }
+            else if ( sortOnShards ) {
+                if ( op == "$limit" )
+                    shard.append( stage );
+                sortOnShards = false;
+            }
+            merge.append( stage );
+        }
+        shardStages = shard.arr();
+        mergeStages = merge.arr();
+    }
+
+} // namespace mongo
@@ -0,0 +1,92 @@
+// pipeline.h
+
+/**
+*    Copyright (C) 2008 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "../stdafx.h"
+#include "jsobj.h"
+
+namespace mongo {
+
+    /**
+       native aggregation: documents are pushed through a chain of stages
+         [ { $match : <query> } , { $project : { a : 1 , total : "$x.y" } } ,
+           { $group : { _id : "$a" , n : { $sum : 1 } , avg : { $avg : "$total" } } } ,
+           { $sort : { n : -1 } } , { $skip : 5 } , { $limit : 10 } ]
+       everything works on BSONObj directly; no javascript.
+       this file is shared with mongos, which merges the results of sharded runs.
+     */
+
+    /** a "$a.b" field path or a constant */
+    class PipelineValue {
+    public:
+        PipelineValue() {}
+        PipelineValue( const BSONElement &e );
+        /** EOO if the field is missing */
+        BSONElement get( const BSONObj &o ) const;
+        bool isPath() const { return ! _path.empty(); }
+    private:
+        BSONObj _constant;
+        string _path;
+    };
+
+    class PipelineStage : boost::noncopyable {
+    public:
+        PipelineStage() : _next( 0 ) {}
+        virtual ~PipelineStage() {}
+        /** @return false once no more input is wanted */
+        virtual bool add( const BSONObj &o ) = 0;
+        /** end of input.  stages that buffer pass their results on here */
+        virtual void done() { if ( _next ) _next->done(); }
+        void setNext( PipelineStage *next ) { _next = next; }
+    protected:
+        bool passOn( const BSONObj &o ) { return _next->add( o ); }
+        PipelineStage *_next;
+    };
+
+    class Pipeline : boost::noncopyable {
+    public:
+        /** @param stages the pipeline array from the command */
+        Pipeline( const BSONObj &stages );
+        ~Pipeline();
+
+        /** removes and returns a leading $match, so the caller can answer it with an index */
+        BSONObj takeMatch();
+        /** the $sort that now leads the pipeline, if any */
+        BSONObj leadingSort() const;
+        /** drops the leading $sort, for when the caller's cursor already returns that order */
+        void takeSort();
+
+        /** @return false once no more input is wanted */
+        bool add( const BSONObj &o );
+        /** ends the input and appends the results to the command result as "result" */
+        void done( BSONObjBuilder &result );
+
+        /**
+           splits a pipeline for a sharded collection.  shardStages run on every shard, with
+           $group sending partial results; mergeStages run on mongos over all the shards' results.
+         */
+        static void split( const BSONObj &stages , BSONObj &shardStages , BSONObj &mergeStages );
+
+    private:
+        void link();
+        list< BSONObj > _specs;
+        vector< PipelineStage* > _stages; // built on first use; the last one is the output
+    };
+
+} // namespace mongo
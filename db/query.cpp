@@ -34,6 +34,7 @@
 #include "commands.h"
 #include "queryoptimizer.h"
 #include "lasterror.h"
+#include "parallelscan.h"
 
 namespace mongo {
 
@@ -142,55 +143,80 @@ namespace mongo {
 
         CursorId id = cc->cursorid;
         
-        unsigned long long nScanned = 0;
-        do {
-            if ( ++nScanned % 128 == 0 && !god && !matcher.docMatcher().atomic() ) {
-                if ( ! cc->yield() ){
-                    cc.release(); // has already been deleted elsewhere
-                    break;
-                }
-            }
-            
+        /* matches are collected a chunk at a time and then deleted together.  the cursor sits on
+           the first key past the chunk while its records go, so its location is noted and checked
+           once per chunk, and we yield between chunks.
+        */
+        vector< DiskLoc > chunk;
+        while ( cc->c->ok() ) {
             // this way we can avoid calling updateLocation() every time (expensive)
             // as well as some other nuances handled
             cc->setDoingDeletes( true );
+
+            chunk.clear();
+            BSONObjBuilder idsBuilder;
+            BSONArrayBuilder ids( idsBuilder.subarrayStart( "$in" ) );
+            int nIds = 0;
+            int idBytes = 0;
+            for ( int nScanned = 0; nScanned < 128 && cc->c->ok(); nScanned++ ) {
+                DiskLoc rloc = cc->c->currLoc();
+                BSONObj key = cc->c->currKey();
             
-            DiskLoc rloc = cc->c->currLoc();
-            BSONObj key = cc->c->currKey();
-            
-            cc->c->advance();
+                cc->c->advance();
             
-            if ( ! matcher.matches( key , rloc ) )
-                continue;
+                if ( ! matcher.matches( key , rloc ) )
+                    continue;
+
+                // another key of a multikey record already in this chunk
+                if ( cc->c->getsetdup( rloc ) )
+                    continue;
             
-            assert( !cc->c->getsetdup(rloc) ); // can't be a dup, we deleted it!
+                if ( logop ) {
+                    BSONElement e;
+                    if( BSONObj( rloc.rec() ).getObjectID( e ) ) {
+                        ids.append( e );
+                        nIds++;
+                        idBytes += e.size();
+                    } else {
+                        problem() << "deleted object without id, not logging" << endl;
+                    }
+                }
 
-            if ( !justOne ) {
-                /* NOTE: this is SLOW.  this is not good, noteLocation() was designed to be called across getMore
-                   blocks.  here we might call millions of times which would be bad.
-                */
+                chunk.push_back( rloc );
+                if ( justOne || idBytes > 256 * 1024 )
+                    break;
+            }
+            ids.done();
+
+            if ( nIds ) {
+                /* one entry for the chunk.  the _ids, not the pattern, are logged: other documents
+                   matching the pattern may be inserted while we yield. */
+                BSONObj o = idsBuilder.done();
+                BSONObjBuilder b;
+                if ( nIds == 1 )
+                    b.appendAs( o.firstElement().embeddedObject().firstElement() , "_id" );
+                else
+                    b.append( "_id" , o );
+                bool replJustOne = nIds == 1;
+                logOp( "d", ns, b.done(), 0, &replJustOne );
+            }
+
+            if ( !chunk.empty() ) {
                 cc->c->noteLocation();
+                theDataFileMgr.deleteRecords( ns, chunk );
+                nDeleted += chunk.size();
+                if ( justOne )
+                    break;
+                cc->c->checkLocation();
             }
-            
-            if ( logop ) {
-                BSONElement e;
-                if( BSONObj( rloc.rec() ).getObjectID( e ) ) {
-                    BSONObjBuilder b;
-                    b.append( e );
-                    bool replJustOne = true;
-                    logOp( "d", ns, b.done(), 0, &replJustOne );
-                } else {
-                    problem() << "deleted object without id, not logging" << endl;
+
+            if ( !god && !matcher.docMatcher().atomic() && cc->c->ok() ) {
+                if ( ! cc->yield() ){
+                    cc.release(); // has already been deleted elsewhere
+                    break;
                 }
             }
-
-            theDataFileMgr.deleteRecord(ns, rloc.rec(), rloc);
-            nDeleted++;
-            if ( justOne )
-                break;
-            cc->c->checkLocation();
-            
-        } while ( cc->c->ok() );
+        }
 
         if ( cc.get() && ClientCursor::find( id , false ) == 0 ){
             cc.release();
@@ -290,6 +316,12 @@ namespace mongo {
             c->checkLocation();
             DiskLoc last;
 
+            OpStats &stats = curop.debug().stats;
+            stats.timed = curop.profileLevel() > 0;
+            long long *cursorMicros = stats.timed ? &stats.cursorMicros : 0;
+            long long *matchMicros = stats.timed ? &stats.matchMicros : 0;
+            long long *projectMicros = stats.timed ? &stats.projectMicros : 0;
+
             while ( 1 ) {
                 if ( !c->ok() ) {
                     if ( c->tailable() ) {
@@ -313,7 +345,13 @@ namespace mongo {
                     cc = 0;
                     break;
                 }
-                if ( !cc->matcher->matches(c->currKey(), c->currLoc() ) ) {
+                stats.nscanned++;
+                bool match;
+                {
+                    StageTimer t( matchMicros );
+                    match = cc->matcher->matches(c->currKey(), c->currLoc() );
+                }
+                if ( !match ) {
                 }
                 else {
                     //out() << "matches " << c->currLoc().toString() << '\n';
@@ -324,16 +362,21 @@ namespace mongo {
                         last = c->currLoc();
                         BSONObj js = c->current();
 
-                        fillQueryResultFromObj(b, cc->fields.get(), js);
+                        {
+                            StageTimer t( projectMicros );
+                            fillQueryResultFromObj(b, cc->fields.get(), js);
+                        }
                         n++;
                         if ( (ntoreturn>0 && (n >= ntoreturn || b.len() > MaxBytesToReturnToClientAtOnce)) ||
                              (ntoreturn==0 && b.len()>1*1024*1024) ) {
+                            StageTimer t( cursorMicros );
                             c->advance();
                             cc->pos += n;
                             break;
                         }
                     }
                 }
+                StageTimer t( cursorMicros );
                 c->advance();
             }
             
@@ -435,9 +478,85 @@ namespace mongo {
         BSONObj firstMatch_;
     };
     
+    /* true if the index bounds of e say exactly what e matches: equality, $in and
+       $gt/$gte/$lt/$lte, without regexes or arrays */
+    static bool exactBoundsQuery( const BSONElement &e ) {
+        if ( e.type() == RegEx || e.type() == Array )
+            return false;
+        if ( e.type() != Object || e.embeddedObject().firstElement().fieldName()[0] != '$' )
+            return true;
+        BSONObjIterator i( e.embeddedObject() );
+        while ( i.more() ) {
+            BSONElement op = i.next();
+            switch( op.getGtLtOp() ) {
+            case BSONObj::LT:
+            case BSONObj::LTE:
+            case BSONObj::GT:
+            case BSONObj::GTE:
+                if ( op.type() == RegEx || op.type() == Array )
+                    return false;
+                break;
+            case BSONObj::opIN: {
+                if ( op.type() != Array )
+                    return false;
+                BSONObjIterator j( op.embeddedObject() );
+                while ( j.more() ) {
+                    BSONElement x = j.next();
+                    if ( x.type() == RegEx || x.type() == Array || x.type() == Object )
+                        return false;
+                }
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /* a query on the first field of a counted index is counted by descending the index at the
+       ends of each interval, rather than walking them.  -1 if there is no such index.
+    */
+    static long long countFromIndex( NamespaceDetails *d, const char *ns, const BSONObj &query ) {
+        if ( query.nFields() != 1 || !exactBoundsQuery( query.firstElement() ) )
+            return -1;
+        const char *field = query.firstElement().fieldName();
+        for ( int i = 0; i < d->nIndexes; i++ ) {
+            IndexDetails &idx = d->idx( i );
+            BSONElement first = idx.keyPattern().firstElement();
+            if ( !idx.counted() || d->isMultikey( i ) || !first.isNumber() ||
+                 strcmp( first.fieldName(), field ) != 0 || !idx.getSpec().usableFor( query ) )
+                continue;
+
+            FieldRangeSet frs( ns, query );
+            const vector< FieldInterval > &intervals = frs.range( field ).intervals();
+            // one sided ranges reach MinKey or MaxKey, which the matcher wouldn't
+            for ( vector< FieldInterval >::const_iterator j = intervals.begin(); j != intervals.end(); ++j )
+                if ( j->lower_.bound_.canonicalType() != j->upper_.bound_.canonicalType() )
+                    return -1;
+
+            long long n = 0;
+            for ( vector< FieldInterval >::const_iterator j = intervals.begin(); j != intervals.end(); ++j )
+                n += BtreeBucket::countInterval( idx, *j );
+            return n;
+        }
+        return -1;
+    }
+
     /* { count: "collectionname"[, query: <query>] }
        returns -1 on ns does not exist error.
     */    
+    class ParallelCountOp : public ParallelMatchOp {
+    public:
+        ParallelCountOp( const BSONObj &query ) : ParallelMatchOp( query ), _n( 0 ) {}
+        virtual ParallelScanOp *clone() const { return new ParallelCountOp( _query ); }
+        long long n() const { return _n; }
+    protected:
+        virtual void matched( const BSONObj &o, const DiskLoc &loc ) { ++_n; }
+    private:
+        long long _n;
+    };
+
     long long runCount( const char *ns, const BSONObj &cmd, string &err ) {
         NamespaceDetails *d = nsdetails( ns );
         if ( !d ) {
@@ -461,6 +580,30 @@ namespace mongo {
             }
             return num;
         }
+
+        long long num = countFromIndex( d, ns, query );
+        if ( num >= 0 ) {
+            // as CountOp does it
+            num = max( 0LL, num - cmd["skip"].numberLong() );
+            long long limit = cmd["limit"].numberLong();
+            if ( limit > 0 && limit < num )
+                num = limit;
+            return num;
+        }
+
+        // a limit lets CountOp stop early, so only unlimited counts are split up
+        if ( cmd["limit"].numberLong() <= 0 ) {
+            int nThreads = parallelQueryThreads( ns, d, query, BSONObj() );
+            if ( nThreads > 1 ) {
+                ParallelCollectionScan scan( ns, d, nThreads );
+                scan.run( ParallelCountOp( query ) );
+                num = 0;
+                for( unsigned i = 0; i < scan.ops().size(); ++i )
+                    num += static_cast< ParallelCountOp* >( scan.ops()[ i ].get() )->n();
+                return max( 0LL, num - cmd["skip"].numberLong() );
+            }
+        }
+
         QueryPlanSet qps( ns, query, BSONObj() );
         CountOp original( cmd );
         shared_ptr< CountOp > res = qps.runOp( original );
@@ -483,7 +626,6 @@ namespace mongo {
             _buf( 32768 ) , // TODO be smarter here
             _pq( pq ) ,
             _ntoskip( pq.getSkip() ) ,
-            _nscanned(0), _nscannedObjects(0),
             _n(0),
             _inMemSort(false),
             _saveClientCursor(false),
@@ -492,10 +634,12 @@ namespace mongo {
         
         virtual void init() {
             _buf.skip( sizeof( QueryResult ) );
+            _stats.timed = _pq.isExplain() || cc().curop()->profileLevel() > 0;
             
             if ( _oplogReplay ) {
                 _findingStartCursor.reset( new FindingStartCursor( qp() ) );
             } else {
+                StageTimer t( timer( _stats.cursorMicros ) );
                 _c = qp().newCursor( DiskLoc() , _pq.getNumToReturn() + _pq.getSkip() );
             }
             _matcher.reset(new CoveredIndexMatcher( qp().query() , qp().indexKey()));
@@ -517,7 +661,10 @@ namespace mongo {
                 return;
             }
             
-            if ( !_c->ok() ) {
+            bool ok = _c->ok();
+            if ( _stats.nscanned == 0 )
+                _stats.nscanned = _c->nscannedUpFront();
+            if ( !ok ) {
                 finish();
                 return;
             }
@@ -528,21 +675,30 @@ namespace mongo {
                 cout << "SCANNING this: " << this << " key: " << _c->currKey() << " obj: " << _c->current() << endl;
             }
 
-            _nscanned++;
-            if ( !_matcher->matches(_c->currKey(), _c->currLoc() , &_details ) ) {
+            _stats.nscanned++;
+            bool match;
+            {
+                StageTimer t( timer( _stats.matchMicros ) );
+                match = _matcher->matches(_c->currKey(), _c->currLoc() , &_details );
+            }
+            if ( !match ) {
                 // not a match, continue onward
                 if ( _details.loadedObject )
-                    _nscannedObjects++;
+                    _stats.nscannedObjects++;
             }
             else {
-                _nscannedObjects++;
+                _stats.nscannedObjects++;
                 DiskLoc cl = _c->currLoc();
                 if( !_c->getsetdup(cl) ) { 
                     // got a match.
                     
                     if ( _inMemSort ) {
                         // note: no cursors for non-indexed, ordered results.  results must be fairly small.
-                        _so->add( _pq.returnKey() ? _c->currKey() : _c->current() );
+                        StageTimer t( timer( _stats.sortMicros ) );
+                        if ( _pq.returnKey() )
+                            _so->add( _c->currKey() , DiskLoc() );
+                        else
+                            _so->add( _c->current() , cl );
                     }
                     else if ( _ntoskip > 0 ) {
                         _ntoskip--;
@@ -557,6 +713,7 @@ namespace mongo {
                             }
                         }
                         else {
+                            StageTimer t( timer( _stats.projectMicros ) );
                             if ( _pq.returnKey() ){
                                 BSONObjBuilder bb( _buf );
                                 bb.appendKeys( _c->indexKeyPattern() , _c->currKey() );
@@ -577,6 +734,7 @@ namespace mongo {
                             else if ( _pq.enoughForFirstBatch( _n , _buf.len() ) ){
                                 /* if only 1 requested, no cursor saved for efficiency...we assume it is findOne() */
                                 if ( mayCreateCursor1 ) {
+                                    StageTimer t( timer( _stats.cursorMicros ) );
                                     _c->advance();
                                     if ( _c->ok() ) {
                                         // more...so save a cursor
@@ -590,6 +748,7 @@ namespace mongo {
                     }
                 }
             }
+            StageTimer t( timer( _stats.cursorMicros ) );
             _c->advance();            
         }
 
@@ -598,6 +757,7 @@ namespace mongo {
                 _n = _inMemSort ? _so->size() : _n;
             } 
             else if ( _inMemSort ) {
+                StageTimer t( timer( _stats.sortMicros ) );
                 _so->fill( _buf, _pq.getFields() , _n );
             }
             
@@ -622,17 +782,19 @@ namespace mongo {
         auto_ptr< Cursor > cursor() { return _c; }
         auto_ptr< CoveredIndexMatcher > matcher() { return _matcher; }
         int n() const { return _n; }
-        long long nscanned() const { return _nscanned; }
-        long long nscannedObjects() const { return _nscannedObjects; }
+        long long nscanned() const { return _stats.nscanned; }
+        long long nscannedObjects() const { return _stats.nscannedObjects; }
+        const OpStats &stats() const { return _stats; }
         bool saveClientCursor() const { return _saveClientCursor; }
 
     private:
         BufBuilder _buf;
         const ParsedQuery& _pq;
 
+        long long *timer( long long &micros ) { return _stats.timed ? &micros : 0; }
+
         long long _ntoskip;
-        long long _nscanned;
-        long long _nscannedObjects;
+        OpStats _stats; // this plan's work
         int _n; // found so far
         
         MatchDetails _details;
@@ -649,6 +811,41 @@ namespace mongo {
         auto_ptr< FindingStartCursor > _findingStartCursor;
     };
     
+    class ParallelSortOp : public ParallelMatchOp {
+    public:
+        ParallelSortOp( const BSONObj &query ) : ParallelMatchOp( query ) {}
+        virtual ParallelScanOp *clone() const { return new ParallelSortOp( _query ); }
+        vector< DiskLoc > locs;
+    protected:
+        virtual void matched( const BSONObj &o, const DiskLoc &loc ) { locs.push_back( loc ); }
+    };
+
+    /* an unindexed query with a sort has to see every match before it can return any, so
+       the matching is split across threads and only the sort is done here.
+       @return the number of objects put in bb
+    */
+    static int runParallelSortedQuery( const char *ns, NamespaceDetails *d, int nThreads, const ParsedQuery &pq,
+                                       BufBuilder &bb, long long &nscanned ) {
+        ParallelCollectionScan scan( ns, d, nThreads );
+        scan.run( ParallelSortOp( pq.getFilter() ) );
+        nscanned = scan.nscanned();
+
+        vector< DiskLoc > locs;
+        for( unsigned i = 0; i < scan.ops().size(); ++i ) {
+            const vector< DiskLoc > &l = static_cast< ParallelSortOp* >( scan.ops()[ i ].get() )->locs;
+            locs.insert( locs.end(), l.begin(), l.end() );
+        }
+        // the workers interleave extents; this keeps ties in the same order from one run to the next
+        sort( locs.begin(), locs.end() );
+
+        ScanAndOrder so( pq.getSkip(), pq.getNumToReturn(), pq.getOrder() );
+        for( vector< DiskLoc >::const_iterator i = locs.begin(); i != locs.end(); ++i )
+            so.add( i->obj(), *i );
+        int n = 0;
+        so.fill( bb, pq.getFields(), n );
+        return n;
+    }
+
     /* run a query -- includes checking for and running a Command */
     auto_ptr< QueryResult > runQuery(Message& m, QueryMessage& q, CurOp& curop ) {
         StringBuilder& ss = curop.debug().str;
@@ -786,6 +983,30 @@ namespace mongo {
             }     
         }
         
+        if ( ! explain && ! snapshot && ! pq.hasIndexSpecifier() && ! order.isEmpty() && ! pq.returnKey() &&
+             ! pq.hasOption( QueryOption_CursorTailable ) && ! pq.hasOption( QueryOption_OplogReplay ) ) {
+            NamespaceDetails *d = nsdetails( ns );
+            int nThreads = parallelQueryThreads( ns, d, query, order );
+            if ( nThreads > 1 ) {
+                BufBuilder bb( 32768 );
+                bb.skip( sizeof( QueryResult ) );
+                n = runParallelSortedQuery( ns, d, nThreads, pq, bb, nscanned );
+                curop.debug().stats.nscanned += nscanned;
+                ss << " scanAndOrder parallel:" << nThreads << " nscanned:" << nscanned;
+                qr.reset( (QueryResult *) bb.buf() );
+                bb.decouple();
+                qr->setResultFlagsToOk();
+                qr->len = bb.len();
+                ss << " reslen:" << bb.len();
+                qr->setOperation(opReply);
+                qr->cursorId = cursorid;
+                qr->startingFrom = 0;
+                qr->nReturned = n;
+                ss << " nreturned:" << n;
+                return qr;
+            }
+        }
+
         // regular, not QO bypass query
         
         BSONObj oldPlan;
@@ -801,6 +1022,7 @@ namespace mongo {
         massert( 10362 ,  dqo.exceptionMessage(), dqo.complete() );
         n = dqo.n();
         nscanned = dqo.nscanned();
+        curop.debug().stats.add( dqo.stats() );
         if ( dqo.scanAndOrderRequired() )
             ss << " scanAndOrder ";
         auto_ptr<Cursor> cursor = dqo.cursor();
@@ -832,6 +1054,11 @@ namespace mongo {
             if ( dqo.scanAndOrderRequired() )
                 builder.append("scanAndOrder", true);
             builder.append("millis", curop.elapsedMillis());
+            {
+                BSONObjBuilder stats( builder.subobjStart( "stats" ) );
+                curop.debug().stats.append( stats );
+                stats.done();
+            }
             if ( !oldPlan.isEmpty() )
                 builder.append( "oldPlan", oldPlan.firstElement().embeddedObject().firstElement().embeddedObject() );
             if ( hint.eoo() )
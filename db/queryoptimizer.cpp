@@ -23,6 +23,8 @@
 #include "pdfile.h"
 #include "queryoptimizer.h"
 #include "cmdline.h"
+#include "histogram.h"
+#include "matcher.h"
 
 //#define DEBUGQO(x) cout << x << endl;
 #define DEBUGQO(x)
@@ -63,7 +65,9 @@ namespace mongo {
     endKeyInclusive_( endKey.isEmpty() ),
     unhelpful_( false ),
     _special( special ),
-    _type(0){
+    _type(0),
+    _sortedIntersect( false ),
+    _unionPossible( false ){
 
         if ( !fbs_.matchPossible() ) {
             unhelpful_ = true;
@@ -171,16 +175,420 @@ namespace mongo {
             newBounds.push_back( make_pair( newStart, newEnd ) );
             indexBounds_ = newBounds;
         }
+        else if ( FieldRangeVector::useful( fbs, idxKey ) ) {
+            /* a range on a later field can be applied by skipping through the index.  this
+               costs about one seek per distinct prefix value, rather than a full scan - so even
+               with an unconstrained first field the plan is worth racing. */
+            ranges_.reset( new FieldRangeVector( fbs, idxKey, direction_ ) );
+        }
         if ( ( scanAndOrderRequired_ || order_.isEmpty() ) &&
-            !fbs.range( idxKey.firstElement().fieldName() ).nontrivial() )
+            !fbs.range( idxKey.firstElement().fieldName() ).nontrivial() &&
+            !ranges_ )
             unhelpful_ = true;
     }
     
+    /* walks the cursors of several indexes together, returning only the records that every
+       one of them reaches.  if each index scans a single key, equal keys being ordered by
+       DiskLoc, the cursors can be merged as they go.  otherwise the DiskLocs of the index with
+       the smallest range are gathered up front, and the ranges of the others are walked against
+       them.  the smallest range is found by reading every range a key at a time in turn until
+       one runs out, so the gather reads at most a few times as many keys as that range has; the
+       last of the others is then streamed from the start with its second cursor in streams.
+     */
+    class IntersectCursor : public Cursor {
+    public:
+        IntersectCursor( const vector< shared_ptr< Cursor > > &c, const vector< shared_ptr< Cursor > > &streams, bool sorted ) :
+            _c( c ), _streams( streams ), _n( c.size() ), _sorted( sorted ), _init(), _ok(), _nscannedUpFront() {}
+        virtual bool ok() {
+            init();
+            return _ok;
+        }
+        virtual Record* _current() {
+            assert( ok() );
+            return _c.back()->_current();
+        }
+        virtual BSONObj current() {
+            return BSONObj( _current() );
+        }
+        virtual DiskLoc currLoc() {
+            return ok() ? _c.back()->currLoc() : DiskLoc();
+        }
+        virtual DiskLoc refLoc() {
+            return currLoc();
+        }
+        virtual bool advance() {
+            if ( !ok() )
+                return false;
+            if ( _sorted ) {
+                _c[ 0 ]->advance();
+                align();
+            } else {
+                _c.back()->advance();
+                skipUngathered();
+            }
+            return _ok;
+        }
+        virtual void noteLocation() {
+            _noted = currLoc();
+            for( unsigned i = 0; i < _c.size(); ++i )
+                _c[ i ]->noteLocation();
+            for( unsigned i = 0; i < _streams.size(); ++i )
+                _streams[ i ]->noteLocation();
+        }
+        virtual void checkLocation() {
+            for( unsigned i = 0; i < _c.size(); ++i )
+                _c[ i ]->checkLocation();
+            for( unsigned i = 0; i < _streams.size(); ++i )
+                _streams[ i ]->checkLocation();
+            if ( !_init )
+                return;
+            if ( _sorted )
+                align();
+            else if ( _c.back()->ok() && _c.back()->currLoc() == _noted )
+                _ok = true; // already taken out of _locs
+            else
+                skipUngathered();
+        }
+        virtual void aboutToDeleteBucket(const DiskLoc& b) {
+            for( unsigned i = 0; i < _c.size(); ++i )
+                _c[ i ]->aboutToDeleteBucket( b );
+            for( unsigned i = 0; i < _streams.size(); ++i )
+                _streams[ i ]->aboutToDeleteBucket( b );
+        }
+        virtual bool supportGetMore() { return true; }
+        /* _locs only hands out each DiskLoc once */
+        virtual bool getsetdup(DiskLoc loc) { return false; }
+        virtual string toString() {
+            string s = "IntersectCursor(";
+            for( unsigned i = 0; i < _n; ++i )
+                s += ( i ? ", " : " " ) + _c[ i ]->toString();
+            return s + " )";
+        }
+        virtual BSONObj prettyIndexBounds() const {
+            BSONArrayBuilder ba;
+            for( unsigned i = 0; i < _n; ++i ) {
+                BSONObjIterator j( _c[ i ]->prettyIndexBounds() );
+                while( j.more() )
+                    ba.append( j.next() );
+            }
+            return ba.arr();
+        }
+        virtual long long nscannedUpFront() const { return _nscannedUpFront; }
+    private:
+        void init() {
+            if ( _init )
+                return;
+            _init = true;
+            if ( _sorted ) {
+                align();
+                return;
+            }
+            gather();
+            skipUngathered();
+        }
+        // move every cursor up to the first DiskLoc they all have
+        void align() {
+            while( 1 ) {
+                DiskLoc max;
+                for( unsigned i = 0; i < _c.size(); ++i ) {
+                    if ( !_c[ i ]->ok() ) {
+                        _ok = false;
+                        return;
+                    }
+                    if ( max < _c[ i ]->currLoc() )
+                        max = _c[ i ]->currLoc();
+                }
+                bool same = true;
+                for( unsigned i = 0; i < _c.size(); ++i ) {
+                    while( _c[ i ]->ok() && _c[ i ]->currLoc() < max )
+                        _c[ i ]->advance();
+                    if ( !_c[ i ]->ok() ) {
+                        _ok = false;
+                        return;
+                    }
+                    if ( !( _c[ i ]->currLoc() == max ) )
+                        same = false;
+                }
+                if ( same ) {
+                    _ok = true;
+                    return;
+                }
+            }
+        }
+        void gather() {
+            vector< set< DiskLoc > > seen( _n );
+            int smallest = -1;
+            while( smallest < 0 ) {
+                unsigned least = MaxIntersectLocs + 1;
+                for( unsigned i = 0; i < _n; ++i ) {
+                    if ( !_c[ i ]->ok() ) {
+                        smallest = i;
+                        break;
+                    }
+                    seen[ i ].insert( _c[ i ]->currLoc() );
+                    _c[ i ]->advance();
+                    ++_nscannedUpFront;
+                    least = min( least, (unsigned) seen[ i ].size() );
+                }
+                uassert( 13105, "index intersection too large", smallest >= 0 || least <= MaxIntersectLocs );
+            }
+            _locs.swap( seen[ smallest ] );
+
+            unsigned streamed = smallest == (int) _n - 1 ? _n - 2 : _n - 1;
+            for( unsigned i = 0; i < _n; ++i ) {
+                if ( (int) i == smallest || i == streamed )
+                    continue;
+                set< DiskLoc > both;
+                for( set< DiskLoc >::const_iterator j = seen[ i ].begin(); j != seen[ i ].end(); ++j )
+                    if ( _locs.count( *j ) )
+                        both.insert( *j );
+                for( ; _c[ i ]->ok(); _c[ i ]->advance() ) {
+                    ++_nscannedUpFront;
+                    if ( _locs.count( _c[ i ]->currLoc() ) )
+                        both.insert( _c[ i ]->currLoc() );
+                }
+                _locs.swap( both );
+            }
+            _c.push_back( _streams[ streamed ] );
+            _streams.clear();
+        }
+        // each match is removed from _locs, which takes care of multikey dups as well
+        void skipUngathered() {
+            Cursor *c = _c.back().get();
+            while( c->ok() && _locs.erase( c->currLoc() ) == 0 )
+                c->advance();
+            _ok = c->ok();
+        }
+        static const unsigned MaxIntersectLocs = 1000000;
+        vector< shared_ptr< Cursor > > _c; // after gather(), followed by the streamed cursor
+        vector< shared_ptr< Cursor > > _streams;
+        unsigned _n;
+        bool _sorted;
+        bool _init;
+        bool _ok;
+        long long _nscannedUpFront;
+        set< DiskLoc > _locs;
+        DiskLoc _noted;
+    };
+
+    QueryPlan::QueryPlan( NamespaceDetails *_d, const vector< int > &idxNos, const FieldRangeSet &fbs, const BSONObj &order ) :
+    d(_d), idxNo(-1),
+    fbs_( fbs ),
+    order_( order ),
+    index_( 0 ),
+    optimal_( false ),
+    scanAndOrderRequired_( !order.isEmpty() ),
+    exactKeyMatch_( false ),
+    direction_( 0 ),
+    endKeyInclusive_( true ),
+    unhelpful_( false ),
+    _type(0),
+    _sortedIntersect( true ),
+    _unionPossible( false ){
+        for( unsigned i = 0; i < idxNos.size(); ++i ) {
+            shared_ptr< QueryPlan > p( new QueryPlan( d, idxNos[ i ], fbs, _noOrder ) );
+            BoundList b = p->indexBounds();
+            if ( p->skipScan() || b.size() != 1 || b[ 0 ].first.woCompare( b[ 0 ].second ) != 0 )
+                _sortedIntersect = false;
+            _intersect.push_back( p );
+        }
+    }
+    
+    /* the records of several cursors, one after another.  a DiskLoc already seen by an earlier
+       cursor - or, for a multikey index, earlier in the same one - is skipped before it ever
+       reaches the matcher.  that means remembering every DiskLoc visited, for as long as the
+       cursor lives - up to unionMaxSeenLocs of them.  past that a record is instead skipped if
+       an earlier clause's query matches it, which costs a fetch and a match per record.
+     */
+    unsigned unionMaxSeenLocs = 1000000;
+
+    class UnionCursor : public Cursor {
+    public:
+        UnionCursor( const vector< shared_ptr< Cursor > > &c, const vector< BSONObj > &clauses ) :
+            _c( c ), _clauses( clauses ), _matchers( clauses.size() ), _i() {
+            skipSeen();
+        }
+        virtual bool ok() {
+            return _i < _c.size();
+        }
+        virtual Record* _current() {
+            assert( ok() );
+            return _c[ _i ]->_current();
+        }
+        virtual BSONObj current() {
+            return BSONObj( _current() );
+        }
+        virtual DiskLoc currLoc() {
+            return ok() ? _c[ _i ]->currLoc() : DiskLoc();
+        }
+        virtual DiskLoc refLoc() {
+            return currLoc();
+        }
+        virtual bool advance() {
+            if ( !ok() )
+                return false;
+            _c[ _i ]->advance();
+            skipSeen();
+            return ok();
+        }
+        virtual void noteLocation() {
+            _noted = currLoc();
+            for( unsigned i = 0; i < _c.size(); ++i )
+                _c[ i ]->noteLocation();
+        }
+        virtual void checkLocation() {
+            for( unsigned i = 0; i < _c.size(); ++i )
+                _c[ i ]->checkLocation();
+            if ( ok() && !( _c[ _i ]->ok() && _c[ _i ]->currLoc() == _noted ) )
+                skipSeen();
+        }
+        virtual void aboutToDeleteBucket(const DiskLoc& b) {
+            for( unsigned i = 0; i < _c.size(); ++i )
+                _c[ i ]->aboutToDeleteBucket( b );
+        }
+        virtual bool supportGetMore() { return true; }
+        virtual bool getsetdup(DiskLoc loc) { return false; }
+        virtual string toString() {
+            string s = "UnionCursor(";
+            for( unsigned i = 0; i < _c.size(); ++i )
+                s += ( i ? ", " : " " ) + _c[ i ]->toString();
+            return s + " )";
+        }
+        virtual BSONObj prettyIndexBounds() const {
+            BSONArrayBuilder ba;
+            for( unsigned i = 0; i < _c.size(); ++i ) {
+                BSONObjIterator j( _c[ i ]->prettyIndexBounds() );
+                while( j.more() )
+                    ba.append( j.next() );
+            }
+            return ba.arr();
+        }
+    private:
+        void skipSeen() {
+            while( _i < _c.size() ) {
+                Cursor *c = _c[ _i ].get();
+                while( c->ok() && seen( c ) )
+                    c->advance();
+                if ( c->ok() )
+                    return;
+                ++_i;
+            }
+        }
+        bool seen( Cursor *c ) {
+            DiskLoc loc = c->currLoc();
+            if ( _seen.size() < unionMaxSeenLocs )
+                return !_seen.insert( loc ).second;
+            if ( _seen.count( loc ) || c->getsetdup( loc ) )
+                return true;
+            // whatever an earlier clause matches, that clause's cursor has returned
+            BSONObj o = c->current();
+            for( unsigned j = 0; j < _i; ++j ) {
+                if ( !_matchers[ j ] )
+                    _matchers[ j ].reset( new Matcher( _clauses[ j ] ) );
+                if ( _matchers[ j ]->matches( o ) )
+                    return true;
+            }
+            return false;
+        }
+        vector< shared_ptr< Cursor > > _c;
+        vector< BSONObj > _clauses; // the query of each cursor
+        vector< shared_ptr< Matcher > > _matchers; // of _clauses, made once _seen is full
+        unsigned _i;
+        set< DiskLoc > _seen;
+        DiskLoc _noted;
+    };
+
+    QueryPlan::QueryPlan( NamespaceDetails *_d, const FieldRangeSet &fbs, const BSONObj &order, const BSONElement &orClauses ) :
+    d(_d), idxNo(-1),
+    fbs_( fbs ),
+    order_( order ),
+    index_( 0 ),
+    optimal_( false ),
+    scanAndOrderRequired_( !order.isEmpty() ),
+    exactKeyMatch_( false ),
+    direction_( 0 ),
+    endKeyInclusive_( true ),
+    unhelpful_( false ),
+    _type(0),
+    _sortedIntersect( false ),
+    _unionPossible( false ){
+        if ( orClauses.type() != Array )
+            return;
+        BSONObjBuilder rest;
+        BSONObjIterator q( fbs.query() );
+        while( q.more() ) {
+            BSONElement e = q.next();
+            if ( strcmp( e.fieldName(), "$or" ) != 0 )
+                rest.append( e );
+        }
+        BSONObj restObj = rest.obj();
+
+        BSONObjIterator c( orClauses.embeddedObject() );
+        while( c.more() ) {
+            BSONElement clause = c.next();
+            if ( clause.type() != Object )
+                return;
+            BSONObjBuilder b;
+            b.appendElements( restObj );
+            b.appendElements( clause.embeddedObject() );
+            BSONObj clauseQuery = b.obj();
+            shared_ptr< FieldRangeSet > frs( new FieldRangeSet( fbs.ns(), clauseQuery ) );
+            _orRanges.push_back( frs );
+
+            if ( !frs->matchPossible() ) {
+                _or.push_back( shared_ptr< QueryPlan >( new QueryPlan( d, -1, *frs, _noOrder ) ) );
+                continue;
+            }
+
+            // no race within a clause: an optimal index, else the first one that helps
+            shared_ptr< QueryPlan > best;
+            for( int i = 0; i < d->nIndexes; ++i ) {
+                const IndexSpec& spec = d->idx( i ).getSpec();
+                if ( spec.getType() || !spec.usableFor( clauseQuery ) ||
+                     spec.suitability( clauseQuery, _noOrder ) == USELESS )
+                    continue;
+                shared_ptr< QueryPlan > p( new QueryPlan( d, i, *frs, _noOrder ) );
+                if ( p->unhelpful() )
+                    continue;
+                if ( !best || p->optimal() )
+                    best = p;
+                if ( p->optimal() )
+                    break;
+            }
+            if ( !best )
+                return;
+            _or.push_back( best );
+        }
+        _unionPossible = !_or.empty();
+    }
+
     auto_ptr< Cursor > QueryPlan::newCursor( const DiskLoc &startLoc , int numWanted ) const {
 
         if ( _type )
             return _type->newCursor( fbs_.query() , order_ , numWanted );
         
+        if ( !_or.empty() ) {
+            massert( 13112 , "newCursor() with start location not implemented for union plans", startLoc.isNull() );
+            vector< shared_ptr< Cursor > > c;
+            vector< BSONObj > clauses;
+            for( unsigned i = 0; i < _or.size(); ++i ) {
+                c.push_back( shared_ptr< Cursor >( _or[ i ]->newCursor().release() ) );
+                clauses.push_back( _orRanges[ i ]->query().getOwned() );
+            }
+            return auto_ptr< Cursor >( new UnionCursor( c, clauses ) );
+        }
+
+        if ( !_intersect.empty() ) {
+            massert( 13106 , "newCursor() with start location not implemented for intersection plans", startLoc.isNull() );
+            vector< shared_ptr< Cursor > > c, streams;
+            for( unsigned i = 0; i < _intersect.size(); ++i ) {
+                c.push_back( shared_ptr< Cursor >( _intersect[ i ]->newCursor().release() ) );
+                if ( !_sortedIntersect )
+                    streams.push_back( shared_ptr< Cursor >( _intersect[ i ]->newCursor().release() ) );
+            }
+            return auto_ptr< Cursor >( new IntersectCursor( c, streams, _sortedIntersect ) );
+        }
+
         if ( !fbs_.matchPossible() ){
             if ( fbs_.nNontrivialRanges() )
                 checkTableScanAllowed( fbs_.ns() );
@@ -194,6 +602,9 @@ namespace mongo {
 
         massert( 10363 ,  "newCursor() with start location not implemented for indexed plans", startLoc.isNull() );
         
+        if ( ranges_ )
+            return auto_ptr< Cursor >( new BtreeCursor( d, idxNo, *index_, indexBounds_, ranges_, direction_ >= 0 ? 1 : -1 ) );
+
         if ( indexBounds_.size() < 2 ) {
             // we are sure to spec endKeyInclusive_
             return auto_ptr< Cursor >( new BtreeCursor( d, idxNo, *index_, indexBounds_[ 0 ].first, indexBounds_[ 0 ].second, endKeyInclusive_, direction_ >= 0 ? 1 : -1 ) );
@@ -215,7 +626,41 @@ namespace mongo {
         return auto_ptr< Cursor >( 0 );
     }
     
+    double QueryPlan::nscannedEstimate() const {
+        scoped_lock lk(NamespaceDetailsTransient::_qcMutex);
+        return nscannedEstimate_inlock( NamespaceDetailsTransient::get_inlock( ns() ) );
+    }
+
+    double QueryPlan::nscannedEstimate_inlock( NamespaceDetailsTransient &nsd ) const {
+        if ( !d || !_intersect.empty() || !_or.empty() || !_special.empty() )
+            return -1;
+        if ( !fbs_.matchPossible() )
+            return 0;
+        if ( !index_ )
+            return d->nrecords;
+        shared_ptr< Histogram > h = nsd.histogram( index_->keyPattern() );
+        if ( !h || !h->current( d ) )
+            return -1;
+        return h->estimate( fbs_.range( index_->keyPattern().firstElement().fieldName() ) );
+    }
+
     BSONObj QueryPlan::indexKey() const {
+        if ( !_or.empty() ) {
+            BSONObjBuilder b;
+            BSONArrayBuilder a( b.subarrayStart( "$union" ) );
+            for( unsigned i = 0; i < _or.size(); ++i )
+                a.append( _or[ i ]->indexKey() );
+            a.done();
+            return b.obj();
+        }
+        if ( !_intersect.empty() ) {
+            BSONObjBuilder b;
+            BSONArrayBuilder a( b.subarrayStart( "$intersect" ) );
+            for( unsigned i = 0; i < _intersect.size(); ++i )
+                a.append( _intersect[ i ]->indexKey() );
+            a.done();
+            return b.obj();
+        }
         if ( !index_ )
             return BSON( "$natural" << 1 );
         return index_->keyPattern();
@@ -253,10 +698,14 @@ namespace mongo {
             // This reformats min_ and max_ to be used for index lookup.
             massert( 10365 ,  errmsg, indexDetailsForRange( fbs_.ns(), errmsg, min_, max_, keyPattern ) );
         }
+        uassert( 13111 , (string)"hinted index " + id.indexName() + " has a filter the query doesn't imply", id.getSpec().usableFor( query_ ) );
         NamespaceDetails *d = nsdetails(ns);
         plans_.push_back( PlanPtr( new QueryPlan( d, d->idxNo(id), fbs_, order_, min_, max_ ) ) );
     }
     
+    /* a recorded plan estimated to scan this many times what it did when recorded is raced again */
+    static const double SelectivityChange = 10;
+
     void QueryPlanSet::init() {
         DEBUGQO( "QueryPlanSet::init " << ns << "\t" << query_ );
         plans_.clear();
@@ -349,6 +798,7 @@ namespace mongo {
             uassert( 13038 , (string)"can't find special index: " + _special + " for: " + query_.toString() , 0 );
         }
 
+        bool recordedUnion = false;
         if ( honorRecordedPlan_ ) {
             scoped_lock lk(NamespaceDetailsTransient::_qcMutex);
             NamespaceDetailsTransient& nsd = NamespaceDetailsTransient::get_inlock( ns );
@@ -362,23 +812,105 @@ namespace mongo {
                     plans_.push_back( PlanPtr( new QueryPlan( d, -1, fbs_, order_ ) ) );
                     return;
                 }
-
-                NamespaceDetails::IndexIterator i = d->ii();
-                while( i.more() ) {
-                    int j = i.pos();
-                    IndexDetails& ii = i.next();
-                    if( ii.keyPattern().woCompare(bestIndex) == 0 ) {
-                        plans_.push_back( PlanPtr( new QueryPlan( d, j, fbs_, order_ ) ) );
+                /* the pattern doesn't capture values, so a filtered index recorded for one query
+                   may not hold all the matches of another - if so, make new plans. */
+                bool usable = true;
+                if ( !strcmp( bestIndex.firstElement().fieldName(), "$union" ) ) {
+                    // its clause plans look at index specs, which needs _qcMutex
+                    recordedUnion = true;
+                }
+                else if ( !strcmp( bestIndex.firstElement().fieldName(), "$intersect" ) ) {
+                    vector< int > idxNos;
+                    BSONObjIterator k( bestIndex.firstElement().embeddedObject() );
+                    while( k.more() ) {
+                        int j = d->findIndexByKeyPattern( k.next().embeddedObject() );
+                        massert( 13107 , "Unable to locate previously recorded index", j >= 0 );
+                        usable = usable && nsd.getIndexSpec( &d->idx( j ) ).usableFor( query_ );
+                        idxNos.push_back( j );
+                    }
+                    if ( usable ) {
+                        plans_.push_back( PlanPtr( new QueryPlan( d, idxNos, fbs_, order_ ) ) );
                         return;
                     }
                 }
-                massert( 10368 ,  "Unable to locate previously recorded index", false );
+                else {
+                    NamespaceDetails::IndexIterator i = d->ii();
+                    while( i.more() ) {
+                        int j = i.pos();
+                        IndexDetails& ii = i.next();
+                        if( ii.keyPattern().woCompare(bestIndex) == 0 ) {
+                            usable = nsd.getIndexSpec( &ii ).usableFor( query_ );
+                            if ( !usable )
+                                break;
+                            PlanPtr p( new QueryPlan( d, j, fbs_, order_ ) );
+                            /* the plan was recorded for values that scanned oldNScanned_.  if the
+                               histograms say these scan far more, race the plans again. */
+                            double estimate = p->nscannedEstimate_inlock( nsd );
+                            if ( estimate > SelectivityChange * max( oldNScanned_, 100LL ) ) {
+                                log(1) << "recorded plan " << bestIndex << " for " << query_ << " estimated to scan "
+                                       << estimate << " not " << oldNScanned_ << endl;
+                                usable = false;
+                                break;
+                            }
+                            plans_.push_back( p );
+                            return;
+                        }
+                    }
+                    massert( 10368 ,  "Unable to locate previously recorded index", !usable );
+                }
+                if ( !recordedUnion ) {
+                    usingPrerecordedPlan_ = false;
+                    mayRecordPlan_ = true;
+                    oldNScanned_ = 0;
+                }
             }
         }
         
+        if ( recordedUnion ) {
+            PlanPtr p( new QueryPlan( d, fbs_, order_, query_[ "$or" ] ) );
+            if ( p->unionPossible() ) {
+                plans_.push_back( p );
+                return;
+            }
+            usingPrerecordedPlan_ = false;
+            mayRecordPlan_ = true;
+            oldNScanned_ = 0;
+        }
+
         addOtherPlans( false );
     }
     
+    static const unsigned MaxIntersectIndexes = 3;
+    /* a plan estimated to scan this many times less than any other doesn't race them */
+    static const double DominantPlanFactor = 10;
+
+    /* with histograms for every candidate index, the plan the others can't come close to, if any */
+    QueryPlanSet::PlanPtr QueryPlanSet::dominantPlan( NamespaceDetails *d, const PlanSet &plans ) const {
+        if ( plans.empty() )
+            return PlanPtr();
+        scoped_lock lk(NamespaceDetailsTransient::_qcMutex);
+        NamespaceDetailsTransient &nsd = NamespaceDetailsTransient::get_inlock( fbs_.ns() );
+        PlanPtr best;
+        double bestEstimate = d->nrecords; // the table scan
+        double secondEstimate = bestEstimate;
+        for( PlanSet::const_iterator i = plans.begin(); i != plans.end(); ++i ) {
+            double e = (*i)->nscannedEstimate_inlock( nsd );
+            if ( e < 0 )
+                return PlanPtr();
+            if ( e < bestEstimate ) {
+                secondEstimate = bestEstimate;
+                bestEstimate = e;
+                best = *i;
+            }
+            else if ( e < secondEstimate ) {
+                secondEstimate = e;
+            }
+        }
+        if ( !best || bestEstimate * DominantPlanFactor >= secondEstimate )
+            return PlanPtr();
+        return best;
+    }
+
     void QueryPlanSet::addOtherPlans( bool checkFirst ) {
         const char *ns = fbs_.ns();
         NamespaceDetails *d = nsdetails( ns );
@@ -396,9 +928,13 @@ namespace mongo {
         bool normalQuery = hint_.isEmpty() && min_.isEmpty() && max_.isEmpty();
 
         PlanSet plans;
+        vector< int > intersect; // indexes with distinct, constrained first fields
+        set< string > intersectFields;
         for( int i = 0; i < d->nIndexes; ++i ) {
             IndexDetails& id = d->idx(i);
             const IndexSpec& spec = id.getSpec();
+            if ( !spec.usableFor( query_ ) )
+                continue;
             IndexSuitability suitability = HELPFUL;
             if ( normalQuery ){
                 suitability = spec.suitability( query_ , order_ );
@@ -412,11 +948,38 @@ namespace mongo {
                 return;
             } else if ( !p->unhelpful() ) {
                 plans.push_back( p );
+                const char *first = id.keyPattern().firstElement().fieldName();
+                if ( normalQuery && spec.getType() == 0 && !p->skipScan() &&
+                    fbs_.range( first ).nontrivial() && intersectFields.insert( first ).second )
+                    intersect.push_back( i );
             }
         }
+        if ( normalQuery && !checkFirst && order_.isEmpty() && query_[ "$or" ].eoo() ) {
+            PlanPtr best = dominantPlan( d, plans );
+            if ( best ) {
+                addPlan( best, checkFirst );
+                return;
+            }
+        }
+
         for( PlanSet::iterator i = plans.begin(); i != plans.end(); ++i )
             addPlan( *i, checkFirst );
 
+        /* when several fields are each selective on their own, fetching only the records all
+           their indexes agree on can beat any single index - let the race decide. */
+        if ( intersect.size() > 1 ) {
+            if ( intersect.size() > MaxIntersectIndexes )
+                intersect.resize( MaxIntersectIndexes );
+            addPlan( PlanPtr( new QueryPlan( d, intersect, fbs_, order_ ) ), checkFirst );
+        }
+
+        BSONElement orClauses = query_[ "$or" ];
+        if ( normalQuery && orClauses.type() == Array ) {
+            PlanPtr p( new QueryPlan( d, fbs_, order_, orClauses ) );
+            if ( p->unionPossible() )
+                addPlan( p, checkFirst );
+        }
+
         // Table scan plan
         addPlan( PlanPtr( new QueryPlan( d, -1, fbs_, order_ ) ), checkFirst );
     }
@@ -445,6 +1008,9 @@ namespace mongo {
             BSONObjBuilder explain;
             explain.append( "cursor", c->toString() );
             explain.appendArray( "indexBounds", c->prettyIndexBounds() );
+            double estimate = (*i)->nscannedEstimate();
+            if ( estimate >= 0 )
+                explain.append( "nscannedEstimate", estimate );
             arr.push_back( explain.obj() );
         }
         BSONObjBuilder b;
@@ -646,7 +1212,7 @@ namespace mongo {
             while( i.more() ) {
                 IndexDetails& ii = i.next();
                 if ( indexWorks( ii.keyPattern(), min.isEmpty() ? max : min, ret.first, ret.second ) ) {
-                    if ( ii.getSpec().getType() == 0 ){
+                    if ( ii.getSpec().getType() == 0 && ii.getSpec().filter().isEmpty() ){
                         id = &ii;
                         keyPattern = ii.keyPattern();
                         break;
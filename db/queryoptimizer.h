@@ -26,6 +26,11 @@ namespace mongo {
     
     class IndexDetails;
     class IndexType;
+    class NamespaceDetailsTransient;
+
+    /* DiskLocs a union plan remembers to skip records already returned; past that it matches
+       each record against the earlier $or clauses instead.  lowered by tests. */
+    extern unsigned unionMaxSeenLocs;
 
     class QueryPlan : boost::noncopyable {
     public:
@@ -37,6 +42,20 @@ namespace mongo {
                   const BSONObj &endKey = BSONObj() ,
                   string special="" );
 
+        /* intersection of the given indexes' plans: records are only fetched once every index
+           has produced their DiskLoc.  see IntersectCursor. */
+        QueryPlan(NamespaceDetails *_d,
+                  const vector< int > &idxNos,
+                  const FieldRangeSet &fbs,
+                  const BSONObj &order );
+
+        /* union of a plan per clause of the query's $or, each with its own index.  see
+           UnionCursor.  only worth using if unionPossible(). */
+        QueryPlan(NamespaceDetails *_d,
+                  const FieldRangeSet &fbs,
+                  const BSONObj &order,
+                  const BSONElement &orClauses );
+
         /* If true, no other index can do better. */
         bool optimal() const { return optimal_; }
         /* ScanAndOrder processing will be required if true */
@@ -58,6 +77,16 @@ namespace mongo {
         BSONObj simplifiedQuery( const BSONObj& fields = BSONObj() ) const { return fbs_.simplifiedQuery( fields ); }
         const FieldRange &range( const char *fieldName ) const { return fbs_.range( fieldName ); }
         void registerSelf( long long nScanned ) const;
+        /* true if the index is scanned with skips, see FieldRangeVector */
+        bool skipScan() const { return ranges_.get() != 0; }
+        bool intersect() const { return !_intersect.empty(); }
+        bool unionPlan() const { return !_or.empty(); }
+        /* true if every $or clause found an index that helps it */
+        bool unionPossible() const { return _unionPossible; }
+        /* about how many keys (records, for a table scan) this plan scans, from the histograms
+           the analyze command made.  -1 if there's no estimate.  _inlock: you're in the qcMutex */
+        double nscannedEstimate() const;
+        double nscannedEstimate_inlock( NamespaceDetailsTransient &nsd ) const;
         // just for testing
         BoundList indexBounds() const { return indexBounds_; }
     private:
@@ -71,10 +100,17 @@ namespace mongo {
         bool exactKeyMatch_;
         int direction_;
         BoundList indexBounds_;
+        shared_ptr< FieldRangeVector > ranges_;
         bool endKeyInclusive_;
         bool unhelpful_;
         string _special;
         IndexType * _type;
+        vector< boost::shared_ptr< QueryPlan > > _intersect;
+        bool _sortedIntersect; // each index scans a single key, so DiskLocs come back in order
+        BSONObj _noOrder; // the order for the _intersect and _or plans
+        vector< boost::shared_ptr< FieldRangeSet > > _orRanges; // one per $or clause
+        vector< boost::shared_ptr< QueryPlan > > _or;
+        bool _unionPossible;
     };
 
     // Inherit from this interface to implement a new query operation.
@@ -140,6 +176,7 @@ namespace mongo {
         PlanPtr getBestGuess() const;
     private:
         void addOtherPlans( bool checkFirst );
+        PlanPtr dominantPlan( NamespaceDetails *d, const PlanSet &plans ) const;
         void addPlan( PlanPtr plan, bool checkFirst ) {
             if ( checkFirst && plan->indexKey().woCompare( plans_[ 0 ]->indexKey() ) == 0 )
                 return;
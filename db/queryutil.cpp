@@ -657,6 +657,118 @@ namespace mongo {
         return ret;
     }
 
+    ////////////////////////
+    // FieldRangeVector //
+    ////////////////////////
+
+    FieldRangeVector::FieldRangeVector( const FieldRangeSet &frs , const BSONObj &keyPattern , int direction )
+        : _keyPattern( keyPattern.getOwned() ) {
+        BSONObjIterator i( _keyPattern );
+        while( i.more() ) {
+            BSONElement e = i.next();
+            int number = (int) e.number(); // returns 0.0 if not numeric
+            int dir = ( number >= 0 ? 1 : -1 ) * ( direction >= 0 ? 1 : -1 );
+            _dirs.push_back( dir );
+
+            const vector< FieldInterval > &fi = frs.range( e.fieldName() ).intervals();
+            vector< Interval > intervals;
+            for( unsigned j = 0; j < fi.size(); ++j ) {
+                const FieldInterval &f = dir > 0 ? fi[ j ] : fi[ fi.size() - 1 - j ];
+                const FieldBound &start = dir > 0 ? f.lower_ : f.upper_;
+                const FieldBound &end = dir > 0 ? f.upper_ : f.lower_;
+                Interval in;
+                BSONObjBuilder sb, eb;
+                sb.appendAs( start.bound_, "" );
+                eb.appendAs( end.bound_, "" );
+                in.start = sb.obj();
+                in.end = eb.obj();
+                in.startInclusive = start.inclusive_;
+                in.endInclusive = end.inclusive_;
+                intervals.push_back( in );
+            }
+            _intervals.push_back( intervals );
+        }
+    }
+
+    bool FieldRangeVector::useful( const FieldRangeSet &frs , const BSONObj &keyPattern ) {
+        bool seenNonEquality = false;
+        BSONObjIterator i( keyPattern );
+        while( i.more() ) {
+            const FieldRange &fr = frs.range( i.next().fieldName() );
+            if ( seenNonEquality && fr.nontrivial() )
+                return true;
+            if ( !fr.equality() )
+                seenNonEquality = true;
+        }
+        return false;
+    }
+
+    void FieldRangeVector::appendBeforeOrAfter( BSONObjBuilder &b , int i , bool after ) const {
+        if ( ( _dirs[ i ] > 0 ) == after )
+            b.appendMaxKey( "" );
+        else
+            b.appendMinKey( "" );
+    }
+
+    BSONObj FieldRangeVector::startKey() const {
+        BSONObjBuilder b;
+        for( unsigned i = 0; i < _intervals.size(); ++i ) {
+            if ( _intervals[ i ].empty() )
+                appendBeforeOrAfter( b, i, false );
+            else
+                b.appendAs( _intervals[ i ][ 0 ].start.firstElement(), "" );
+        }
+        return b.obj();
+    }
+
+    FieldRangeVector::CheckResult FieldRangeVector::check( const BSONObj &key , BSONObj &seek , bool &after ) const {
+        BSONObjBuilder prefix;
+        BSONObjIterator k( key );
+        for( unsigned i = 0; i < _intervals.size(); ++i ) {
+            BSONElement e = k.next();
+            const vector< Interval > &intervals = _intervals[ i ];
+            int dir = _dirs[ i ];
+
+            // the first interval not ending before e - binary search, as an $in may have thousands
+            unsigned j = 0;
+            unsigned h = intervals.size();
+            while( j < h ) {
+                unsigned m = ( j + h ) / 2;
+                int cmp = dir * e.woCompare( intervals[ m ].end.firstElement(), false );
+                if ( cmp < 0 || ( cmp == 0 && intervals[ m ].endInclusive ) )
+                    h = m;
+                else
+                    j = m + 1;
+            }
+
+            if ( j == intervals.size() ) {
+                // past all of this field's intervals: nothing more under the current prefix
+                if ( i == 0 )
+                    return Done;
+                for( unsigned x = i; x < _intervals.size(); ++x )
+                    appendBeforeOrAfter( prefix, x, true );
+                seek = prefix.obj();
+                after = true;
+                return Seek;
+            }
+
+            const Interval &in = intervals[ j ];
+            int cmp = dir * e.woCompare( in.start.firstElement(), false );
+            if ( cmp < 0 || ( cmp == 0 && !in.startInclusive ) ) {
+                // in the gap before interval j
+                prefix.appendAs( in.start.firstElement(), "" );
+                after = !in.startInclusive;
+                for( unsigned x = i + 1; x < _intervals.size(); ++x )
+                    appendBeforeOrAfter( prefix, x, after );
+                seek = prefix.obj();
+                return Seek;
+            }
+
+            prefix.appendAs( e, "" );
+        }
+        return InRange;
+    }
+
     ///////////////////
     // FieldMatcher //
     ///////////////////
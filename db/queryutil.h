@@ -184,6 +184,45 @@ namespace mongo {
         BSONObj query_;
     };
 
+    /* the intervals of each field of an index key, in the order a cursor walks the index.
+       used by BtreeCursor to scan an index with skips: each key is checked field by field, and 
+       when one is out of its intervals the cursor seeks ahead - to the start of the field's next 
+       interval, or past every key with the current prefix.  so a range on { b : 1 } in 
+       { a : 1 , b : 1 } only costs a seek per distinct value of a, instead of a full scan.
+    */
+    class FieldRangeVector {
+    public:
+        FieldRangeVector( const FieldRangeSet &frs , const BSONObj &keyPattern , int direction );
+
+        enum CheckResult {
+            InRange,
+            Seek,   // seek to the key given, which is after the current one
+            Done    // no later key can be in range
+        };
+
+        /* the first key that may be in range */
+        BSONObj startKey() const;
+
+        /* when Seek is returned, seek is set to the key to locate and after is set if the cursor
+           should be positioned after any keys equal to it (rather than before).
+        */
+        CheckResult check( const BSONObj &key , BSONObj &seek , bool &after ) const;
+
+        /* true if skipping can help: some field after the first one that isn't an equality is constrained */
+        static bool useful( const FieldRangeSet &frs , const BSONObj &keyPattern );
+
+    private:
+        struct Interval {
+            BSONObj start, end; // single, unnamed elements
+            bool startInclusive, endInclusive;
+        };
+        void appendBeforeOrAfter( BSONObjBuilder &b , int i , bool after ) const;
+
+        BSONObj _keyPattern;
+        vector< vector< Interval > > _intervals; // per key field, in scan order
+        vector< int > _dirs; // per key field: 1 if the scan sees its values in ascending order
+    };
+
     /**
        used for doing field limiting
      */
@@ -46,6 +46,8 @@
 #include "security.h"
 #include "cmdline.h"
 #include "repl_block.h"
+#include "repl_prefetch.h"
+#include "stats/counters.h"
 
 namespace mongo {
     
@@ -889,6 +891,8 @@ namespace mongo {
          { ts: ..., op: <optype>, ns: ..., o: <obj> , o2: <extraobj>, b: <boolflag> }
          ...
        see logOp() comments.
+
+       you must be in the write lock, and not nested: cloning a new database releases it.
     */
     void ReplSource::sync_pullOpLog_applyOperation(BSONObj& op, OpTime *localLogTail) {
         log( 6 ) << "processing op: " << op << endl;
@@ -913,8 +917,6 @@ namespace mongo {
         if ( !only.empty() && only != clientName )
             return;
 
-        dblock lk;
-
         if ( localLogTail && replPair && replPair->state == ReplPair::State_Master ) {
             updateSetsWithLocalOps( *localLogTail, true ); // allow unlocking
             updateSetsWithLocalOps( *localLogTail, false ); // don't allow unlocking or conversion to db backed storage
@@ -1112,6 +1114,11 @@ namespace mongo {
                0 ok, don't sleep
                1 ok, sleep
     */
+    /* ops applied per acquisition of the write lock, at most.  commands and ops waiting on
+       slavedelay end a batch early, as does reaching the end of what the master has sent.
+    */
+    const unsigned replApplyBatchMax = 1024;
+
     int ReplSource::sync_pullOpLog(int& nApplied) {
         int okResultCode = 1;
         string ns = string("local.oplog.$") + sourceName();
@@ -1195,6 +1202,7 @@ namespace mongo {
                 b.append("ns", *i + '.');
                 b.append("op", "db");
                 BSONObj op = b.done();
+                dblock lk;
                 sync_pullOpLog_applyOperation(op, 0);
             }
         }
@@ -1336,31 +1344,66 @@ namespace mongo {
 					n = 0;
 				}
 
-                BSONObj op = c->next();
-                BSONElement ts = op.getField("ts");
-                if( !( ts.type() == Date || ts.type() == Timestamp ) ) { 
-                    log() << "sync error: problem querying remote oplog record\n";
-                    log() << "op: " << op.toString() << '\n';
-                    log() << "halting replication" << endl;
-                    replInfo = replAllDead = "sync error: no ts found querying remote oplog record";
-                    throw SyncException();
-                }
-                OpTime last = nextOpTime;
-                nextOpTime = OpTime( ts.date() );
-                if ( !( last < nextOpTime ) ) {
-                    log() << "sync error: last applied optime at slave >= nextOpTime from master" << endl;
-                    log() << " last:       " << last.toStringLong() << '\n';
-                    log() << " nextOpTime: " << nextOpTime.toStringLong() << '\n';
-                    log() << " halting replication" << endl;
-                    replInfo = replAllDead = "sync error last >= nextOpTime";
-                    uassert( 10123 , "replication error last applied optime at slave >= nextOpTime from master", false);
+                /* a batch: the ops already read from the master, up to replApplyBatchMax of
+                   them.  a command is a batch by itself.
+                */
+                vector< BSONObj > ops;
+                bool delayed = false;
+                do {
+                    BSONObj op = c->next();
+                    BSONElement ts = op.getField("ts");
+                    if( !( ts.type() == Date || ts.type() == Timestamp ) ) { 
+                        log() << "sync error: problem querying remote oplog record\n";
+                        log() << "op: " << op.toString() << '\n';
+                        log() << "halting replication" << endl;
+                        replInfo = replAllDead = "sync error: no ts found querying remote oplog record";
+                        throw SyncException();
+                    }
+                    OpTime last = nextOpTime;
+                    OpTime next( ts.date() );
+                    if ( !( last < next ) ) {
+                        log() << "sync error: last applied optime at slave >= nextOpTime from master" << endl;
+                        log() << " last:       " << last.toStringLong() << '\n';
+                        log() << " nextOpTime: " << next.toStringLong() << '\n';
+                        log() << " halting replication" << endl;
+                        replInfo = replAllDead = "sync error last >= nextOpTime";
+                        uassert( 10123 , "replication error last applied optime at slave >= nextOpTime from master", false);
+                    }
+                    if ( replSettings.slavedelay && ( unsigned( time( 0 ) ) < next.getSecs() + replSettings.slavedelay ) ) {
+                        c->putBack( op );
+                        _sleepAdviceTime = next.getSecs() + replSettings.slavedelay + 1;
+                        delayed = true;
+                        break;
+                    }
+                    bool command = *op.getStringField( "op" ) == 'c';
+                    if ( command && !ops.empty() ) {
+                        c->putBack( op );
+                        break;
+                    }
+                    nextOpTime = next;
+                    ops.push_back( op );
+                    if ( command )
+                        break;
+                } while ( ops.size() < replApplyBatchMax && c->moreInCurrentBatch() );
+
+                if ( !ops.empty() ) {
+                    // fault in what the ops need before taking the write lock
+                    Timer pt;
+                    prefetchOps( ops );
+                    int prefetchMs = pt.millis();
+
+                    dblock lk;
+                    Timer t;
+                    for ( unsigned i = 0; i < ops.size(); i++ )
+                        sync_pullOpLog_applyOperation( ops[ i ], &localLogTail );
+                    n += ops.size();
+                    globalReplApplyCounters.batch( prefetchMs, t.millis(), ops.size(), (long long) time( 0 ) - nextOpTime.getSecs() );
                 }
-                if ( replSettings.slavedelay && ( unsigned( time( 0 ) ) < nextOpTime.getSecs() + replSettings.slavedelay ) ) {
-                    c->putBack( op );
-                    _sleepAdviceTime = nextOpTime.getSecs() + replSettings.slavedelay + 1;
+
+                if ( delayed ) {
                     dblock lk;
                     if ( n > 0 ) {
-                        syncedTo = last;
+                        syncedTo = nextOpTime;
                         save();
                     }
                     log() << "repl:   applied " << n << " operations" << endl;
@@ -1368,9 +1411,6 @@ namespace mongo {
                     log() << "waiting until: " << _sleepAdviceTime << " to continue" << endl;
                     break;
                 }
-
-                sync_pullOpLog_applyOperation(op, &localLogTail);
-                n++;
             }
         }
 
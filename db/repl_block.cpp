@@ -105,7 +105,16 @@ namespace mongo {
 
         void update( const BSONObj& rid , const string& host , const string& ns , OpTime last ){
             scoped_lock mylk(_mutex);
-            
+            _update( rid , host , ns , last );
+            // only waiters for an op this slave now has can be replicated enough
+            Waiters::iterator end = _waiters.upper_bound( last );
+            for ( Waiters::iterator i = _waiters.begin(); i != end; i++ ){
+                if ( _opReplicatedEnough( i->first , i->second->w ) )
+                    i->second->replicated.notify_one();
+            }
+        }
+
+        void _update( const BSONObj& rid , const string& host , const string& ns , OpTime last ){
             Ident ident(rid,host,ns);
             Info& i = _slaves[ ident ];
             if ( i.loc ){
@@ -134,10 +143,46 @@ namespace mongo {
         }
 
         bool opReplicatedEnough( OpTime op , int w ){
+            scoped_lock mylk(_mutex);
+            return _opReplicatedEnough( op , w );
+        }
+
+        bool waitForReplication( OpTime op , int w , int maxMillis ){
+            scoped_lock mylk(_mutex);
+            if ( _opReplicatedEnough( op , w ) )
+                return true;
+
+            Waiter me( w );
+            Waiters::iterator mine = _waiters.insert( pair<OpTime,Waiter*>( op , &me ) );
+            bool ok = true;
+            if ( maxMillis <= 0 ){
+                while ( ! _opReplicatedEnough( op , w ) )
+                    me.replicated.wait( mylk.boost() );
+            }
+            else {
+                boost::xtime deadline;
+                boost::xtime_get( &deadline , boost::TIME_UTC );
+                deadline.sec += maxMillis / 1000;
+                deadline.nsec += ( maxMillis % 1000 ) * 1000000;
+                if ( deadline.nsec >= 1000000000 ){
+                    deadline.sec++;
+                    deadline.nsec -= 1000000000;
+                }
+                while ( ! _opReplicatedEnough( op , w ) ){
+                    if ( ! me.replicated.timed_wait( mylk.boost() , deadline ) ){
+                        ok = _opReplicatedEnough( op , w );
+                        break;
+                    }
+                }
+            }
+            _waiters.erase( mine );
+            return ok;
+        }
+
+        bool _opReplicatedEnough( OpTime op , int w ){
             if ( w <= 1 )
                 return true;
             w--; // now this is the # of slaves i need
-            scoped_lock mylk(_mutex);
             for ( map<Ident,Info>::iterator i=_slaves.begin(); i!=_slaves.end(); i++){
                 OpTime s = *(i->second.loc);
                 if ( s < op ){
@@ -149,8 +194,17 @@ namespace mongo {
             return w <= 0;
         }
         
+        /* a getlasterror w waiting for its op to reach w-1 slaves */
+        struct Waiter {
+            Waiter( int _w ) : w( _w ){}
+            int w;
+            boost::condition replicated; // signalled, under _mutex, once it may be
+        };
+        typedef multimap<OpTime,Waiter*> Waiters;
+
         // need to be careful not to deadlock with this
         mongo::mutex _mutex;
+        Waiters _waiters; // by the op each waits for
         map<Ident,Info> _slaves;
         bool _dirty;
         bool _started;
@@ -176,6 +230,10 @@ namespace mongo {
         return slaveTracking.opReplicatedEnough( op , w );
     }
 
+    bool waitForReplication( OpTime op , int w , int maxMillis ){
+        return slaveTracking.waitForReplication( op , w , maxMillis );
+    }
+
     void resetSlaveCache(){
         slaveTracking.reset();
     }
@@ -30,5 +30,9 @@ namespace mongo {
     
     void updateSlaveLocation( CurOp& curop, const char * ns , OpTime lastOp );
     bool opReplicatedEnough( OpTime op , int w );
+    /* blocks until op is on w servers, this one included, or maxMillis pass (0 for no limit).
+       woken by updateSlaveLocation() rather than polling.
+       @return false if it timed out */
+    bool waitForReplication( OpTime op , int w , int maxMillis );
     void resetSlaveCache();
 }
@@ -0,0 +1,185 @@
+// repl_prefetch.cpp
+
+/**
+*    Copyright (C) 2008 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "repl_prefetch.h"
+#include "db.h"
+#include "client.h"
+#include "btree.h"
+#include "queryoptimizer.h"
+#include "../util/thread_pool.h"
+
+namespace mongo {
+
+    enum ReplPrefetch { PrefetchNone , PrefetchIdOnly , PrefetchAll };
+
+    static ReplPrefetch replPrefetch = PrefetchAll;
+
+    bool setReplPrefetch( const string& s ){
+        if ( s == "none" )
+            replPrefetch = PrefetchNone;
+        else if ( s == "_id_only" )
+            replPrefetch = PrefetchIdOnly;
+        else if ( s == "all" )
+            replPrefetch = PrefetchAll;
+        else
+            return false;
+        return true;
+    }
+
+    const char * replPrefetchName(){
+        switch ( replPrefetch ){
+        case PrefetchNone: return "none";
+        case PrefetchIdOnly: return "_id_only";
+        default: return "all";
+        }
+    }
+
+    /* below this many ops per thread the thread handoff costs more than the overlap saves */
+    static const unsigned PrefetchOpsPerThread = 32;
+    static const unsigned PrefetchMaxThreads = 8;
+
+    /* an op whose collection the slave has */
+    struct PrefetchTarget {
+        PrefetchTarget( const char *_ns , Database *_db , NamespaceDetails *_d , const BSONObj& _op )
+            : ns( _ns ) , db( _db ) , d( _d ) , op( _op ){}
+        string ns;
+        Database *db;
+        NamespaceDetails *d;
+        BSONObj op;
+    };
+
+    /* reads a byte of each page of [p, p+len) */
+    static void touch( const char *p , int len ){
+        volatile const char *v = p;
+        for ( int i = 0; i < len; i += 4096 )
+            v[ i ];
+        if ( len > 0 )
+            v[ len - 1 ];
+    }
+
+    /* the buckets from the root down to where key:loc is, or would go */
+    static void touchKey( const IndexDetails& idx , const BSONObj& key , const DiskLoc& loc ){
+        int pos;
+        bool found;
+        idx.head.btree()->locate( idx , idx.head , key , idx.keyPattern() , pos , found , loc );
+    }
+
+    static void touchKeys( NamespaceDetails *d , int idxNo , const BSONObj& obj , const DiskLoc& loc ){
+        IndexDetails& idx = d->idx( idxNo );
+        BSONObjSetDefaultOrder keys;
+        idx.getKeysFromObject( obj , keys );
+        for ( BSONObjSetDefaultOrder::iterator i = keys.begin(); i != keys.end(); ++i )
+            touchKey( idx , *i , loc );
+    }
+
+    /* what applying op (see ReplSource::applyOperation) will read */
+    static void prefetchOp( NamespaceDetails *d , const BSONObj& op ){
+        const char *opType = op.getStringField( "op" );
+        BSONObj o = op.getObjectField( "o" );
+        int idIdx = d->findIdIndex();
+
+        if ( *opType == 'i' ){
+            // an upsert on _id, then the new keys.  the record goes somewhere new
+            for ( int i = 0; i < d->nIndexes; i++ )
+                if ( i == idIdx || replPrefetch == PrefetchAll )
+                    touchKeys( d , i , o , minDiskLoc );
+            return;
+        }
+
+        BSONObj query = *opType == 'u' ? op.getObjectField( "o2" ) : o;
+        if ( idIdx < 0 || !isSimpleIdQuery( query ) )
+            return;
+        IndexDetails& id = d->idx( idIdx );
+        BSONObjBuilder b;
+        b.appendAs( query.firstElement() , "" );
+        DiskLoc loc = id.head.btree()->findSingle( id , id.head , b.obj() );
+        if ( loc.isNull() )
+            return;
+        Record *r = loc.rec();
+        touch( r->data , r->netLength() );
+
+        // the old keys an update may change and a delete removes
+        if ( replPrefetch == PrefetchAll ){
+            BSONObj obj( r );
+            for ( int i = 0; i < d->nIndexes; i++ )
+                if ( i != idIdx )
+                    touchKeys( d , i , obj , loc );
+        }
+    }
+
+    static void prefetchTargets( const vector< PrefetchTarget >& targets , unsigned from , unsigned step ){
+        for ( unsigned i = from; i < targets.size(); i += step ){
+            const PrefetchTarget& t = targets[ i ];
+            try {
+                Client::Context ctx( t.ns , t.db , false );
+                prefetchOp( t.d , t.op );
+            }
+            catch ( DBException& e ){
+                log() << "repl: prefetch caught exception " << e << " for op: " << t.op << endl;
+            }
+        }
+    }
+
+    /* workers have no lock of their own; prefetchOps() holds the read lock for them */
+    static void prefetchWorker( const vector< PrefetchTarget > *targets , unsigned from , unsigned step ){
+        Client::initThread( "replprefetch" );
+        prefetchTargets( *targets , from , step );
+        cc().shutdown();
+        currentClient.reset();
+    }
+
+    int prefetchOps( const vector< BSONObj >& ops ){
+        if ( replPrefetch == PrefetchNone || ops.empty() )
+            return 0;
+
+        readlock lk( "" );
+
+        vector< PrefetchTarget > targets;
+        for ( unsigned i = 0; i < ops.size(); i++ ){
+            const BSONObj& op = ops[ i ];
+            const char *opType = op.getStringField( "op" );
+            if ( !( ( *opType == 'i' || *opType == 'u' || *opType == 'd' ) && opType[ 1 ] == 0 ) )
+                continue;
+            const char *ns = op.getStringField( "ns" );
+            // no databases created here: the apply decides if a new one needs cloning
+            Database *db = dbHolder.get( ns , dbpath );
+            if ( !db )
+                continue;
+            Client::Context ctx( ns , db , false );
+            NamespaceDetails *d = nsdetails( ns );
+            if ( d )
+                targets.push_back( PrefetchTarget( ns , db , d , op ) );
+        }
+
+        unsigned nThreads = targets.size() / PrefetchOpsPerThread;
+        if ( nThreads > PrefetchMaxThreads )
+            nThreads = PrefetchMaxThreads;
+        if ( nThreads <= 1 ){
+            prefetchTargets( targets , 0 , 1 );
+        }
+        else {
+            ThreadPool pool( nThreads );
+            for ( unsigned i = 0; i < nThreads; i++ )
+                pool.schedule( prefetchWorker , &targets , i , nThreads );
+            pool.join();
+        }
+        return targets.size();
+    }
+
+}
@@ -0,0 +1,48 @@
+// repl_prefetch.h - reading ahead of a slave applying the master's ops
+
+/**
+*    Copyright (C) 2008 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* a slave applies a batch of the master's ops in one write lock (see
+   ReplSource::sync_pullOpLog), and mostly waits on page faults for the records and index
+   buckets they touch while it holds it.  prefetchOps() reads those pages first, in a read lock
+   and with several threads so the faults overlap, and the apply then finds them in memory.
+
+   what is read is set by --replPrefetch:
+     none      nothing
+     _id_only  the _id index path and the record of each update and delete
+     all       that, and the positions of the record's keys in the other indexes (the default)
+*/
+
+#pragma once
+
+#include "../stdafx.h"
+#include "jsobj.h"
+
+namespace mongo {
+
+    /* @return false if s isn't one of none, _id_only and all */
+    bool setReplPrefetch( const string& s );
+
+    /* the --replPrefetch setting, by name */
+    const char * replPrefetchName();
+
+    /* you must not be locked: takes a read lock for the ops' databases.  best effort - ops on
+       databases or collections the slave doesn't have yet are skipped, and errors only logged.
+       @return number of ops that had something read for them */
+    int prefetchOps( const vector< BSONObj >& ops );
+
+}
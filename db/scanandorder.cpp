@@ -0,0 +1,131 @@
+// scanandorder.cpp
+
+/**
+*    Copyright (C) 2008 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "pdfile.h"
+#include "queryutil.h"
+#include "scanandorder.h"
+#include "extsort.h"
+
+namespace mongo {
+
+    /* sort key data kept in memory before spilling to disk */
+    static const unsigned ScanAndOrderMemoryLimit = 16 * 1024 * 1024;
+
+    ScanAndOrder::ScanAndOrder(int _startFrom, int _limit, BSONObj _order) :
+        startFrom(_startFrom), order(_order), _seq(0), _n(0), approxSize(0), _haveObjs(false) {
+        limit = _limit > 0 ? _limit + startFrom : 0x7fffffff;
+        BSONObjBuilder b;
+        b.appendElements( order.pattern );
+        b.append( "$seq" , 1 );
+        _cmpOrder = b.obj();
+    }
+
+    ScanAndOrder::~ScanAndOrder() {
+    }
+
+    void ScanAndOrder::add(const BSONObj& o, const DiskLoc& loc) {
+        Item item;
+        {
+            BSONObjBuilder b;
+            b.appendElements( order.getKeyFromObject(o) );
+            b.append( "$seq" , _seq++ );
+            item.key = b.obj();
+        }
+        item.loc = loc;
+        if ( loc.isNull() ) {
+            item.obj = o.getOwned();
+            _haveObjs = true;
+        }
+
+        if ( _sorter.get() ) {
+            _sorter->add( item.key , item.loc );
+            // fill() stops at limit, so a bounded sort never has more than that
+            if ( !bounded() || _n < (unsigned long long) limit )
+                _n++;
+            return;
+        }
+
+        ItemCmp cmp( _cmpOrder );
+        if ( bounded() && _items.size() >= (unsigned) limit ) {
+            // full: replace the worst if this one is better
+            if ( !cmp( item , _items.front() ) )
+                return;
+            approxSize -= _items.front().key.objsize() + _items.front().obj.objsize();
+            pop_heap( _items.begin() , _items.end() , cmp );
+            _items.back() = item;
+        }
+        else {
+            _items.push_back( item );
+            _n++;
+        }
+        if ( bounded() )
+            push_heap( _items.begin() , _items.end() , cmp );
+
+        approxSize += item.key.objsize() + item.obj.objsize();
+        if ( approxSize > ScanAndOrderMemoryLimit ) {
+            uassert( 10128 ,  "too much key data for sort() with no index.  add an index or specify a smaller limit", !_haveObjs );
+            spill();
+        }
+    }
+
+    /* from here on everything goes straight to the external sorter, which keeps at most a
+       file's worth in memory.  a bounded sort loses its pruning, but fill() still stops at limit.
+    */
+    void ScanAndOrder::spill() {
+        log(1) << "scanandorder spilling " << _items.size() << " keys to disk" << endl;
+        _sorter.reset( new BSONObjExternalSorter( _cmpOrder ) );
+        for( vector< Item >::iterator i = _items.begin(); i != _items.end(); ++i )
+            _sorter->add( i->key , i->loc );
+        _items.clear();
+        approxSize = 0;
+    }
+
+    void ScanAndOrder::fillOne(BufBuilder& b, FieldMatcher *filter, BSONObj o, int& n, int& nFilled) {
+        n++;
+        if ( n <= startFrom )
+            return;
+        fillQueryResultFromObj(b, filter, o);
+        nFilled++;
+        uassert( 10129 ,  "too much data for sort() with no index", b.len() < 4000000 ); // appserver limit
+    }
+
+    void ScanAndOrder::fill(BufBuilder& b, FieldMatcher *filter, int& nout) {
+        int n = 0;
+        int nFilled = 0;
+        if ( _sorter.get() ) {
+            _sorter->sort();
+            auto_ptr<BSONObjExternalSorter::Iterator> i = _sorter->iterator();
+            while( i->more() && n < limit ) {
+                BSONObjExternalSorter::Data d = i->next();
+                fillOne( b, filter, d.second.obj(), n, nFilled );
+            }
+        }
+        else {
+            ItemCmp cmp( _cmpOrder );
+            if ( bounded() )
+                sort_heap( _items.begin() , _items.end() , cmp );
+            else
+                sort( _items.begin() , _items.end() , cmp );
+            for( vector< Item >::iterator i = _items.begin(); i != _items.end() && n < limit; ++i )
+                fillOne( b, filter, i->loc.isNull() ? i->obj : i->loc.obj(), n, nFilled );
+        }
+        nout = nFilled;
+    }
+
+} // namespace mongo
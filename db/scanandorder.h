@@ -44,12 +44,6 @@ namespace mongo {
         }
     };
 
-    /* todo:
-       _ respect limit
-       _ check for excess mem usage
-       _ response size limit from runquery; push it up a bit.
-    */
-
     inline void fillQueryResultFromObj(BufBuilder& bb, FieldMatcher *filter, BSONObj& js) {
         if ( filter ) {
             BSONObjBuilder b( bb );
@@ -72,78 +66,57 @@ namespace mongo {
         }
     }
     
-    typedef multimap<BSONObj,BSONObj,BSONObjCmp> BestMap;
-    class ScanAndOrder {
-        BestMap best; // key -> full object
-        int startFrom;
-        int limit;   // max to send back.
-        KeyType order;
-        unsigned approxSize;
+    class BSONObjExternalSorter;
 
-        void _add(BSONObj& k, BSONObj o) {
-            best.insert(make_pair(k,o));
-        }
-
-        void _addIfBetter(BSONObj& k, BSONObj o, BestMap::iterator i) {
-            const BSONObj& worstBestKey = i->first;
-            int c = worstBestKey.woCompare(k, order.pattern);
-            if ( c > 0 ) {
-                // k is better, 'upgrade'
-                best.erase(i);
-                _add(k, o);
-            }
-        }
+    /* the matches of a query with an unindexed sort.  only their sort keys and DiskLocs are kept
+       until fill(), which is when the objects are read - so the records must stay put meanwhile,
+       which they do as queries hold the read lock throughout.
 
+       with a limit only the best skip+limit are kept, in a heap.  otherwise once the keys take more
+       than ScanAndOrderMemoryLimit they spill to a BSONObjExternalSorter.
+    */
+    class ScanAndOrder : boost::noncopyable {
     public:
-        ScanAndOrder(int _startFrom, int _limit, BSONObj _order) :
-                best( BSONObjCmp( _order ) ),
-                startFrom(_startFrom), order(_order) {
-            limit = _limit > 0 ? _limit + startFrom : 0x7fffffff;
-            approxSize = 0;
-        }
+        ScanAndOrder(int _startFrom, int _limit, BSONObj _order);
+        ~ScanAndOrder();
 
-        int size() const {
-            return best.size();
-        }
+        /* number of objects that fill() can return, before the skip */
+        int size() const { return (int) _n; }
 
-        void add(BSONObj o) {
-            assert( o.isValid() );
-            BSONObj k = order.getKeyFromObject(o);
-            if ( (int) best.size() < limit ) {
-                approxSize += k.objsize();
-                uassert( 10128 ,  "too much key data for sort() with no index.  add an index or specify a smaller limit", approxSize < 1 * 1024 * 1024 );
-                _add(k, o);
-                return;
-            }
-            BestMap::iterator i;
-            assert( best.end() != best.begin() );
-            i = best.end();
-            i--;
-            _addIfBetter(k, o, i);
-        }
-
-        void _fill(BufBuilder& b, FieldMatcher *filter, int& nout, BestMap::iterator begin, BestMap::iterator end) {
-            int n = 0;
-            int nFilled = 0;
-            for ( BestMap::iterator i = begin; i != end; i++ ) {
-                n++;
-                if ( n <= startFrom )
-                    continue;
-                BSONObj& o = i->second;
-                fillQueryResultFromObj(b, filter, o);
-                nFilled++;
-                if ( nFilled >= limit )
-                    break;
-                uassert( 10129 ,  "too much data for sort() with no index", b.len() < 4000000 ); // appserver limit
-            }
-            nout = nFilled;
-        }
+        /* @param loc where o lives.  if null, o itself is kept (e.g. it's an index key) and the
+                      results can't spill.
+        */
+        void add(const BSONObj& o, const DiskLoc& loc);
 
         /* scanning complete. stick the query result in b for n objects. */
-        void fill(BufBuilder& b, FieldMatcher *filter, int& nout) {
-            _fill(b, filter, nout, best.begin(), best.end());
-        }
+        void fill(BufBuilder& b, FieldMatcher *filter, int& nout);
+
+    private:
+        struct Item {
+            BSONObj key; // sort key, then $seq
+            DiskLoc loc;
+            BSONObj obj; // if loc is null
+        };
+        struct ItemCmp {
+            ItemCmp( const BSONObj& order ) : cmp( order ) {}
+            bool operator()( const Item& l , const Item& r ) const { return cmp( l.key , r.key ); }
+            BSONObjCmp cmp;
+        };
+
+        void spill();
+        bool bounded() const { return limit != 0x7fffffff; }
+        void fillOne(BufBuilder& b, FieldMatcher *filter, BSONObj o, int& n, int& nFilled);
 
+        int startFrom;
+        int limit;   // max to send back, including the skipped ones
+        KeyType order;
+        BSONObj _cmpOrder; // order, then $seq so that equal keys stay in scan order
+        vector< Item > _items; // a heap, worst first, if bounded()
+        auto_ptr< BSONObjExternalSorter > _sorter;
+        long long _seq;
+        unsigned long long _n;
+        unsigned approxSize;
+        bool _haveObjs;
     };
 
 } // namespace mongo
@@ -125,7 +125,90 @@ namespace mongo {
     }
     
 
+    TTLCounters::TTLCounters()
+        : _passes(0)
+        , _deleted(0)
+        , _last_deleted(0)
+        , _last_lag(0)
+        , _last_time(0)
+        , _last()
+    {}
+
+    void TTLCounters::pass( int ms , long long deleted , long long lag ){
+        _passes++;
+        _deleted += deleted;
+        _last_deleted = deleted;
+        _last_lag = lag;
+        _last_time = ms;
+        _last = jsTime();
+    }
+
+    void TTLCounters::append( BSONObjBuilder& b ){
+        b.appendNumber( "passes" , _passes );
+        b.appendNumber( "deletedDocuments" , _deleted );
+        b.appendNumber( "last_deleted" , _last_deleted );
+        b.appendNumber( "last_lag_secs" , _last_lag );
+        b.appendNumber( "last_ms" , _last_time );
+        b.append( "last_finished" , _last );
+    }
+
+    ReplApplyCounters::ReplApplyCounters()
+        : _batches(0)
+        , _ops(0)
+        , _total_time(0)
+        , _prefetch_time(0)
+        , _last_size(0)
+        , _last_time(0)
+        , _last_prefetch_time(0)
+        , _last_lag(0)
+    {
+        for ( int i=0; i<NBuckets; i++ )
+            _sizes[i] = 0;
+    }
+
+    void ReplApplyCounters::batch( int prefetchMs , int ms , int n , long long lag ){
+        _batches++;
+        _ops += n;
+        _total_time += ms;
+        _prefetch_time += prefetchMs;
+        _last_size = n;
+        _last_time = ms;
+        _last_prefetch_time = prefetchMs;
+        _last_lag = lag;
+        int i = 0;
+        while ( i < NBuckets - 1 && ( n >> ( i + 1 ) ) )
+            i++;
+        _sizes[i]++;
+    }
+
+    void ReplApplyCounters::append( BSONObjBuilder& b ){
+        b.appendNumber( "batches" , _batches );
+        b.appendNumber( "ops" , _ops );
+        b.appendNumber( "total_ms" , _total_time );
+        b.appendNumber( "prefetch_ms" , _prefetch_time );
+        b.append( "average_batch" , _batches ? (double)_ops / _batches : 0 );
+        b.append( "ops_per_sec" , _total_time + _prefetch_time ? (double)_ops * 1000 / ( _total_time + _prefetch_time ) : 0 );
+        b.append( "lock_ms_per_op" , _ops ? (double)_total_time / _ops : 0 );
+        b.appendNumber( "last_batch" , _last_size );
+        b.appendNumber( "last_ms" , _last_time );
+        b.appendNumber( "last_prefetch_ms" , _last_prefetch_time );
+        b.appendNumber( "last_lag_secs" , _last_lag );
+        BSONObjBuilder sizes( b.subobjStart( "batchSizes" ) );
+        for ( int i=0; i<NBuckets; i++ ){
+            stringstream ss;
+            ss << ( 1 << i );
+            if ( i == NBuckets - 1 )
+                ss << '+';
+            else if ( i > 0 )
+                ss << '-' << ( ( 1 << ( i + 1 ) ) - 1 );
+            sizes.appendNumber( ss.str().c_str() , _sizes[i] );
+        }
+        sizes.done();
+    }
+
     OpCounters globalOpCounters;
     IndexCounters globalIndexCounters;
     FlushCounters globalFlushCounters;
+    TTLCounters globalTTLCounters;
+    ReplApplyCounters globalReplApplyCounters;
 }
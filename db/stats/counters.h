@@ -118,4 +118,52 @@ namespace mongo {
     };
 
     extern FlushCounters globalFlushCounters;
+
+    class TTLCounters {
+    public:
+        TTLCounters();
+
+        /* a pass of the ttl monitor over all ttl indexes
+           @param lag seconds the oldest expired document had been expired at the start of it */
+        void pass( int ms , long long deleted , long long lag );
+
+        void append( BSONObjBuilder& b );
+
+    private:
+        long long _passes;
+        long long _deleted;
+        long long _last_deleted;
+        long long _last_lag;
+        int _last_time;
+        Date_t _last;
+    };
+
+    extern TTLCounters globalTTLCounters;
+
+    class ReplApplyCounters {
+    public:
+        ReplApplyCounters();
+
+        /* a batch of ops a slave applied in one write lock
+           @param prefetchMs time reading ahead for it, before the lock (see repl_prefetch.h)
+           @param ms time in the lock
+           @param lag seconds its last op had been on the master when it was applied */
+        void batch( int prefetchMs , int ms , int n , long long lag );
+
+        void append( BSONObjBuilder& b );
+
+    private:
+        enum { NBuckets = 11 }; // batch sizes 1, 2-3, 4-7, ... 1024+
+        long long _batches;
+        long long _ops;
+        long long _total_time;
+        long long _prefetch_time;
+        long long _sizes[NBuckets];
+        int _last_size;
+        int _last_time;
+        int _last_prefetch_time;
+        long long _last_lag;
+    };
+
+    extern ReplApplyCounters globalReplApplyCounters;
 }
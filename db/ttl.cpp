@@ -0,0 +1,140 @@
+// ttl.cpp
+
+/**
+*    Copyright (C) 2008 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "ttl.h"
+#include "instance.h"
+#include "query.h"
+#include "replset.h"
+#include "cmdline.h"
+#include "stats/counters.h"
+#include "../client/dbclient.h"
+
+namespace mongo {
+
+    /* documents deleted per remove; the monitor sleeps after each as long as the remove took */
+    static const int TTLBatch = 500;
+
+    /* deletes ns's documents whose date in the index's field is before cutoff, oldest first.
+       @param lag set to the seconds the oldest of them has been expired
+       @return number deleted
+    */
+    static long long expire( DBDirectClient& db , const string& ns , const BSONObj& key , Date_t cutoff , long long& lag ){
+        const char *field = key.firstElement().fieldName();
+        BSONObj expired = BSON( field << BSON( "$lt" << Date_t( cutoff ) ) );
+        BSONObj fields = BSON( field << 1 );
+        Query byDate = Query( expired ).sort( fields ).hint( key );
+
+        lag = 0;
+        {
+            auto_ptr<DBClientCursor> c = db.query( ns , byDate , 1 , 0 , &fields );
+            if ( ! c->more() )
+                return 0;
+            Date_t oldest = c->next()[ field ].date();
+            if ( oldest < cutoff )
+                lag = (long long) ( cutoff - oldest ) / 1000;
+        }
+
+        long long n = 0;
+        while ( ! inShutdown() ){
+            /* a batch ends at the date TTLBatch documents in.  removing by that range rather
+               than by _id lets the remove walk the index */
+            BSONObj pattern = expired;
+            bool last = true;
+            {
+                auto_ptr<DBClientCursor> c = db.query( ns , byDate , 1 , TTLBatch - 1 , &fields );
+                if ( c->more() ){
+                    Date_t upTo = c->next()[ field ].date();
+                    pattern = BSON( field << BSON( "$lt" << Date_t( cutoff ) << "$lte" << upTo ) );
+                    last = false;
+                }
+            }
+
+            Timer t;
+            long long removed = 0;
+            {
+                writelock lk( ns );
+                Client::Context ctx( ns );
+                if ( ! isMasterNs( ns.c_str() ) )
+                    break;
+                removed = deleteObjects( ns.c_str() , pattern , false , true );
+            }
+            n += removed;
+            if ( last || removed == 0 )
+                break;
+            sleepmillis( t.millis() + 1 );
+        }
+        return n;
+    }
+
+    void TTLMonitor::run(){
+        Client::initThread( "TTLMonitor" );
+        DBDirectClient db;
+
+        while ( ! inShutdown() ){
+            sleepsecs( cmdLine.ttlMonitorSleepSecs );
+            if ( inShutdown() )
+                break;
+
+            try {
+                Timer t;
+                long long deleted = 0;
+                long long lag = 0;
+
+                vector< string > dbNames;
+                getDatabaseNames( dbNames );
+                for ( vector< string >::iterator i = dbNames.begin(); i != dbNames.end(); ++i ){
+                    if ( *i == "local" )
+                        continue;
+                    auto_ptr<DBClientCursor> c = db.query( *i + ".system.indexes" , BSON( "expireAfterSeconds" << BSON( "$exists" << true ) ) );
+                    vector< BSONObj > indexes;
+                    while ( c->more() )
+                        indexes.push_back( c->next().getOwned() );
+
+                    for ( unsigned j = 0; j < indexes.size(); j++ ){
+                        BSONObj key = indexes[j].getObjectField( "key" );
+                        BSONElement e = indexes[j][ "expireAfterSeconds" ];
+                        if ( ! e.isNumber() || key.nFields() != 1 )
+                            continue;
+                        Date_t cutoff = jsTime() - (Date_t) ( e.numberLong() * 1000 );
+                        long long l = 0;
+                        try {
+                            deleted += expire( db , indexes[j].getStringField( "ns" ) , key , cutoff , l );
+                        }
+                        catch ( DBException& e ){
+                            log() << "TTLMonitor: error expiring " << indexes[j].getStringField( "ns" ) << ' ' << e.what() << endl;
+                        }
+                        if ( l > lag )
+                            lag = l;
+                    }
+                }
+
+                globalTTLCounters.pass( t.millis() , deleted , lag );
+                log(1) << "TTLMonitor: deleted " << deleted << " in " << t.millis() << "ms" << endl;
+            }
+            catch ( std::exception& e ){
+                log() << "ERROR in TTLMonitor: " << e.what() << endl;
+            }
+        }
+
+        cc().shutdown();
+    }
+
+    TTLMonitor ttlMonitor;
+
+} // namespace mongo
@@ -0,0 +1,42 @@
+// ttl.h
+
+/**
+*    Copyright (C) 2008 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ttl collections.
+
+   an index on a single date field may be given an expiry:
+     db.foo.ensureIndex( { createdAt : 1 } , { expireAfterSeconds : 3600 } )
+   every --ttlMonitorSleepSecs the ttl monitor deletes the documents whose createdAt is more than
+   an hour ago, walking the index a range at a time.  the deletes are ordinary removes, so they
+   replicate, and only a master runs them.  progress is in serverStatus().ttl.
+*/
+
+#pragma once
+
+#include "../stdafx.h"
+#include "../util/background.h"
+
+namespace mongo {
+
+    class TTLMonitor : public BackgroundJob {
+    public:
+        void run();
+    };
+
+    extern TTLMonitor ttlMonitor;
+
+} // namespace mongo
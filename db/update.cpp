@@ -23,6 +23,7 @@
 #include "queryoptimizer.h"
 #include "repl.h"
 #include "update.h"
+#include "btree.h"
 
 //#define DEBUGUPDATE(x) cout << x << endl;
 #define DEBUGUPDATE(x)
@@ -438,6 +439,85 @@ namespace mongo {
         }
     }
 
+    bool ModSetState::enclosingObjects( const char *fieldName , const BSONElement& e , vector<int>& ofs , bool& parentIsArray ) const {
+        ofs.push_back( 0 );
+        parentIsArray = false;
+        BSONObj cur = _obj;
+        const char *p = fieldName;
+        while ( const char *dot = strchr( p , '.' ) ){
+            BSONElement x = cur.getField( string( p , dot - p ).c_str() );
+            if ( x.type() != Object && x.type() != Array )
+                return false;
+            parentIsArray = x.type() == Array;
+            cur = x.embeddedObject();
+            ofs.push_back( cur.objdata() - _obj.objdata() );
+            p = dot + 1;
+        }
+        return cur.getField( p ).rawdata() == e.rawdata();
+    }
+
+    /* one field applyModsWithPadding() replaces */
+    struct Splice {
+        ModState *ms;
+        int ofs;
+        vector<int> enclosing;
+        BSONObj repl; // holding the new element, or nothing for a removal
+        bool operator<( const Splice& other ) const { return ofs > other.ofs; } // last first
+    };
+
+    /* each mod's new element is built first, off to the side; only if they all fit is the object
+       touched.  fields are then replaced from the last in the buffer to the first, so moving the
+       bytes after one never moves a field or length still to be patched.
+    */
+    bool ModSetState::applyModsWithPadding( int room ) {
+        vector< Splice > splices;
+        for ( ModStateHolder::iterator i = _mods.begin(); i != _mods.end(); ++i ) {
+            ModState& ms = i->second;
+            if ( ms.old.eoo() ){
+                if ( ms.m->op == Mod::UNSET )
+                    continue;
+                return false; // a new field: let createNewFromMods() place it
+            }
+            Splice s;
+            s.ms = &ms;
+            s.ofs = ms.old.rawdata() - _obj.objdata();
+            bool parentIsArray;
+            if ( ! enclosingObjects( ms.fieldName() , ms.old , s.enclosing , parentIsArray ) )
+                return false;
+            if ( parentIsArray && ms.m->op == Mod::UNSET )
+                return false; // an $unset array element becomes null
+            splices.push_back( s );
+        }
+
+        int delta = 0;
+        for ( unsigned i = 0; i < splices.size(); i++ ){
+            BSONObjBuilder b;
+            splices[i].ms->apply( b , splices[i].ms->old );
+            splices[i].repl = b.obj();
+            delta += splices[i].repl.objsize() - 5 - splices[i].ms->old.size();
+        }
+        int size = _obj.objsize();
+        if ( delta > room || size + delta > 4 * 1024 * 1024 )
+            return false;
+
+        sort( splices.begin() , splices.end() );
+        char *base = const_cast< char * >( _obj.objdata() );
+        for ( unsigned i = 0; i < splices.size(); i++ ){
+            const Splice& s = splices[i];
+            int oldSize = s.ms->old.size();
+            int newSize = s.repl.objsize() - 5;
+            int d = newSize - oldSize;
+            if ( d )
+                memmove( base + s.ofs + newSize , base + s.ofs + oldSize , size - s.ofs - oldSize );
+            memcpy( base + s.ofs , s.repl.objdata() + 4 , newSize );
+            size += d;
+            for ( vector<int>::const_iterator j = s.enclosing.begin(); j != s.enclosing.end(); ++j )
+                *reinterpret_cast< int * >( base + *j ) += d;
+            s.ms->old = BSONElement(); // moved or gone
+        }
+        return true;
+    }
+
     void ModSet::extractFields( map< string, BSONElement > &fields, const BSONElement &top, const string &base ) {
         if ( top.type() != Object ) {
             fields[ base + top.fieldName() ] = top;
@@ -683,7 +763,9 @@ namespace mongo {
         virtual void init() {
             BSONObj pattern = qp().query();
             _c.reset( qp().newCursor().release() );
-            if ( ! _c->ok() )
+            bool ok = _c->ok();
+            _nscanned = _c->nscannedUpFront();
+            if ( ! ok )
                 setComplete();
             else
                 _matcher.reset( new CoveredIndexMatcher( pattern, qp().indexKey() ) );
@@ -717,6 +799,122 @@ namespace mongo {
         MatchDetails _details;
     };
 
+
+    /* applies mss to the document at loc: in place if the mods don't change its size, into the
+       record's padding if they fit there, otherwise by rewriting it.
+       @return where the document is now
+    */
+    static DiskLoc applyModsToRecord( const char *ns, NamespaceDetails *d, NamespaceDetailsTransient *nsdt, Record *r, const DiskLoc& loc,
+                                      ModSetState& mss, int modsIsIndexed, int profile, OpDebug& debug ) {
+        StringBuilder& ss = debug.str;
+        if ( modsIsIndexed <= 0 && mss.canApplyInPlace() ){
+            mss.applyModsInPlace();
+            nsdt->queueDocumentWritten( BSONObj( r ), loc );
+
+            if ( profile )
+                ss << " fastmod ";
+            return loc;
+        } 
+        
+        if ( modsIsIndexed <= 0 && mss.applyModsWithPadding( r->netLength() - BSONObj( r ).objsize() ) ){
+            // grew or shrank into the record's padding: no move, no index changes
+            nsdt->queueDocumentWritten( BSONObj( r ), loc );
+            if ( profile )
+                ss << " fastmodpadding ";
+            return loc;
+        }
+        
+        BSONObj newObj = mss.createNewFromMods();
+        uassert( 12522 , "$ operator made object too large" , newObj.objsize() <= ( 4 * 1024 * 1024 ) );
+        return theDataFileMgr.updateRecord(ns, d, nsdt, r, loc , newObj.objdata(), newObj.objsize(), debug);
+    }
+
+    /* logs a mod update of the document pattern picks out */
+    static void logModOp( const char *ns, ModSetState& mss, const BSONObj& updateobj, BSONObj pattern ) {
+        if ( mss.haveArrayDepMod() ) {
+            BSONObjBuilder patternBuilder;
+            patternBuilder.appendElements( pattern );
+            mss.appendSizeSpecForArrayDepMods( patternBuilder );
+            pattern = patternBuilder.obj();                        
+        }
+        
+        if ( mss.needOpLogRewrite() ){
+            DEBUGUPDATE( "\t rewrite update: " << mss.getOpLogRewrite() );
+            logOp("u", ns, mss.getOpLogRewrite() , &pattern );
+        }
+        else {
+            logOp("u", ns, updateobj, &pattern );
+        }
+    }
+
+    /* the upsert half of updateObjects(), once nothing matched patternOrig */
+    static UpdateResult upsertObject( const char *ns, const BSONObj& updateobj, const BSONObj& patternOrig, ModSet *mods, bool multi, bool logop, int profile, StringBuilder& ss ) {
+        if ( updateobj.firstElement().fieldName()[0] == '$' ) {
+            /* upsert of an $inc. build a default */
+            BSONObj newObj = mods->createNewFromQuery( patternOrig );
+            if ( profile )
+                ss << " fastmodinsert ";
+            theDataFileMgr.insert(ns, newObj);
+            if ( profile )
+                ss << " fastmodinsert ";
+            if ( logop )
+                logOp( "i", ns, newObj );
+            return UpdateResult( 0 , 1 , 1 );
+        }
+        uassert( 10159 ,  "multi update only works with $ operators" , ! multi );
+        checkNoMods( updateobj );
+        if ( profile )
+            ss << " upsert ";
+        BSONObj no = updateobj;
+        theDataFileMgr.insert(ns, no);
+        if ( logop )
+            logOp( "i", ns, no );
+        return UpdateResult( 0 , 0 , 1 );
+    }
+
+    /* { _id : <value> } updates: the _id index gives the one document there can be directly, with
+       no query plans, cursor or matcher.
+       @return false if the _id isn't there
+    */
+    static bool updateById( const char *ns, NamespaceDetails *d, NamespaceDetailsTransient *nsdt, int idIdxNo, const BSONObj& updateobj, const BSONObj& patternOrig,
+                            ModSet *mods, int modsIsIndexed, bool logop, int profile, OpDebug& debug, UpdateResult& result ) {
+        StringBuilder& ss = debug.str;
+        IndexDetails& idx = d->idx( idIdxNo );
+        DiskLoc loc = idx.head.btree()->findSingle( idx , idx.head , idx.getKeyFromQuery( patternOrig ) );
+        if ( profile )
+            ss << " idhack ";
+        if ( loc.isNull() )
+            return false;
+
+        Record *r = loc.rec();
+        BSONObj js( r );
+        BSONObj pattern = patternOrig;
+        if ( logop ) {
+            BSONElement id;
+            if ( js.getObjectID( id ) ) {
+                BSONObjBuilder idPattern;
+                idPattern.append( id );
+                pattern = idPattern.obj();
+            }
+        }
+
+        if ( mods ) {
+            auto_ptr<ModSetState> mss = mods->prepare( js );
+            applyModsToRecord( ns, d, nsdt, r, loc, *mss, modsIsIndexed, profile, debug );
+            if ( logop )
+                logModOp( ns, *mss, updateobj, pattern );
+            result = UpdateResult( 1 , 1 , 1 );
+            return true;
+        }
+
+        BSONElementManipulator::lookForTimestamps( updateobj );
+        checkNoMods( updateobj );
+        theDataFileMgr.updateRecord(ns, d, nsdt, r, loc , updateobj.objdata(), updateobj.objsize(), debug);
+        if ( logop )
+            logOp("u", ns, updateobj, &pattern );
+        result = UpdateResult( 1 , 0 , 1 );
+        return true;
+    }
     
     UpdateResult updateObjects(const char *ns, const BSONObj& updateobj, BSONObj patternOrig, bool upsert, bool multi, bool logop , OpDebug& debug ) {
         DEBUGUPDATE( "update: " << ns << " update: " << updateobj << " query: " << patternOrig << " upsert: " << upsert << " multi: " << multi );
@@ -744,7 +942,8 @@ namespace mongo {
         if ( isOperatorUpdate ){
             if( d && d->backgroundIndexBuildInProgress ) { 
                 set<string> bgKeys;
-                d->backgroundIdx().keyPattern().getFieldNames(bgKeys);
+                for ( int i = 0; i < d->backgroundIndexBuildInProgress; i++ )
+                    d->backgroundIdx(i).keyPattern().getFieldNames(bgKeys);
                 mods.reset( new ModSet(updateobj, nsdt->indexKeys(), &bgKeys) );
             }
             else {
@@ -753,6 +952,18 @@ namespace mongo {
             modsIsIndexed = mods->isIndexed();
         }
 
+        if ( d && ! multi && isSimpleIdQuery( patternOrig ) ) {
+            int idIdxNo = d->findIdIndex();
+            if ( idIdxNo >= 0 ) {
+                UpdateResult result( 0 , 0 , 0 );
+                if ( updateById( ns, d, nsdt, idIdxNo, updateobj, patternOrig, mods.get(), modsIsIndexed, logop, profile, debug, result ) )
+                    return result;
+                if ( upsert )
+                    return upsertObject( ns, updateobj, patternOrig, mods.get(), multi, logop, profile, ss );
+                return result;
+            }
+        }
+
         set<DiskLoc> seenObjects;
         
         QueryPlanSet qps( ns, patternOrig, BSONObj() );
@@ -824,44 +1035,15 @@ namespace mongo {
                      
                 auto_ptr<ModSetState> mss = useMods->prepare( onDisk );
                 
-                if ( modsIsIndexed <= 0 && mss->canApplyInPlace() ){
-                    mss->applyModsInPlace();// const_cast<BSONObj&>(onDisk) );
-
-                    if ( profile )
-                        ss << " fastmod ";
-                    
-                    if ( modsIsIndexed ){
-                        seenObjects.insert( loc );
-                    }
-                } 
-                else {
-                    BSONObj newObj = mss->createNewFromMods();
-                    uassert( 12522 , "$ operator made object too large" , newObj.objsize() <= ( 4 * 1024 * 1024 ) );
-                    DiskLoc newLoc = theDataFileMgr.updateRecord(ns, d, nsdt, r, loc , newObj.objdata(), newObj.objsize(), debug);
-                    if ( newLoc != loc || modsIsIndexed ) {
-                        // object moved, need to make sure we don' get again
-                        seenObjects.insert( newLoc );
-                    }
-                        
+                DiskLoc newLoc = applyModsToRecord( ns, d, nsdt, r, loc, *mss, modsIsIndexed, profile, debug );
+                if ( newLoc != loc || modsIsIndexed ) {
+                    // object moved, need to make sure we don' get again
+                    seenObjects.insert( newLoc );
                 }
                 
                 if ( logop ) {
                     DEV assert( mods->size() );
-
-                    if ( mss->haveArrayDepMod() ) {
-                        BSONObjBuilder patternBuilder;
-                        patternBuilder.appendElements( pattern );
-                        mss->appendSizeSpecForArrayDepMods( patternBuilder );
-                        pattern = patternBuilder.obj();                        
-                    }
-                    
-                    if ( mss->needOpLogRewrite() ){
-                        DEBUGUPDATE( "\t rewrite update: " << mss->getOpLogRewrite() );
-                        logOp("u", ns, mss->getOpLogRewrite() , &pattern );
-                    }
-                    else {
-                        logOp("u", ns, updateobj, &pattern );
-                    }
+                    logModOp( ns, *mss, updateobj, pattern );
                 }
                 numModded++;
                 if ( ! multi )
@@ -888,29 +1070,8 @@ namespace mongo {
         if ( profile )
             ss << " nscanned:" << u->nscanned();
         
-        if ( upsert ) {
-            if ( updateobj.firstElement().fieldName()[0] == '$' ) {
-                /* upsert of an $inc. build a default */
-                BSONObj newObj = mods->createNewFromQuery( patternOrig );
-                if ( profile )
-                    ss << " fastmodinsert ";
-                theDataFileMgr.insert(ns, newObj);
-                if ( profile )
-                    ss << " fastmodinsert ";
-                if ( logop )
-                    logOp( "i", ns, newObj );
-                return UpdateResult( 0 , 1 , 1 );
-            }
-            uassert( 10159 ,  "multi update only works with $ operators" , ! multi );
-            checkNoMods( updateobj );
-            if ( profile )
-                ss << " upsert ";
-            BSONObj no = updateobj;
-            theDataFileMgr.insert(ns, no);
-            if ( logop )
-                logOp( "i", ns, no );
-            return UpdateResult( 0 , 0 , 1 );
-        }
+        if ( upsert )
+            return upsertObject( ns, updateobj, patternOrig, mods.get(), multi, logop, profile, ss );
         return UpdateResult( 0 , 0 , 0 );
     }
     
@@ -435,6 +435,12 @@ namespace mongo {
         template< class Builder >
         void createNewFromMods( const string& root , Builder& b , const BSONObj &obj );
 
+        /**
+         * offsets in _obj of the objects enclosing e, the field named fieldName, outermost first
+         * @return false if e isn't where fieldName leads; parentIsArray set for e's parent
+         */
+        bool enclosingObjects( const char *fieldName , const BSONElement& e , vector<int>& ofs , bool& parentIsArray ) const;
+
         template< class Builder >
         void _appendNewFromMods( const string& root , ModState& m , Builder& b , set<string>& onedownseen );
         
@@ -495,6 +501,14 @@ namespace mongo {
          */
         void applyModsInPlace();
 
+        /**
+         * applies the mods to _obj's buffer even when they change the size of the fields, moving
+         * the bytes after each changed field and fixing up the lengths of the objects around it.
+         * @param room bytes free after _obj, i.e. the padding of its record
+         * @return false, with _obj unchanged, if a mod would add a field or the result doesn't fit
+         */
+        bool applyModsWithPadding( int room );
+
         BSONObj createNewFromMods();
 
         // re-writing for oplog
@@ -28,7 +28,7 @@ namespace BtreeTests {
 
     class Base {
     public:
-        Base() : 
+        Base( bool counted = false ) : 
             _context( ns() ) {
             
             {
@@ -39,6 +39,10 @@ namespace BtreeTests {
             BSONObjBuilder builder;
             builder.append( "ns", ns() );
             builder.append( "name", "testIndex" );
+            if ( counted ) {
+                builder.append( "key", BSON( "a" << 1 ) );
+                builder.appendBool( "counted", true );
+            }
             BSONObj bobj = builder.done();
             idx_.info =
                 theDataFileMgr.insert( ns(), bobj.objdata(), bobj.objsize() );
@@ -252,6 +256,55 @@ namespace BtreeTests {
         }        
     };
     
+    /* fullValidate() checks the subtree count of every bucket */
+    class CountedInsertDelete : public Base {
+    public:
+        CountedInsertDelete() : Base( true ) {}
+        void run() {
+            for ( int i = 0; i < 10000; ++i )
+                insert( i * 7 % 10000 );
+            checkValid( 10000 );
+            ASSERT_EQUALS( 2500, before( 2500, minDiskLoc ) );
+            ASSERT_EQUALS( 2501, before( 2500, maxDiskLoc ) );
+            ASSERT_EQUALS( 100, interval( 100, true, 200, false ) );
+            ASSERT_EQUALS( 100, interval( 100, false, 200, true ) );
+
+            for ( int i = 0; i < 10000; i += 2 )
+                unindex( i );
+            checkValid( 5000 );
+            ASSERT_EQUALS( 1250, before( 2500, maxDiskLoc ) );
+            ASSERT_EQUALS( 50, interval( 100, true, 200, true ) );
+
+            // reuses the unused keys left behind
+            for ( int i = 0; i < 10000; i += 2 )
+                insert( i );
+            checkValid( 10000 );
+            ASSERT_EQUALS( 101, interval( 100, true, 200, true ) );
+        }
+    private:
+        void insert( int i ) {
+            BSONObj k = BSON( "" << i );
+            Base::insert( k );
+        }
+        void unindex( int i ) {
+            BSONObj k = BSON( "" << i );
+            Base::unindex( k );
+        }
+        long long before( int i, const DiskLoc &loc ) {
+            return bt()->countBefore( id(), dl(), BSON( "" << i ), order(), loc );
+        }
+        long long interval( int lower, bool lowerInclusive, int upper, bool upperInclusive ) {
+            BSONObj l = BSON( "" << lower );
+            BSONObj u = BSON( "" << upper );
+            FieldInterval i;
+            i.lower_.bound_ = l.firstElement();
+            i.lower_.inclusive_ = lowerInclusive;
+            i.upper_.bound_ = u.firstElement();
+            i.upper_.inclusive_ = upperInclusive;
+            return BtreeBucket::countInterval( id(), i );
+        }
+    };
+
     class All : public Suite {
     public:
         All() : Suite( "btree" ){
@@ -265,6 +318,7 @@ namespace BtreeTests {
             add< MissingLocate >();
             add< MissingLocateMultiBucket >();
             add< SERVER983 >();
+            add< CountedInsertDelete >();
         }
     } myall;
 }
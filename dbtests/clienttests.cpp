@@ -154,6 +154,42 @@ namespace ClientTests {
         }
     };
     
+    /** one message of many objects takes the batched insert path, stopping at a duplicate */
+    class BatchInsert : public Base {
+    public:
+        BatchInsert() : Base( "batchinsert" ){}
+        void run(){
+            db.insert( ns() , BSON( "_id" << -1 << "u" << -1 ) );
+            db.ensureIndex( ns() , BSON( "u" << 1 ) , true );
+            db.ensureIndex( ns() , BSON( "m" << -1 ) );
+
+            vector< BSONObj > v;
+            for( int i = 0; i < 5000; ++i )
+                v.push_back( BSON( "_id" << ( i == 3000 ? 10 : i ) << "u" << i << "m" << BSON_ARRAY( i % 7 << i % 11 ) ) );
+            db.insert( ns() , v );
+            ASSERT( !db.getLastError().empty() );
+            ASSERT_EQUALS( 3001U , db.count( ns() ) );
+
+            // the same again without the duplicate, after what's there
+            v.clear();
+            for( int i = 3000; i < 5000; ++i )
+                v.push_back( BSON( "u" << i << "m" << BSON_ARRAY( i % 7 << i % 11 ) ) );
+            db.insert( ns() , v );
+            ASSERT( db.getLastError().empty() );
+            ASSERT_EQUALS( 5001U , db.count( ns() ) );
+
+            ASSERT_EQUALS( 5001 , db.query( ns() , Query().hint( BSON( "_id" << 1 ) ) )->itcount() );
+            ASSERT_EQUALS( 5001 , db.query( ns() , Query().hint( BSON( "u" << 1 ) ) )->itcount() );
+            ASSERT_EQUALS( 5000 , db.query( ns() , QUERY( "m" << GTE << 0 ).hint( BSON( "m" << -1 ) ) )->itcount() );
+            ASSERT_EQUALS( 1104 , db.query( ns() , QUERY( "m" << 3 ).hint( BSON( "m" << -1 ) ) )->itcount() );
+
+            BSONObj info;
+            ASSERT( db.runCommand( "test" , BSON( "validate" << "batchinsert" ) , info ) );
+            string result = info[ "result" ].str();
+            ASSERT( result.find( "exception" ) == string::npos && result.find( "corrupt" ) == string::npos );
+        }
+    };
+
     class All : public Suite {
     public:
         All() : Suite( "client" ){
@@ -166,6 +202,7 @@ namespace ClientTests {
             add<CS_10>();
             add<PushBack>();
             add<Create>();
+            add<BatchInsert>();
         }
         
     } all;
@@ -1184,6 +1184,37 @@ namespace JsobjTests {
             }
         };
 
+        class Merge {
+        public:
+            void run(){
+                const int total = 3000;
+                vector<BSONObjExternalSorter*> sorters;
+                for ( int j=0; j<3; j++ )
+                    sorters.push_back( new BSONObjExternalSorter( BSONObj() , 2000 ) );
+                for ( int i=0; i<total; i++ )
+                    sorters[ rand() % 3 ]->add( BSON( "x" << rand() % 1000 ) , 5 , i );
+                for ( int j=0; j<3; j++ )
+                    sorters[j]->sort();
+
+                {
+                    BSONObjExternalSorter::MergeIterator i( sorters );
+                    int num=0;
+                    double prev = 0;
+                    while ( i.more() ){
+                        pair<BSONObj,DiskLoc> p = i.next();
+                        num++;
+                        double cur = p.first["x"].number();
+                        ASSERT( cur >= prev );
+                        prev = cur;
+                    }
+                    ASSERT_EQUALS( total , num );
+                }
+
+                for ( int j=0; j<3; j++ )
+                    delete sorters[j];
+            }
+        };
+
         class D1 {
         public:
             void run(){
@@ -1562,6 +1593,7 @@ namespace JsobjTests {
             add< external_sort::ByDiskLock >();
             add< external_sort::Big1 >();
             add< external_sort::Big2 >();
+            add< external_sort::Merge >();
             add< external_sort::D1 >();
             add< CompatBSON >();
             add< CompareDottedFieldNamesTest >();
@@ -117,6 +117,76 @@ namespace MatcherTests {
     };
     
 
+    /** simple top level comparisons take the compiled path; results must not change */
+    class Compiled {
+    public:
+        void run() {
+            Matcher m( fromjson( "{a:{$gt:4,$lte:10},b:'x'}" ) );
+            ASSERT( m.matches( fromjson( "{b:'x',c:1,a:5}" ) ) );
+            ASSERT( m.matches( fromjson( "{a:10.0,b:'x'}" ) ) );
+            ASSERT( !m.matches( fromjson( "{a:4,b:'x'}" ) ) );
+            ASSERT( !m.matches( fromjson( "{a:5,b:'y'}" ) ) );
+            ASSERT( !m.matches( fromjson( "{a:'5',b:'x'}" ) ) );
+            ASSERT( !m.matches( fromjson( "{b:'x'}" ) ) );
+            // arrays fall back to the interpreter
+            ASSERT( m.matches( fromjson( "{a:[1,6],b:'x'}" ) ) );
+            ASSERT( m.matches( fromjson( "{a:5,b:['y','x']}" ) ) );
+            ASSERT( !m.matches( fromjson( "{a:[1,2],b:'x'}" ) ) );
+            // the first of duplicate fields is the one matched
+            ASSERT( m.matches( BSON( "a" << 5 << "b" << "x" << "a" << 0 ) ) );
+
+            Matcher n( fromjson( "{a:null,b:{$gte:null}}" ) );
+            ASSERT( n.matches( fromjson( "{}" ) ) );
+            ASSERT( n.matches( fromjson( "{a:null,b:null}" ) ) );
+            ASSERT( !n.matches( fromjson( "{a:1}" ) ) );
+
+            BSONObjBuilder b;
+            b.append( "a", numeric_limits< double >::quiet_NaN() );
+            Matcher nan( b.done() );
+            BSONObjBuilder c;
+            c.append( "a", numeric_limits< double >::quiet_NaN() );
+            ASSERT( nan.matches( c.done() ) );
+            ASSERT( !nan.matches( BSON( "a" << 1 ) ) );
+
+            Matcher l( BSON( "a" << LT << 5LL ) );
+            ASSERT( l.matches( BSON( "a" << 4 ) ) );
+            ASSERT( !l.matches( BSON( "a" << 5.0 ) ) );
+        }
+    };
+
+    /** $in values are hashed; values that compare equal must still be found */
+    class InHashed {
+    public:
+        void run() {
+            BSONObjBuilder b;
+            BSONArrayBuilder a( b.subarrayStart( "$in" ) );
+            for( int i = 1; i <= 100; ++i )
+                a.append( i * 2 );
+            a.append( 3.5 );
+            a.append( -0.0 );
+            a.append( numeric_limits< double >::quiet_NaN() );
+            a.append( "x" );
+            a.append( fromjson( "{b:1}" ) );
+            a.done();
+            Matcher m( BSON( "a" << b.obj() ) );
+            ASSERT( m.matches( BSON( "a" << 4 ) ) );
+            ASSERT( m.matches( BSON( "a" << 4.0 ) ) );
+            ASSERT( m.matches( BSON( "a" << 4LL ) ) );
+            ASSERT( !m.matches( BSON( "a" << 5 ) ) );
+            ASSERT( m.matches( BSON( "a" << 3.5 ) ) );
+            ASSERT( m.matches( BSON( "a" << 0 ) ) );
+            BSONObjBuilder nan;
+            nan.append( "a", numeric_limits< double >::quiet_NaN() );
+            ASSERT( m.matches( nan.done() ) );
+            ASSERT( m.matches( BSON( "a" << "x" ) ) );
+            ASSERT( !m.matches( BSON( "a" << "y" ) ) );
+            ASSERT( m.matches( fromjson( "{a:{b:1.0}}" ) ) );
+            ASSERT( !m.matches( fromjson( "{a:{b:2}}" ) ) );
+            ASSERT( m.matches( fromjson( "{a:[7,8]}" ) ) );
+            ASSERT( !m.matches( fromjson( "{}" ) ) );
+        }
+    };
+
     class All : public Suite {
     public:
         All() : Suite( "matcher" ){
@@ -130,6 +200,8 @@ namespace MatcherTests {
             add< MixedNumericIN >();
             add< Size >();
             add< MixedNumericEmbedded >();
+            add< Compiled >();
+            add< InHashed >();
         }
     } dball;
     
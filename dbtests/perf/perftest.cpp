@@ -24,9 +24,12 @@
 #include "../../db/query.h"
 #include "../../db/queryoptimizer.h"
 #include "../../util/file_allocator.h"
+#include "../../util/atomic_int.h"
 
 #include "../framework.h"
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
 
 namespace mongo {
     extern string dbpath;
@@ -166,6 +169,79 @@ namespace Insert {
         string ns_;
     };
 
+    class OneIndexRandom {
+    public:
+        OneIndexRandom() : ns_( testNs( this ) ) {
+            client_->ensureIndex( ns_, BSON( "a" << 1 ) );
+        }
+        void run() {
+            for( int i = 0; i < 100000; ++i )
+                client_->insert( ns_.c_str(), BSON( "a" << ( i * 7919 ) % 100000 ) );
+        }
+        string ns_;
+    };
+
+    // the cost of keeping subtree counts
+    class OneIndexRandomCounted {
+    public:
+        OneIndexRandomCounted() : ns_( testNs( this ) ) {
+            client_->insert( Namespace( ns_.c_str() ).getSisterNS( "system.indexes" ).c_str(),
+                             BSON( "ns" << ns_ << "key" << BSON( "a" << 1 ) << "name" << "a_1" << "counted" << true ) );
+        }
+        void run() {
+            for( int i = 0; i < 100000; ++i )
+                client_->insert( ns_.c_str(), BSON( "a" << ( i * 7919 ) % 100000 ) );
+        }
+        string ns_;
+    };
+
+    // 100000 documents sent 10000 to a message, with nIndexes indexes including _id's
+    class Batch {
+    public:
+        Batch( int nIndexes ) : nIndexes_( nIndexes ) {}
+        void setup( const string &ns ) {
+            ns_ = ns;
+            client_->createCollection( ns_ );
+            for( int i = 1; i < nIndexes_; ++i ) {
+                stringstream ss;
+                ss << "a" << i;
+                client_->ensureIndex( ns_, BSON( ss.str() << 1 ) );
+            }
+        }
+        void run() {
+            for( int j = 0; j < 10; ++j ) {
+                vector< BSONObj > batch;
+                for( int i = j * 10000; i < ( j + 1 ) * 10000; ++i ) {
+                    BSONObjBuilder b;
+                    for( int k = 1; k < 10; ++k ) {
+                        stringstream ss;
+                        ss << "a" << k;
+                        b.append( ss.str(), ( i * 7919 * k ) % 100000 );
+                    }
+                    batch.push_back( b.obj() );
+                }
+                client_->insert( ns_, batch );
+            }
+        }
+        int nIndexes_;
+        string ns_;
+    };
+
+    class BatchOneIndex : public Batch {
+    public:
+        BatchOneIndex() : Batch( 1 ) { setup( testNs( this ) ); }
+    };
+
+    class BatchThreeIndex : public Batch {
+    public:
+        BatchThreeIndex() : Batch( 3 ) { setup( testNs( this ) ); }
+    };
+
+    class BatchTenIndex : public Batch {
+    public:
+        BatchTenIndex() : Batch( 10 ) { setup( testNs( this ) ); }
+    };
+
     class All : public RunnerSuite {
     public:
         All() : RunnerSuite( "insert" ){}
@@ -177,6 +253,11 @@ namespace Insert {
             add< Capped >();
             add< OneIndexReverse >();
             add< OneIndexHighLow >();
+            add< OneIndexRandom >();
+            add< OneIndexRandomCounted >();
+            add< BatchOneIndex >();
+            add< BatchThreeIndex >();
+            add< BatchTenIndex >();
         }
     } all;
 } // namespace Insert
@@ -250,6 +331,34 @@ namespace Update {
         string ns_;
     };
 
+    // Inc, but the query isn't { _id : ... } so it goes through the query optimizer
+    class IncByField {
+    public:
+        IncByField() : ns_( testNs( this ) ) {
+            for( int i = 0; i < 10000; ++i )
+                client_->insert( ns_.c_str(), BSON( "_id" << i << "a" << i << "i" << 0 ) );
+            client_->ensureIndex( ns_, BSON( "a" << 1 ) );
+        }
+        void run() {
+            for( int j = 0; j < 10; ++j )
+                for( int i = 0; i < 10000; ++i )
+                    client_->update( ns_.c_str(), QUERY( "a" << i ), BSON( "$inc" << BSON( "i" << 1 ) ) );
+        }
+        string ns_;
+    };
+
+    class UpsertInc {
+    public:
+        UpsertInc() : ns_( testNs( this ) ) {}
+        void run() {
+            // the first pass inserts
+            for( int j = 0; j < 10; ++j )
+                for( int i = 0; i < 10000; ++i )
+                    client_->update( ns_.c_str(), QUERY( "_id" << i ), BSON( "$inc" << BSON( "i" << 1 ) ), true );
+        }
+        string ns_;
+    };
+
     class All : public RunnerSuite {
     public:
         All() : RunnerSuite( "update" ){}
@@ -259,6 +368,8 @@ namespace Update {
             add< Inc >();
             add< Set >();
             add< SetGrow >();
+            add< IncByField >();
+            add< UpsertInc >();
         }
     } all;
 } // namespace Update
@@ -343,6 +454,68 @@ namespace BSON {
 
 } // namespace BSON
 
+namespace Matching {
+
+    class Base {
+    public:
+        Base() {
+            for( int i = 0; i < 1000; ++i ) {
+                BSONObjBuilder b;
+                b.append( "_id", i );
+                b.append( "name", "aaaaaaaaaa" );
+                b.append( "a", i );
+                b.append( "x", i % 10 );
+                b.append( "b", i * 0.5 );
+                b.append( "s", i % 2 ? "red" : "blue" );
+                objs_.push_back( b.obj() );
+            }
+        }
+        void runMatcher( const BSONObj &query, unsigned expected ) {
+            Matcher m( query );
+            for( int j = 0; j < 100; ++j ) {
+                unsigned n = 0;
+                for( vector< BSONObj >::const_iterator i = objs_.begin(); i != objs_.end(); ++i )
+                    if ( m.matches( *i ) )
+                        ++n;
+                ASSERT_EQUALS( expected, n );
+            }
+        }
+        vector< BSONObj > objs_;
+    };
+
+    class Equality : public Base {
+    public:
+        void run() { runMatcher( BSON( "x" << 3 ), 100 ); }
+    };
+
+    class Range : public Base {
+    public:
+        void run() { runMatcher( BSON( "a" << GTE << 100 << LT << 600 ), 500 ); }
+    };
+
+    class ThreeFields : public Base {
+    public:
+        void run() { runMatcher( BSON( "s" << "red" << "b" << GT << 100 << "x" << LTE << 4 ), 160 ); }
+    };
+
+    class Missing : public Base {
+    public:
+        void run() { runMatcher( BSON( "a" << GTE << 0 << "z" << 1 ), 0 ); }
+    };
+
+    class All : public RunnerSuite {
+    public:
+        All() : RunnerSuite( "matcher" ){}
+        void setupTests(){
+            add< Equality >();
+            add< Range >();
+            add< ThreeFields >();
+            add< Missing >();
+        }
+    } all;
+
+} // namespace Matching
+
 namespace Index {
 
     class Int {
@@ -489,6 +662,48 @@ namespace QueryTests {
         string ns_;
     };
 
+    // unindexed sorts: the best few of many large objects
+    class SortTopK {
+    public:
+        SortTopK() : ns_( testNs( this ) ) {
+            string pad( 1000, 'x' );
+            for( int i = 0; i < 100000; ++i )
+                client_->insert( ns_.c_str(), BSON( "a" << ( i * 7919 ) % 100000 << "pad" << pad ) );
+        }
+        void run() {
+            for( int j = 0; j < 5; ++j ) {
+                auto_ptr< DBClientCursor > c =
+                client_->query( ns_.c_str(), Query( BSONObj() ).sort( BSON( "a" << 1 ) ), 10, 100 );
+                int i = 0;
+                for( ; c->more(); c->nextSafe(), ++i );
+                ASSERT_EQUALS( 10, i );
+            }
+        }
+        string ns_;
+    };
+
+    // unbounded, with more sort key data than is kept in memory
+    class SortSpill {
+    public:
+        SortSpill() : ns_( testNs( this ) ) {
+            string key( 100, 'k' );
+            for( int i = 0; i < 200000; ++i ) {
+                stringstream ss;
+                ss << ( i * 7919 ) % 200000;
+                client_->insert( ns_.c_str(), BSON( "a" << key + ss.str() << "b" << i ) );
+            }
+        }
+        void run() {
+            BSONObj fields = BSON( "b" << 1 << "_id" << 0 );
+            auto_ptr< DBClientCursor > c =
+            client_->query( ns_.c_str(), Query( BSON( "b" << LT << 150000 ) ).sort( BSON( "a" << 1 ) ), 0, 0, &fields );
+            int i = 0;
+            for( ; c->more(); c->nextSafe(), ++i );
+            ASSERT_EQUALS( 150000, i );
+        }
+        string ns_;
+    };
+
     class GetMore {
     public:
         GetMore() : ns_( testNs( this ) ) {
@@ -539,6 +754,64 @@ namespace QueryTests {
         auto_ptr< DBClientCursor > c_;
     };
 
+    // { _id : { $in : [ n values ] } }, one in every 200000 / n documents; or the same on an
+    // unindexed field
+    class In {
+    public:
+        In( int n, bool indexed ) : n_( n ), indexed_( indexed ) {}
+        void setup( const string &ns ) {
+            ns_ = ns;
+            for( int i = 0; i < 200000; ++i )
+                client_->insert( ns_.c_str(), BSON( "_id" << i << "a" << i ) );
+            BSONObjBuilder b;
+            BSONArrayBuilder a( b.subarrayStart( "$in" ) );
+            for( int i = 0; i < n_; ++i )
+                a.append( i * ( 200000 / n_ ) );
+            a.done();
+            query_ = BSON( ( indexed_ ? "_id" : "a" ) << b.obj() );
+        }
+        void run() {
+            auto_ptr< DBClientCursor > c = client_->query( ns_.c_str(), Query( query_ ) );
+            int i = 0;
+            for( ; c->more(); c->nextSafe(), ++i );
+            ASSERT_EQUALS( n_, i );
+        }
+        string ns_;
+        int n_;
+        bool indexed_;
+        BSONObj query_;
+    };
+
+    class In1k : public In {
+    public:
+        In1k() : In( 1000, true ) { setup( testNs( this ) ); }
+    };
+
+    class In10k : public In {
+    public:
+        In10k() : In( 10000, true ) { setup( testNs( this ) ); }
+    };
+
+    class In100k : public In {
+    public:
+        In100k() : In( 100000, true ) { setup( testNs( this ) ); }
+    };
+
+    class InUnindexed1k : public In {
+    public:
+        InUnindexed1k() : In( 1000, false ) { setup( testNs( this ) ); }
+    };
+
+    class InUnindexed10k : public In {
+    public:
+        InUnindexed10k() : In( 10000, false ) { setup( testNs( this ) ); }
+    };
+
+    class InUnindexed100k : public In {
+    public:
+        InUnindexed100k() : In( 100000, false ) { setup( testNs( this ) ); }
+    };
+
     class All : public RunnerSuite {
     public:
         All() : RunnerSuite( "query" ){}
@@ -548,9 +821,17 @@ namespace QueryTests {
             add< NoMatchLong >();
             add< SortOrdered >();
             add< SortReverse >();
+            add< SortTopK >();
+            add< SortSpill >();
             add< GetMore >();
             add< GetMoreIndex >();
             add< GetMoreKeyMatchHelps >();
+            add< In1k >();
+            add< In10k >();
+            add< In100k >();
+            add< InUnindexed1k >();
+            add< InUnindexed10k >();
+            add< InUnindexed100k >();
         }
     } all;
 
@@ -600,6 +881,35 @@ namespace Count {
         string ns_;
     };
 
+    class CountRange {
+    public:
+        CountRange() : ns_( testNs( this ) ) {
+            for( int i = 0; i < 100000; ++i )
+                client_->insert( ns_, BSON( "a" << i ) );
+            client_->ensureIndex( ns_, BSON( "a" << 1 ) );
+        }
+        void run() {
+            for( int i = 0; i < 10; ++i )
+                ASSERT_EQUALS( 80000U, client_->count( ns_, BSON( "a" << GTE << 10000 << LT << 90000 ) ) );
+        }
+        string ns_;
+    };
+
+    class CountRangeCounted {
+    public:
+        CountRangeCounted() : ns_( testNs( this ) ) {
+            for( int i = 0; i < 100000; ++i )
+                client_->insert( ns_, BSON( "a" << i ) );
+            client_->insert( Namespace( ns_.c_str() ).getSisterNS( "system.indexes" ).c_str(),
+                             BSON( "ns" << ns_ << "key" << BSON( "a" << 1 ) << "name" << "a_1" << "counted" << true ) );
+        }
+        void run() {
+            for( int i = 0; i < 10; ++i )
+                ASSERT_EQUALS( 80000U, client_->count( ns_, BSON( "a" << GTE << 10000 << LT << 90000 ) ) );
+        }
+        string ns_;
+    };
+
     class All : public RunnerSuite {
     public:
         All() : RunnerSuite( "count" ){}
@@ -607,6 +917,8 @@ namespace Count {
             add< Count >();
             add< CountIndex >();
             add< CountSimpleIndex >();
+            add< CountRange >();
+            add< CountRangeCounted >();
         }
     } all;
 
@@ -687,6 +999,80 @@ namespace Plan {
 
 } // namespace Plan
 
+namespace Queue {
+
+    /* producers insert jobs at mixed priorities while consumers take the highest priority
+       ready one with findandmodify, each on its own thread and connection.
+    */
+    class Base {
+    public:
+        Base( const string &ns ) : ns_( ns ) {
+            client_->ensureIndex( ns_, BSON( "priority" << -1 ) );
+        }
+        virtual ~Base() {}
+        void run() {
+            boost::thread_group threads;
+            for( int i = 0; i < nProducers; ++i )
+                threads.create_thread( boost::bind( &Base::produce, this, i ) );
+            for( int i = 0; i < nConsumers; ++i )
+                threads.create_thread( boost::bind( &Base::consume, this ) );
+            threads.join_all();
+            ASSERT_EQUALS( (unsigned long long)( nProducers * nJobs ), client_->count( ns_, BSON( "state" << "done" ) ) );
+        }
+    protected:
+        virtual bool queue() const = 0;
+    private:
+        enum { nProducers = 4, nConsumers = 4, nJobs = 5000 };
+        void produce( int p ) {
+            Client::initThread( "perftest producer" );
+            DBDirectClient c;
+            for( int i = 0; i < nJobs; ++i )
+                c.insert( ns_, BSON( "priority" << ( i * 7 + p ) % 100 << "state" << "ready" ) );
+            cc().shutdown();
+        }
+        void consume() {
+            Client::initThread( "perftest consumer" );
+            DBDirectClient c;
+            BSONObj cmd = BSON( "findandmodify" << ns_.substr( ns_.find( '.' ) + 1 ) <<
+                                "query" << BSON( "state" << "ready" ) <<
+                                "sort" << BSON( "priority" << -1 ) <<
+                                "update" << BSON( "$set" << BSON( "state" << "done" ) ) <<
+                                "queue" << queue() );
+            string db = nsToDatabase( ns_.c_str() );
+            while( taken_ < (unsigned) ( nProducers * nJobs ) ) {
+                BSONObj info;
+                if ( c.runCommand( db, cmd, info ) )
+                    ++taken_;
+            }
+            cc().shutdown();
+        }
+        string ns_;
+        AtomicUInt taken_;
+    };
+
+    class Ordinary : public Base {
+    public:
+        Ordinary() : Base( testNs( this ) ) {}
+        virtual bool queue() const { return false; }
+    };
+
+    class Resume : public Base {
+    public:
+        Resume() : Base( testNs( this ) ) {}
+        virtual bool queue() const { return true; }
+    };
+
+    class All : public RunnerSuite {
+    public:
+        All() : RunnerSuite( "queue" ){}
+        void setupTests(){
+            add< Ordinary >();
+            add< Resume >();
+        }
+    } all;
+
+} // namespace Queue
+
 int main( int argc, char **argv ) {
     logLevel = -1;
     client_ = new DBDirectClient();
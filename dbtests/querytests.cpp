@@ -19,6 +19,7 @@
 
 #include "stdafx.h"
 #include "../db/query.h"
+#include "../db/queryoptimizer.h"
 
 #include "../db/db.h"
 #include "../db/instance.h"
@@ -1001,6 +1002,47 @@ namespace QueryTests {
         int _old;
     };
 
+    class UnionPastSeenLimit : public CollectionBase {
+    public:
+        UnionPastSeenLimit() : CollectionBase( "unionpastseenlimit" ), _old( unionMaxSeenLocs ) {
+            unionMaxSeenLocs = 10;
+        }
+        ~UnionPastSeenLimit() {
+            unionMaxSeenLocs = _old;
+        }
+        void run() {
+            for( int i = 0; i < 1000; ++i )
+                client().insert( ns(), BSON( "a" << i << "b" << i - 15 << "c" << BSON_ARRAY( i % 3 << 10 + i % 3 ) ) );
+            client().ensureIndex( ns(), BSON( "a" << 1 ) );
+            client().ensureIndex( ns(), BSON( "b" << 1 ) );
+            client().ensureIndex( ns(), BSON( "c" << 1 ) );
+
+            // records of the first clause, all again in the second
+            check( fromjson( "{$or:[{a:{$lt:30}},{b:{$lt:30}}]}" ), 45 );
+            // and a multikey clause, reaching each record twice
+            check( fromjson( "{$or:[{a:{$lt:30}},{c:{$in:[1,11]}}]}" ), 353 );
+        }
+    private:
+        void check( const BSONObj &q, int n ) {
+            BSONObj e = client().findOne( ns(), Query( q ).explain() );
+            ASSERT( string( e.getStringField( "cursor" ) ).find( "UnionCursor" ) == 0 );
+            // the limit is passed during the getMore
+            auto_ptr< DBClientCursor > c = client().query( ns(), q, 7 );
+            int got = 0;
+            for( ; c->moreInCurrentBatch(); c->next() )
+                ++got;
+            ASSERT_EQUALS( 7, got );
+            long long cursorId = c->getCursorId();
+            c->decouple();
+            c.reset();
+            c = client().getMore( ns(), cursorId );
+            got += c->itcount();
+            ASSERT_EQUALS( n, got );
+            ASSERT_EQUALS( (unsigned long long) n, client().count( ns(), q ) );
+        }
+        unsigned _old;
+    };
+
     class WhatsMyUri : public CollectionBase {
     public:
         WhatsMyUri() : CollectionBase( "whatsmyuri" ) {}
@@ -1096,6 +1138,7 @@ namespace QueryTests {
             add< HelperByIdTest >();
             add< FindingStart >();
             add< WhatsMyUri >();
+            add< UnionPastSeenLimit >();
             
             add< parsedtests::basic1 >();
             
@@ -759,6 +759,68 @@ namespace UpdateTests {
             }
         };
 
+        /* after the first few moves the record has padding, and the rest grow into it */
+        class growInPadding : public Base {
+            const char * ns(){
+                return "unittests.growinpadding";
+            }
+            void dotest(){
+                client().insert( ns() , fromjson( "{_id:1,a:[],s:'',n:1,o:{p:{q:1},r:[]},z:'end'}" ) );
+                string str;
+                for ( int i = 0; i < 100; i++ ){
+                    client().update( ns() , BSON( "_id" << 1 ) , BSON( "$push" << BSON( "a" << i << "o.r" << i ) <<
+                                                                       "$set" << BSON( "s" << ( str += "x" ) ) ) );
+                }
+                client().update( ns() , BSON( "_id" << 1 ) , BSON( "$inc" << BSON( "n" << 0.5 << "o.p.q" << 1LL ) ) );
+                client().update( ns() , BSON( "_id" << 1 ) , fromjson( "{$set:{'a.0':'zero'},$pop:{'o.r':1}}" ) );
+
+                BSONObj out = client().findOne( ns() , BSONObj() );
+                ASSERT_EQUALS( "zero" , out[ "a" ].embeddedObject()[ "0" ].str() );
+                ASSERT_EQUALS( 100 , out[ "a" ].embeddedObject().nFields() );
+                ASSERT_EQUALS( 99 , out.getFieldDotted( "o.r" ).embeddedObject().nFields() );
+                ASSERT_EQUALS( 1.5 , out[ "n" ].number() );
+                ASSERT_EQUALS( NumberLong , out.getFieldDotted( "o.p.q" ).type() );
+                ASSERT_EQUALS( 2 , out.getFieldDotted( "o.p.q" ).numberLong() );
+                ASSERT_EQUALS( str , out[ "s" ].str() );
+                ASSERT_EQUALS( "end" , out[ "z" ].str() );
+                ASSERT( out.valid() );
+            }
+        };
+
+        /* { _id : ... } updates skip the query optimizer */
+        class byId : public Base {
+            const char * ns(){
+                return "unittests.byid";
+            }
+            void dotest(){
+                client().insert( ns() , fromjson( "{_id:1,a:1}" ) );
+                client().insert( ns() , fromjson( "{_id:'x',a:1}" ) );
+                client().update( ns() , QUERY( "_id" << 1 ) , fromjson( "{$inc:{a:2}}" ) );
+                client().update( ns() , QUERY( "_id" << 1.0 ) , fromjson( "{$push:{b:5}}" ) );
+                client().update( ns() , QUERY( "_id" << "x" ) , fromjson( "{_id:'x',c:3}" ) );
+                client().update( ns() , QUERY( "_id" << 2 ) , fromjson( "{$inc:{a:1}}" ) );
+                client().update( ns() , QUERY( "_id" << 3 ) , fromjson( "{$inc:{a:1}}" ) , true );
+                client().update( ns() , QUERY( "_id" << 4 ) , fromjson( "{_id:4,d:1}" ) , true );
+
+                ASSERT_EQUALS( 4U , client().count( ns() ) );
+                ASSERT_EQUALS( fromjson( "{_id:1,a:3,b:[5]}" ) , client().findOne( ns() , QUERY( "_id" << 1 ) ) );
+                ASSERT_EQUALS( fromjson( "{_id:'x',c:3}" ) , client().findOne( ns() , QUERY( "_id" << "x" ) ) );
+                ASSERT( client().findOne( ns() , QUERY( "_id" << 2 ) ).isEmpty() );
+                ASSERT_EQUALS( fromjson( "{_id:3,a:1}" ) , client().findOne( ns() , QUERY( "_id" << 3 ) ) );
+                ASSERT_EQUALS( fromjson( "{_id:4,d:1}" ) , client().findOne( ns() , QUERY( "_id" << 4 ) ) );
+            }
+        };
+
+        class unsetInPadding : public Base {
+            const char * ns(){
+                return "unittests.unsetinpadding";
+            }
+            void dotest(){
+                test( "{_id:1,x:1,o:{y:'abc',z:2},w:3}" , "{$unset:{'o.y':1,w:1}}" , "{_id:1,x:1,o:{z:2}}" );
+                test( "{_id:1,a:[1,2,3],b:4}" , "{$unset:{'a.1':1}}" , "{_id:1,a:[1,null,3],b:4}" );
+            }
+        };
+
 
     };
     
@@ -830,6 +892,9 @@ namespace UpdateTests {
             add< basic::bit1 >();
             add< basic::unset >();
             add< basic::setswitchint >();
+            add< basic::growInPadding >();
+            add< basic::unsetInPadding >();
+            add< basic::byId >();
         }
     } myall;
 
@@ -0,0 +1,39 @@
+// native aggregation pipeline
+
+t = db.aggregate1;
+t.drop();
+
+for ( var i=0; i<100; i++ )
+    t.save( { _id : i , a : i % 5 , b : i , s : "x" + ( i % 2 ) } );
+t.ensureIndex( { a : 1 } );
+
+function agg( pipeline ) {
+    var res = db.runCommand( { aggregate : "aggregate1" , pipeline : pipeline } );
+    assert( res.ok , tojson( res ) );
+    return res.result;
+}
+
+r = agg( [ { $group : { _id : "$a" , total : { $sum : "$b" } , n : { $count : 1 } , avg : { $avg : "$b" } , lo : { $min : "$b" } , hi : { $max : "$b" } } } ,
+           { $sort : { _id : 1 } } ] );
+assert.eq( 5 , r.length , "A1" );
+assert.eq( { _id : 2 , total : 990 , n : 20 , avg : 49.5 , lo : 2 , hi : 97 } , r[2] , "A2" );
+
+// the leading $match and $sort come from the index
+assert.eq( [ { b : 98 } , { b : 93 } , { b : 88 } ] ,
+           agg( [ { $match : { a : 3 } } , { $project : { b : 1 , _id : 0 } } , { $sort : { b : -1 } } , { $limit : 3 } ] ) , "B1" );
+assert.eq( [ 1 , 6 ] , agg( [ { $match : { a : 1 } } , { $sort : { a : 1 } } , { $limit : 2 } ] ).map( function(z){ return z.b; } ) , "B2" );
+assert.eq( 28 , agg( [ { $match : { a : { $gt : 2 } } } , { $sort : { b : 1 } } , { $skip : 10 } , { $limit : 1 } ] )[0].b , "B3" );
+
+// compound keys, $push, renames and constants
+r = agg( [ { $match : { b : { $lt : 10 } } } , { $project : { k : "$a" , s : 1 , b : 1 } } ,
+           { $group : { _id : { k : "$k" , s : "$s" } , bs : { $push : "$b" } } } , { $sort : { "_id.k" : 1 , "_id.s" : 1 } } ] );
+assert.eq( 10 , r.length , "C1" );
+assert.eq( { _id : { k : 0 , s : "x1" } , bs : [ 5 ] } , r[1] , "C2" );
+assert.eq( [ { _id : null , t : 150 } ] , agg( [ { $group : { _id : null , t : { $sum : 1.5 } } } ] ) , "C3" );
+
+// a $match after the $group
+assert.eq( 2 , agg( [ { $group : { _id : "$a" , hi : { $max : "$b" } } } , { $match : { hi : { $gt : 97 } } } ] ).length , "D1" );
+
+assert( ! db.runCommand( { aggregate : "aggregate1" , pipeline : [ { $foo : 1 } ] } ).ok , "E1" );
+assert( ! db.runCommand( { aggregate : "aggregate1" , pipeline : [ { $group : { n : { $sum : 1 } } } ] } ).ok , "E2" );
+assert( ! db.runCommand( { aggregate : "aggregate1" , pipeline : [ { $project : { a : "b" } } ] } ).ok , "E3" );
@@ -0,0 +1,74 @@
+// analyze builds histograms the query optimizer uses to skip racing plans that can't win
+
+t = db.jstests_analyze1;
+t.drop();
+
+// a is skewed: 1 for 90% of the documents
+for ( var i=0; i<10000; i++ )
+    t.save( { _id : i , a : i < 9000 ? 1 : i , b : i } );
+t.ensureIndex( { a : 1 } );
+t.ensureIndex( { b : -1 } );
+
+assert.lt( 1 , t.find( { a : 5 , b : { $gte : 0 } } ).explain().allPlans.length , "A1" );
+
+r = db.runCommand( { analyze : t.getName() } );
+assert( r.ok , "B1 " + tojson( r ) );
+assert.eq( 3 , r.nIndexes , "B2" );
+h = db.system.histograms.findOne( { ns : t.getFullName() , key : { a : 1 } } );
+assert( h , "B3" );
+assert.eq( 10000 , h.n , "B4" );
+assert.eq( h.counts.length + 1 , h.bounds.length , "B5" );
+assert.eq( 1 , h.bounds[ 0 ] , "B6" );
+assert.eq( 9999 , h.bounds[ h.bounds.length - 1 ] , "B7" );
+h = db.system.histograms.findOne( { ns : t.getFullName() , key : { b : -1 } } );
+assert.eq( 0 , h.bounds[ 0 ] , "B8" );
+
+// one index clearly wins: no race
+e = t.find( { a : 5 , b : { $gte : 0 } } ).explain();
+assert.eq( 1 , e.allPlans.length , "C1" );
+assert.eq( "BtreeCursor a_1" , e.cursor , "C2" );
+assert.gt( 2 , e.allPlans[ 0 ].nscannedEstimate , "C3" );
+
+e = t.find( { a : 1 , b : { $lt : 10 } } ).explain();
+assert.eq( 1 , e.allPlans.length , "C4" );
+assert( e.cursor.match( /^BtreeCursor b_-1/ ) , "C5 " + e.cursor );
+assert.gt( 50 , e.allPlans[ 0 ].nscannedEstimate , "C6" );
+
+// close calls still race
+e = t.find( { a : { $gt : 9500 } , b : { $gt : 9000 } } ).explain();
+assert.lt( 1 , e.allPlans.length , "D1" );
+
+// a plan recorded for a rare value isn't reused for a common one
+assert.eq( 1 , t.find( { a : 9500 , b : { $gte : 0 } } ).itcount() , "E1" );
+// recorded for a rare value: reused for another, raced again for the common one
+e = t.find( { a : 9600 , b : { $gte : 0 } } ).explain();
+assert( e.oldPlan , "E4 " + tojson( e ) );
+assert.eq( "BtreeCursor a_1" , e.oldPlan.cursor , "E5" );
+e = t.find( { a : 1 , b : { $gte : 0 } } ).explain();
+assert( ! e.oldPlan , "E6 " + tojson( e.oldPlan ) );
+assert.lt( 1 , e.allPlans.length , "E7" );
+assert.eq( 9000 , t.find( { a : 1 , b : { $gte : 0 } } ).itcount() , "E2" );
+assert.eq( 10 , t.find( { a : 1 , b : { $lt : 10 } } ).itcount() , "E3" );
+
+// dropping the collection drops its histograms
+t.drop();
+assert.eq( 0 , db.system.histograms.find( { ns : t.getFullName() } ).count() , "F1" );
+
+// a multikey index has many more keys than records: the bucket count still stays near buckets
+for ( var i=0; i<1000; i++ ){
+    var c = [];
+    for ( var j=0; j<50; j++ )
+        c.push( i * 50 + j );
+    t.save( { _id : i , c : c } );
+}
+t.ensureIndex( { c : 1 } );
+r = db.runCommand( { analyze : t.getName() , buckets : 10 } );
+assert( r.ok , "G1 " + tojson( r ) );
+h = db.system.histograms.findOne( { ns : t.getFullName() , key : { c : 1 } } );
+assert.eq( 50000 , h.n , "G2" );
+assert.gte( 20 , h.counts.length , "G3 " + h.counts.length );
+var total = 0;
+for ( var i=0; i<h.counts.length; i++ )
+    total += h.counts[ i ];
+assert.eq( 50000 , total , "G4" );
+assert.eq( h.counts.length + 1 , h.bounds.length , "G5" );
@@ -0,0 +1,41 @@
+// counted indexes answer range counts from the subtree counts
+
+t = db.jstests_count_counted1;
+t.drop();
+
+function check( q , n ) {
+    assert.eq( n , t.find( q ).itcount() , "itcount " + tojson( q ) );
+    assert.eq( n , t.find( q ).count() , tojson( q ) );
+}
+
+// maintained by inserts
+t.ensureIndex( { a : 1 } , { counted : true } );
+for ( var i=0; i<1000; i++ )
+    t.save( { a : i % 500 , b : i } );
+assert( t.validate().valid , "A1" );
+
+check( { a : 5 } , 2 );
+check( { a : { $gte : 10 , $lt : 20 } } , 20 );
+check( { a : { $gt : 10 , $lte : 20 } } , 20 );
+check( { a : { $in : [ 1 , 3 , 600 , 7 ] } } , 6 );
+check( { a : { $gt : 100 , $lt : 50 } } , 0 );
+assert.eq( 5 , t.find( { a : { $gte : 10 , $lt : 20 } } ).skip( 15 ).count( true ) , "A2" );
+assert.eq( 4 , t.find( { a : { $gte : 10 , $lt : 20 } } ).limit( 4 ).count( true ) , "A3" );
+
+// ranges the index can't count exactly are walked as before
+check( { a : { $gte : 490 } } , 20 );
+check( { a : 5 , b : 5 } , 1 );
+
+// maintained by removes and updates
+t.remove( { a : { $lt : 100 } } );
+t.update( { a : 100 } , { $set : { a : 1000 } } , false , true );
+assert( t.validate().valid , "B1" );
+check( { a : { $gte : 0 , $lt : 200 } } , 198 );
+check( { a : { $gte : 900 , $lte : 1000 } } , 2 );
+
+// built over existing data, descending
+t.dropIndexes();
+t.ensureIndex( { a : -1 } , { counted : true } );
+assert( t.validate().valid , "C1" );
+check( { a : { $gte : 0 , $lt : 200 } } , 198 );
+check( { a : { $in : [ 150 , 1000 ] } } , 4 );
@@ -0,0 +1,54 @@
+// build several indexes with one collection scan
+
+t = db.createindexes1;
+t.drop();
+
+for ( var i=0; i<1000; i++ )
+    t.save( { a : i , b : [ i % 10 , 100 + i % 7 ] , c : "x" + i } );
+
+res = t.runCommand( "createIndexes" , { indexes : [ { key : { a : 1 } , name : "a_1" } ,
+                                                    { key : { b : 1 } , name : "b_1" } ,
+                                                    { key : { c : -1 } , name : "c_-1" , unique : true } ] } );
+assert( res.ok , "A1 " + tojson( res ) );
+assert.eq( 3 , res.nIndexesAdded , "A2" );
+assert.eq( 4 , t.getIndexes().length , "A3" );
+
+assert.eq( 1000 , t.find().hint( { a : 1 } ).itcount() , "B1" );
+assert.eq( 2000 , t.find().hint( { b : 1 } ).itcount() , "B2" ); // multikey, not deduped without a query
+assert.eq( 100 , t.find( { b : 3 } ).hint( { b : 1 } ).itcount() , "B3" );
+assert.eq( 1000 , t.find().hint( { c : -1 } ).itcount() , "B4" );
+assert.eq( 1 , t.find( { c : "x5" } ).explain().nscanned , "B5" );
+assert( t.validate().valid , "B6" );
+
+// existing ones are skipped
+res = t.runCommand( "createIndexes" , { indexes : [ { key : { a : 1 } , name : "a_1" } , { key : { d : 1 } , name : "d_1" } ] } );
+assert( res.ok , "C1" );
+assert.eq( 1 , res.nIndexesAdded , "C2" );
+assert.eq( 5 , t.getIndexes().length , "C3" );
+
+// a failed unique build rolls back all the indexes of the batch
+t.save( { a : 1 } );
+res = t.runCommand( "createIndexes" , { indexes : [ { key : { e : 1 } , name : "e_1" } , { key : { a : -1 } , name : "a_-1" , unique : true } ] } );
+assert( ! res.ok , "D1" );
+assert.eq( 5 , t.getIndexes().length , "D2" );
+
+// dropDups
+res = t.runCommand( "createIndexes" , { indexes : [ { key : { e : 1 } , name : "e_1" } , { key : { a : -1 } , name : "a_-1" , unique : true , dropDups : true } ] } );
+assert( res.ok , "E1" );
+assert.eq( 1000 , t.count() , "E2" );
+assert.eq( 1000 , t.find().hint( { e : 1 } ).itcount() , "E3" );
+assert( t.validate().valid , "E4" );
+
+// background
+t.dropIndexes();
+res = t.runCommand( "createIndexes" , { indexes : [ { key : { a : 1 } , name : "a_1" , background : true } ,
+                                                    { key : { c : 1 } , name : "c_1" , background : true } ] } );
+assert( res.ok , "F1" );
+assert.eq( 3 , t.getIndexes().length , "F2" );
+assert.eq( 1000 , t.find().hint( { c : 1 } ).itcount() , "F3" );
+assert( t.validate().valid , "F4" );
+
+// reIndex goes through the same path
+assert( t.reIndex().ok , "G1" );
+assert.eq( 3 , t.getIndexes().length , "G2" );
+assert.eq( 1000 , t.find().hint( { a : 1 } ).itcount() , "G3" );
@@ -0,0 +1,41 @@
+// distinct answered from an index: one seek per value, records only read for null keys
+
+t = db.distinct_index1;
+t.drop();
+
+for ( var i=0; i<1000; i++ )
+    t.save( { a : i % 10 , b : i } );
+t.ensureIndex( { a : 1 } );
+
+assert.eq( "0,1,2,3,4,5,6,7,8,9" , t.distinct( "a" ).toString() , "A1" );
+assert.eq( "7,8,9" , t.distinct( "a" , { a : { $gt : 6 } } ).toString() , "A2" );
+assert.eq( "2,4" , t.distinct( "a" , { a : { $in : [ 2 , 4 , 99 ] } } ).toString() , "A3" );
+assert.eq( "3" , t.distinct( "a" , { b : 503 } ).toString() , "A4" );
+
+// missing fields index as null, but aren't values
+t.save( { b : -1 } );
+assert.eq( 10 , t.distinct( "a" ).length , "B1" );
+t.save( { a : null , b : -2 } );
+assert.eq( 11 , t.distinct( "a" ).length , "B2" );
+assert.eq( null , t.distinct( "a" )[0] , "B3" );
+
+// multikey, and empty arrays in a compound index
+t.drop();
+t.save( { a : [ 1 , 2 ] , c : 1 } );
+t.save( { a : [] , c : 1 } );
+t.save( { a : [ 2 , 3 ] , c : 1 } );
+t.save( { a : { b : "z" } } );
+t.save( { a : [ { b : "x" } , { b : "y" } ] } );
+t.ensureIndex( { a : 1 , c : -1 } );
+assert.eq( 6 , t.distinct( "a" ).length , "C1" );
+assert.eq( "1,2,3" , t.distinct( "a" , { a : 2 } ).toString() , "C2" );
+
+t.ensureIndex( { "a.b" : -1 } );
+assert.eq( "x,y,z" , t.distinct( "a.b" ).toString() , "C3" );
+
+// a filtered index only helps queries implying its filter
+t.drop();
+for ( var i=0; i<100; i++ )
+    t.save( { a : i % 10 , s : i < 50 ? "new" : "done" } );
+t.ensureIndex( { a : 1 } , { filter : { s : "new" } } );
+assert.eq( 10 , t.distinct( "a" ).length , "D1" );
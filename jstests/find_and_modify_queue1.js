@@ -0,0 +1,83 @@
+// findandmodify with queue:true resumes where the last call for the same query and sort stopped
+
+t = db.find_and_modify_queue1;
+t.drop();
+
+for( var i=1; i<=20; i++ )
+    t.insert( { _id : i , priority : i , state : "ready" } );
+t.ensureIndex( { priority : -1 } );
+
+function take( extra ){
+    var a = { query : { state : "ready" } , sort : { priority : -1 } , update : { $set : { state : "running" } } , queue : true };
+    for( var k in extra )
+        a[ k ] = extra[ k ];
+    return t.findAndModify( a );
+}
+
+// in sort order, old value by default
+for( var i=20; i>15; i-- ){
+    out = take();
+    assert.eq( i , out.priority , "A1 " + i );
+    assert.eq( "ready" , out.state , "A2 " + i );
+}
+assert.eq( 5 , t.count( { state : "running" } ) , "A3" );
+
+// new and fields
+out = take( { "new" : true , fields : { state : 1 } } );
+assert.eq( { _id : 15 , state : "running" } , out , "B1" );
+
+// a new job ahead of the position is seen
+t.insert( { _id : 100 , priority : 100 , state : "ready" } );
+assert.eq( 100 , take().priority , "C1" );
+assert.eq( 14 , take().priority , "C2" );
+
+// so is one put back
+t.update( { _id : 18 } , { $set : { state : "ready" } } );
+assert.eq( 18 , take().priority , "D1" );
+assert.eq( 13 , take().priority , "D2" );
+
+// and one whose priority goes up
+t.update( { _id : 5 } , { $set : { priority : 50 } } );
+assert.eq( 50 , take().priority , "E1" );
+assert.eq( 12 , take().priority , "E2" );
+
+// remove
+out = t.findAndModify( { query : { state : "ready" } , sort : { priority : -1 } , remove : true , queue : true } );
+assert.eq( 11 , out.priority , "F1" );
+assert.eq( 0 , t.count( { _id : 11 } ) , "F2" );
+
+// drain it
+for( var i=10; i>=1; i-- ){
+    if ( i == 5 )
+        continue;
+    assert.eq( i , take().priority , "G1 " + i );
+}
+assert.eq( {} , take() , "G2" );
+assert.eq( 0 , t.count( { state : "ready" } ) , "G3" );
+
+// refilled after it ran dry
+t.insert( { _id : 200 , priority : 0 , state : "ready" } );
+assert.eq( 0 , take().priority , "H1" );
+
+// a sort no index gives is an ordinary findandmodify
+t.insert( { _id : 201 , priority : 1 , state : "ready" , n : 2 } );
+t.insert( { _id : 202 , priority : 2 , state : "ready" , n : 1 } );
+out = t.findAndModify( { query : { state : "ready" } , sort : { n : 1 } , update : { $set : { state : "running" } } , queue : true } );
+assert.eq( 202 , out._id , "I1" );
+
+// a sort is required
+assert.throws( function(){ t.findAndModify( { query : { state : "ready" } , update : { $set : { state : "running" } } , queue : true } ); } , [] , "J1" );
+
+// more queues than positions are kept: evicted ones start over and still take in order
+t.drop();
+t.ensureIndex( { w : 1 , priority : -1 } );
+for( var w=0; w<50; w++ )
+    for( var i=1; i<=3; i++ )
+        t.insert( { w : w , priority : i , state : "ready" } );
+function takeW( w ){
+    return t.findAndModify( { query : { w : w , state : "ready" } , sort : { w : 1 , priority : -1 } , update : { $set : { state : "running" } } , queue : true } );
+}
+for( var i=3; i>=1; i-- )
+    for( var w=0; w<50; w++ )
+        assert.eq( i , takeW( w ).priority , "K1 " + w + " " + i );
+assert.eq( 0 , t.count( { state : "ready" } ) , "K2" );
@@ -0,0 +1,50 @@
+// large $in lists: the index is walked from one value to the next and matching uses a hash
+
+t = db.jstests_in_large1;
+t.drop();
+
+for ( var i=0; i<20000; i++ )
+    t.save( { _id : i , a : i , b : i % 2 == 0 ? "s" + i : i } );
+
+var ids = [];
+var strs = [];
+for ( var i=0; i<20000; i+=7 ){
+    ids.push( i );
+    strs.push( "s" + i );
+}
+// equal values of other numeric types, and values that aren't there
+ids.push( 7.0 );
+ids.push( NumberLong( 14 ) );
+ids.push( 20001 );
+ids.push( "x" );
+
+function check( q , n , msg ){
+    assert.eq( n , t.find( q ).itcount() , msg );
+    assert.eq( n , t.find( q ).sort( { _id : -1 } ).itcount() , msg + " reverse" );
+}
+
+check( { _id : { $in : ids } } , 2858 , "A1" );
+check( { a : { $in : ids } } , 2858 , "A2" );
+check( { b : { $in : strs.concat( ids ) } } , 2858 , "A3" );
+check( { _id : { $in : ids } , a : { $gte : 10000 } } , 1429 , "A4" );
+
+t.ensureIndex( { a : 1 , b : 1 } );
+assert.eq( 2858 , t.find( { a : { $in : ids } } ).hint( { a : 1 , b : 1 } ).itcount() , "B1" );
+assert.eq( 1429 , t.find( { a : { $gte : 0 } , b : { $in : strs } } ).hint( { a : 1 , b : 1 } ).itcount() , "B2" );
+
+var r = t.find( { _id : { $in : ids } } ).sort( { _id : 1 } ).toArray();
+for ( var i=1; i<r.length; i++ )
+    assert.lt( r[i-1]._id , r[i]._id , "C1" );
+
+// values that aren't numbers or strings
+t.drop();
+var objs = [];
+for ( var i=0; i<2000; i++ ){
+    t.save( { _id : i , o : { x : i } , bin : i == 1999 ? new BinData( 0 , "AQID" ) : null } );
+    if ( i % 5 == 0 )
+        objs.push( { x : i } );
+}
+assert.eq( 400 , t.find( { o : { $in : objs } } ).itcount() , "D1" );
+assert.eq( 400 , t.find( { o : { $in : objs.concat( [ 1 , "x" , null ] ) } } ).itcount() , "D2" );
+assert.eq( 1 , t.find( { bin : { $in : [ new BinData( 0 , "AQID" ) , new BinData( 1 , "AQID" ) , new BinData( 0 , "AQIE" ) ] } } ).itcount() , "D3" );
+assert.eq( 1999 , t.find( { bin : { $in : [ null , new BinData( 0 , "AQIE" ) ] } } ).itcount() , "D4" );
@@ -0,0 +1,53 @@
+// indexes with a filter only hold the objects matching it
+
+t = db.index_filter1;
+t.drop();
+
+for ( var i=0; i<100; i++ )
+    t.save( { u : i % 10 , state : i < 90 ? "done" : "new" , x : i } );
+t.ensureIndex( { u : 1 } , { filter : { state : { $ne : "done" } } } );
+
+assert.eq( 10 , t.find( { state : { $ne : "done" } } ).hint( { u : 1 } ).itcount() , "A1" );
+assert( t.validate().valid , "A2" );
+
+function check( q , n , indexed ) {
+    assert.eq( n , t.find( q ).itcount() , tojson( q ) );
+    assert.eq( n , t.find( q ).count() , "count " + tojson( q ) );
+    var e = t.find( q ).explain();
+    assert.eq( indexed , e.cursor.match( /^BtreeCursor u_1/ ) != null , "cursor " + tojson( q ) + " " + e.cursor );
+}
+
+// implied by the query
+check( { u : 3 , state : { $ne : "done" } } , 1 , true );
+check( { u : { $gt : 5 } , state : { $ne : "done" } } , 4 , true );
+
+// not implied: the index would miss matches
+check( { u : 3 } , 10 , false );
+check( { u : 3 , state : "done" } , 9 , false );
+check( { u : 3 , state : { $ne : "new" } } , 9 , false );
+t.find( { u : 3 } ).sort( { u : 1 } ).itcount();
+check( { u : 3 } , 10 , false );
+
+// the same query pattern with a value the filter doesn't hold doesn't reuse the recorded plan
+t.dropIndexes();
+t.ensureIndex( { u : 1 } , { filter : { state : "new" } } );
+check( { u : 3 , state : "new" } , 1 , true );
+check( { u : 3 , state : "done" } , 9 , false );
+check( { u : 3 , state : "new" } , 1 , true );
+assert.throws( function() { t.find( { u : 3 } ).hint( { u : 1 } ).itcount(); } , null , "B1" );
+
+// updates move objects into and out of the index
+t.update( { x : 1 } , { $set : { state : "new" } } );
+t.update( { x : 95 } , { $set : { state : "done" } } );
+t.update( { x : 96 } , { $set : { state : "done" , pad : "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx" } } );
+assert.eq( 9 , t.find( { state : "new" } ).hint( { u : 1 } ).itcount() , "C1" );
+assert.eq( 2 , t.find( { u : 1 , state : "new" } ).itcount() , "C2" );
+t.remove( { x : 91 } );
+assert.eq( 8 , t.find( { state : "new" } ).hint( { u : 1 } ).itcount() , "C3" );
+assert( t.validate().valid , "C4" );
+
+// bad filters
+t.createIndex( { x : 1 } , { filter : 5 } );
+assert( db.getLastError() , "D1" );
+t.createIndex( { x : 1 } , { filter : { $where : "this.x > 5" } } );
+assert( db.getLastError() , "D2" );
@@ -0,0 +1,46 @@
+// records matched by several single field indexes are found by intersecting their DiskLocs
+
+t = db.intersect1;
+t.drop();
+
+for ( var i=0; i<2000; i++ )
+    t.save( { a : i % 10 , b : i % 7 , c : [ i % 3 , 10 + i % 3 ] , d : i } );
+t.ensureIndex( { a : 1 } );
+t.ensureIndex( { b : 1 } );
+
+function check( q , n ) {
+    assert.eq( n , t.find( q ).hint( { $natural : 1 } ).itcount() , "natural " + tojson( q ) );
+    assert.eq( n , t.find( q ).itcount() , tojson( q ) );
+    assert.eq( n , t.find( q ).count() , "count " + tojson( q ) );
+    return t.find( q ).explain();
+}
+
+// single keys: merged in DiskLoc order
+e = check( { a : 3 , b : 4 } , 28 );
+assert( e.cursor.match( /^IntersectCursor/ ) , "A1 " + e.cursor );
+assert.eq( 28 , e.nscanned , "A2" );
+assert.eq( 2 , e.indexBounds.length , "A3" );
+
+// ranges: gathered, then streamed
+e = check( { a : { $gt : 7 } , b : { $lt : 2 } } , 115 );
+// the keys read to find the smaller range, a's 400, count too
+if ( e.cursor.match( /^IntersectCursor/ ) )
+    assert.lte( 400 * 2 , e.nscanned , "A4 " + tojson( e ) );
+check( { a : { $in : [ 1 , 9 ] } , b : 0 , d : { $lt : 1000 } } , 28 );
+check( { a : 3 , b : 4 , d : { $mod : [ 2 , 0 ] } } , 0 );
+
+// multikey, each record once
+t.ensureIndex( { c : 1 } );
+check( { a : 3 , c : { $in : [ 1 , 11 ] } } , 67 );
+
+// the chosen plan is remembered
+t.find( { a : 5 , b : 5 } ).itcount();
+assert.eq( 29 , t.find( { a : 5 , b : 5 } ).itcount() , "B1" );
+
+// results survive a getMore and removal of records during the scan
+c = t.find( { a : { $gt : 7 } , b : { $lt : 2 } } ).batchSize( 10 );
+assert.eq( 115 , c.itcount() , "C1" );
+t.remove( { a : 3 , b : 4 } );
+assert.eq( 0 , t.find( { a : 3 , b : 4 } ).itcount() , "C2" );
+assert.eq( 1972 , t.count() , "C3" );
+assert( t.validate().valid , "C4" );
@@ -0,0 +1,44 @@
+// $or clauses each use their own index, and the results are merged without dups
+
+t = db.jstests_or3;
+t.drop();
+
+for ( var i=0; i<1000; i++ )
+    t.save( { _id : i , email : "e" + i , phone : 1000 - i , tags : [ i % 5 , 5 + i % 5 ] , x : i % 2 } );
+t.ensureIndex( { email : 1 } );
+t.ensureIndex( { phone : 1 } );
+t.ensureIndex( { tags : 1 } );
+
+function check( q , n ) {
+    assert.eq( n , t.find( q ).hint( { $natural : 1 } ).itcount() , "natural " + tojson( q ) );
+    assert.eq( n , t.find( q ).itcount() , tojson( q ) );
+    assert.eq( n , t.find( q ).count() , "count " + tojson( q ) );
+    return t.find( q ).explain();
+}
+
+e = check( { $or : [ { email : "e5" } , { phone : 10 } ] } , 2 );
+assert( e.cursor.match( /^UnionCursor/ ) , "A1 " + e.cursor );
+assert.eq( 2 , e.indexBounds.length , "A2" );
+assert.gt( 5 , e.nscanned , "A3" );
+
+// the same record from two clauses, and from a multikey index twice
+check( { $or : [ { email : "e5" } , { phone : 995 } ] } , 1 );
+check( { $or : [ { tags : { $in : [ 1 , 6 ] } } , { phone : { $lt : 100 } } ] } , 279 );
+
+// the rest of the query applies to each clause
+check( { x : 1 , $or : [ { email : { $in : [ "e1" , "e2" , "e3" ] } } , { phone : { $gte : 990 } } ] } , 5 );
+check( { x : 1 , $or : [ { email : "e2" } ] } , 0 );
+
+// a clause no index helps: table scan only
+e = check( { $or : [ { email : "e5" } , { x : 1 } ] } , 500 );
+assert( e.cursor.match( /^BasicCursor/ ) , "B1" );
+
+// getMore
+assert.eq( 279 , t.find( { $or : [ { tags : { $in : [ 1 , 6 ] } } , { phone : { $lt : 100 } } ] } ).batchSize( 7 ).itcount() , "C1" );
+
+// updates and removes
+t.update( { $or : [ { email : "e7" } , { phone : 7 } ] } , { $set : { y : 1 } } , false , true );
+assert.eq( 2 , t.find( { y : 1 } ).itcount() , "D1" );
+t.remove( { $or : [ { tags : 4 } , { phone : { $lte : 500 } } ] } );
+assert.eq( 400 , t.count() , "D2" );
+assert( t.validate().valid , "D3" );
@@ -0,0 +1,32 @@
+// getlasterror fsyncs from many clients at once share flushes
+
+f = db.jstests_parallel_fsync_group1;
+f.drop();
+
+before = db.serverStatus().fsyncGroupCommit;
+
+t = new ParallelTester();
+
+for( id = 0; id < 20; ++id ) {
+    t.add( function( host, id ) {
+              var d = new Mongo( host ).getDB( db.getName() );
+              for( var i = 0; i < 20; ++i ) {
+                  d.jstests_parallel_fsync_group1.insert( { who:id, i:i } );
+                  var r = d.runCommand( { getlasterror:1, fsync:true } );
+                  assert( r.ok && r.err == null, tojson( r ) );
+                  assert( r.fsyncFiles != null, tojson( r ) );
+              }
+          }, [ db.getMongo().host, id ] );
+}
+
+t.run( "one or more tests failed" );
+
+assert.eq( 400, f.count() );
+
+after = db.serverStatus().fsyncGroupCommit;
+assert.eq( 400, after.callers - before.callers, tojson( after ) );
+assert.lte( after.commits - before.commits, 400, tojson( after ) );
+var n = 0;
+for( var k in after.batchSizes )
+    n += after.batchSizes[ k ];
+assert.eq( after.commits, n, tojson( after ) );
@@ -0,0 +1,36 @@
+// unindexed counts, distincts and sorted queries on a big collection are split across threads
+
+t = db.jstests_parallel_scan1;
+t.drop();
+
+for ( var i=0; i<20000; i++ )
+    t.save( { _id : i , a : i % 100 , b : i % 7 , c : [ i % 3 , 10 + i % 3 ] , s : "x" + ( i % 50 ) } );
+assert.lt( 1 , t.stats().numExtents , "A1" );
+
+assert.eq( 200 , t.count( { a : 5 } ) , "B1" );
+assert.eq( 10000 , t.count( { a : { $lt : 50 } } ) , "B2" );
+assert.eq( 0 , t.count( { a : 500 } ) , "B3" );
+assert.eq( 6667 , t.count( { c : 0 } ) , "B4" );
+assert.eq( 190 , t.find( { a : 5 } ).skip( 10 ).count( true ) , "B5" );
+assert.eq( 10 , t.find( { a : 5 } ).limit( 10 ).count( true ) , "B6" );
+assert.eq( t.find( { a : 5 , b : 3 } ).itcount() , t.count( { a : 5 , b : 3 } ) , "B7" );
+
+assert.eq( [ 0 , 1 , 2 , 3 , 4 , 5 , 6 ] , t.distinct( "b" ) , "C1" );
+assert.eq( [ 0 , 1 , 2 , 10 , 11 , 12 ] , t.distinct( "c" ) , "C2" );
+assert.eq( [ 0 , 1 , 2 ] , t.distinct( "b" , { a : 0 , b : { $lt : 3 } } ) , "C3" );
+assert.eq( 50 , t.distinct( "s" ).length , "C4" );
+
+var r = t.find( { a : { $gte : 90 } } ).sort( { b : 1 , _id : -1 } ).toArray();
+assert.eq( 2000 , r.length , "D1" );
+for ( var i=1; i<r.length; i++ ){
+    assert( r[i-1].b < r[i].b || ( r[i-1].b == r[i].b && r[i-1]._id > r[i]._id ) , "D2 " + i );
+}
+r = t.find( { b : 0 } ).sort( { a : -1 } ).skip( 5 ).limit( 3 ).toArray();
+assert.eq( 3 , r.length , "D3" );
+assert.eq( 99 , r[0].a , "D4" );
+assert.eq( t.find( { b : 0 } ).sort( { a : -1 } ).skip( 5 ).limit( 3 ).toArray() , r , "D5" );
+
+// anything an index helps with runs as before
+t.ensureIndex( { a : 1 } );
+assert.eq( 200 , t.count( { a : 5 } ) , "E1" );
+assert.eq( "BtreeCursor a_1" , t.find( { a : 5 } ).sort( { b : 1 } ).explain().cursor , "E2" );
@@ -0,0 +1,35 @@
+// explain() and the profiler say where a query's time went
+
+t = db.jstests_profile_stats1;
+t.drop();
+
+for ( var i=0; i<1000; i++ )
+    t.save( { a : i % 10 , b : i } );
+t.ensureIndex( { a : 1 } );
+
+e = t.find( { a : 3 , b : { $gt : 500 } } ).sort( { b : 1 } ).explain();
+assert.eq( e.nscanned , e.stats.nscanned , "A1" );
+assert.eq( e.nscannedObjects , e.stats.nscannedObjects , "A2" );
+assert.eq( 100 , e.stats.nscanned , "A3" );
+[ "cursorMicros" , "matchMicros" , "sortMicros" , "projectMicros" , "nYields" , "lockWaitMicros" ].forEach(
+    function( f ) { assert( e.stats[ f ] >= 0 , "A4 " + f ); } );
+
+db.runCommand( { profile : 0 } );
+db.system.profile.drop();
+db.runCommand( { profile : 2 } );
+
+t.find( { b : { $lt : 500 } } ).batchSize( 10 ).itcount();
+t.find( { a : 5 } ).sort( { b : -1 } ).toArray();
+
+db.runCommand( { profile : 0 } );
+
+p = db.system.profile.find( { info : /query .*jstests_profile_stats1/ } ).toArray();
+assert.eq( 2 , p.length , "B1" );
+p.forEach( function( x ) {
+    assert( x.stats , "B2 " + tojson( x ) );
+    assert( x.stats.matchMicros >= 0 && x.stats.cursorMicros >= 0 , "B3 " + tojson( x ) );
+} );
+assert.lte( 100 , p[ 1 ].stats.nscanned , "B4" );
+assert( db.system.profile.find( { info : /getmore .*jstests_profile_stats1/ , "stats.nscanned" : { $gt : 0 } } ).count() > 0 , "B5" );
+
+db.system.profile.drop();
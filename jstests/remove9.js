@@ -0,0 +1,42 @@
+// removes go a chunk of documents at a time, unindexing each chunk index by index
+
+t = db.jstests_remove9;
+t.drop();
+
+for ( var i=0; i<5000; i++ )
+    t.save( { _id : i , ts : i , a : [ i % 10 , 10 + i % 10 ] , s : "x" + i } );
+t.ensureIndex( { ts : 1 } );
+t.ensureIndex( { a : 1 } );
+t.ensureIndex( { s : -1 } );
+
+// a cursor open on documents about to go moves past all of them
+c = t.find( { ts : { $gte : 1000 } } ).sort( { ts : 1 } ).batchSize( 2 );
+assert.eq( 1000 , c.next().ts , "A1" );
+assert.eq( 1001 , c.next().ts , "A2" );
+
+t.remove( { ts : { $lt : 3000 } } );
+assert.eq( 2000 , t.count() , "B1" );
+assert.eq( 2000 , t.find( { ts : { $gte : 0 } } ).itcount() , "B2" );
+assert.eq( 2000 , t.find().hint( { s : -1 } ).itcount() , "B3" );
+assert.eq( 200 , t.find( { a : 3 } ).itcount() , "B4" );
+assert.eq( 0 , t.find( { ts : { $lt : 3000 } } ).itcount() , "B5" );
+
+var n = 0;
+while ( c.hasNext() ){
+    assert.lte( 3000 , c.next().ts , "C1" );
+    n++;
+}
+assert.eq( 2000 , n , "C2" );
+
+// multikey: each document goes once however many keys it has
+t.remove( { a : { $in : [ 1 , 11 , 2 ] } } );
+assert.eq( 1600 , t.count() , "D1" );
+assert.eq( 0 , t.find( { a : 11 } ).itcount() , "D2" );
+
+// unindexed
+t.remove( { s : /5$/ } );
+assert.eq( 1440 , t.count() , "E1" );
+assert.eq( 1440 , t.find().hint( { a : 1 } ).itcount() , "E2" );
+
+v = t.validate();
+assert( v.valid , "F1 " + tojson( v ) );
@@ -0,0 +1,40 @@
+// slaves apply the master's ops in batches, with commands in between kept in order
+
+var rt = new ReplTest( "batch1" );
+
+m = rt.start( true );
+s = rt.start( false );
+
+am = m.getDB( "foo" ).batch1;
+as = s.getDB( "foo" ).batch1;
+
+am.save( { _id : -1 } );
+assert.soon( function(){ return as.count() == 1; } , "A1" );
+
+for ( var i=0; i<5000; i++ ){
+    am.save( { _id : i , n : 0 } );
+    am.update( { _id : i % 100 } , { $inc : { n : 1 } } );
+    if ( i == 2500 ){
+        // a command in the middle of it: what comes after it sees the collection recreated
+        m.getDB( "foo" ).batch1b.drop();
+        m.getDB( "foo" ).createCollection( "batch1b" );
+    }
+    if ( i > 2500 && i % 10 == 0 )
+        m.getDB( "foo" ).batch1b.save( { _id : i } );
+}
+m.getDB( "foo" ).getLastError();
+
+assert.soon( function(){ return as.count() == 5001 && as.findOne( { _id : 4999 } ); } , "B1" , 60000 );
+for ( var i=0; i<100; i++ )
+    assert.eq( am.findOne( { _id : i } ).n , as.findOne( { _id : i } ).n , "B2 " + i );
+assert.eq( 249 , s.getDB( "foo" ).batch1b.count() , "B3" );
+
+apply = s.getDB( "admin" ).runCommand( { serverStatus : 1 } ).repl.apply;
+assert.lte( 10000 , apply.ops , "C1 " + tojson( apply ) );
+assert.gte( apply.ops , apply.batches , "C2" );
+var n = 0;
+for ( var k in apply.batchSizes )
+    n += apply.batchSizes[ k ];
+assert.eq( apply.batches , n , "C3" );
+
+rt.stop();
@@ -0,0 +1,31 @@
+// getlasterror w waits are woken by the slave's progress, and report how long they took
+
+var rt = new ReplTest( "block3" );
+
+m = rt.start( true );
+s = rt.start( false );
+
+dbm = m.getDB( "foo" );
+dbs = s.getDB( "foo" );
+tm = dbm.bar;
+ts = dbs.bar;
+
+tm.save( { x : 0 } );
+assert.isnull( dbm.getLastError( 2 , 30000 ) , "A1" );
+
+for ( var i=1; i<=50; i++ ){
+    tm.save( { x : i } );
+    r = dbm.runCommand( { getlasterror : 1 , w : 2 , wtimeout : 30000 } );
+    assert( r.ok , "B1 " + tojson( r ) );
+    assert( r.wtime != null && r.wtime < 30000 , "B2 " + tojson( r ) );
+    assert.eq( i + 1 , ts.count() , "B3" );
+}
+
+// no slave to wait for: times out after about wtimeout
+tm.save( { x : 51 } );
+r = dbm.runCommand( { getlasterror : 1 , w : 3 , wtimeout : 500 } );
+assert( r.wtimeout , "C1 " + tojson( r ) );
+assert.lte( 500 , r.waited , "C2 " + tojson( r ) );
+assert.gt( 5000 , r.waited , "C3 " + tojson( r ) );
+
+rt.stop();
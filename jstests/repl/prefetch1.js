@@ -0,0 +1,42 @@
+// a slave reading ahead of the ops it applies ends up with the same data
+
+function check( mode ){
+    var rt = new ReplTest( "prefetch1" );
+
+    m = rt.start( true );
+    s = rt.start( false , mode ? { replPrefetch : mode } : {} );
+
+    am = m.getDB( "foo" ).prefetch1;
+    as = s.getDB( "foo" ).prefetch1;
+
+    am.ensureIndex( { a : 1 } );
+    am.ensureIndex( { b : 1 , c : -1 } );
+    am.save( { _id : -1 } );
+    assert.soon( function(){ return as.count() == 1; } , "A1 " + mode );
+
+    for ( var i=0; i<3000; i++ )
+        am.save( { _id : i , a : i % 13 , b : [ i , i + 1 ] , c : "x" + i } );
+    for ( var i=0; i<3000; i+=3 )
+        am.update( { _id : i } , { $set : { a : -i } , $push : { b : i + 2 } } );
+    for ( var i=1; i<3000; i+=3 )
+        am.remove( { _id : i } );
+    am.save( { _id : 3000 , done : true } );
+
+    assert.soon( function(){ return as.findOne( { done : true } ); } , "B1 " + mode , 60000 );
+    assert.eq( am.count() , as.count() , "B2 " + mode );
+    assert.eq( am.find().sort( { _id : 1 } ).toArray() , as.find().sort( { _id : 1 } ).toArray() , "B3 " + mode );
+    assert.eq( am.find( { a : { $lt : 0 } } ).count() , as.find( { a : { $lt : 0 } } ).count() , "B4 " + mode );
+    assert.eq( am.find( { b : 1000 } ).count() , as.find( { b : 1000 } ).count() , "B5 " + mode );
+
+    apply = s.getDB( "admin" ).runCommand( { serverStatus : 1 } ).repl.apply;
+    assert.eq( mode || "all" , apply.prefetch , "C1 " + tojson( apply ) );
+    assert.lte( 0 , apply.prefetch_ms , "C2" );
+    assert.lte( 0 , apply.lock_ms_per_op , "C3" );
+    assert( apply.last_lag_secs != null , "C4" );
+
+    rt.stop();
+}
+
+check();
+check( "_id_only" );
+check( "none" );
@@ -0,0 +1,40 @@
+// documents past an index's expireAfterSeconds are deleted on the master and the deletes replicate
+
+var rt = new ReplTest( "ttl1" );
+
+m = rt.start( true , { ttlMonitorSleepSecs : 1 } );
+s = rt.start( false , { ttlMonitorSleepSecs : 1 } );
+
+am = m.getDB( "foo" ).ttl1;
+as = s.getDB( "foo" ).ttl1;
+
+var now = new Date().getTime();
+for ( var i=0; i<3000; i++ ){
+    // a third expired, a third not yet, a third without a date
+    var o = { _id : i };
+    if ( i % 3 == 0 )
+        o.createdAt = new Date( now - 7200 * 1000 - i );
+    else if ( i % 3 == 1 )
+        o.createdAt = new Date( now );
+    else
+        o.createdAt = i;
+    am.save( o );
+}
+
+am.ensureIndex( { createdAt : 1 , x : 1 } , { expireAfterSeconds : 3600 } );
+assert( m.getDB( "foo" ).getLastError() , "A1" );
+am.ensureIndex( { createdAt : 1 } , { expireAfterSeconds : 3600 } );
+assert.eq( null , m.getDB( "foo" ).getLastError() , "A2" );
+
+assert.soon( function(){ return am.count() == 2000; } , "B1" , 30000 );
+assert.eq( 0 , am.find( { createdAt : { $lt : new Date( now - 3600 * 1000 ) } } ).count() , "B2" );
+assert.eq( 1000 , am.find( { createdAt : { $type : 1 } } ).count() , "B3" );
+
+assert.soon( function(){ return as.count() == 2000; } , "C1" , 30000 );
+assert.eq( 0 , as.find( { _id : { $mod : [ 3 , 0 ] } } ).count() , "C2" );
+
+st = m.getDB( "admin" ).runCommand( { serverStatus : 1 } ).ttl;
+assert.eq( 1000 , st.deletedDocuments , "D1 " + tojson( st ) );
+assert.lt( 0 , st.passes , "D2" );
+
+rt.stop();
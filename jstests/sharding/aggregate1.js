@@ -0,0 +1,38 @@
+// aggregate on a sharded collection: shards run the first $group, mongos merges
+
+s = new ShardingTest( "aggregate1" , 2 );
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { _id : 1 } } );
+
+db = s.getDB( "test" );
+for ( var i=0; i<100; i++ )
+    db.foo.save( { _id : i , a : i % 5 , b : i } );
+
+s.adminCommand( { split : "test.foo" , middle : { _id : 50 } } );
+primary = s.getServer( "test" ).getDB( "test" );
+secondary = s.getOther( primary ).getDB( "test" );
+s.adminCommand( { movechunk : "test.foo" , find : { _id : 50 } , to : secondary.getMongo().name } );
+assert.eq( 50 , secondary.foo.count() , "setup" );
+
+function agg( pipeline ) {
+    var res = db.runCommand( { aggregate : "foo" , pipeline : pipeline } );
+    assert( res.ok , tojson( res ) );
+    return res.result;
+}
+
+r = agg( [ { $group : { _id : "$a" , total : { $sum : "$b" } , n : { $count : 1 } , avg : { $avg : "$b" } , lo : { $min : "$b" } , hi : { $max : "$b" } , bs : { $push : "$b" } } } ,
+           { $sort : { _id : 1 } } ] );
+assert.eq( 5 , r.length , "A1" );
+assert.eq( 990 , r[2].total , "A2" );
+assert.eq( 20 , r[2].n , "A3" );
+assert.eq( 49.5 , r[2].avg , "A4" );
+assert.eq( 2 , r[2].lo , "A5" );
+assert.eq( 97 , r[2].hi , "A6" );
+assert.eq( 20 , r[2].bs.length , "A7" );
+
+assert.eq( [ 99 , 98 , 97 ] , agg( [ { $sort : { b : -1 } } , { $limit : 3 } ] ).map( function(z){ return z.b; } ) , "B1" );
+assert.eq( 4 , agg( [ { $match : { _id : { $gte : 40 , $lt : 60 } } } , { $match : { a : 0 } } , { $project : { b : 1 } } ] ).length , "B2" );
+assert.eq( 40 , agg( [ { $skip : 60 } ] ).length , "B3" );
+
+s.stop();
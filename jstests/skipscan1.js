@@ -0,0 +1,35 @@
+// a range on a later field of a compound index is applied by skipping through the index
+
+t = db.skipscan1;
+t.drop();
+
+for ( var i=0; i<1000; i++ )
+    t.save( { a : i % 4 , b : i , c : i % 10 } );
+t.ensureIndex( { a : 1 , b : 1 } );
+
+function check( q , sort , n ) {
+    var c = t.find( q ).hint( { a : 1 , b : 1 } );
+    if ( sort )
+        c.sort( sort );
+    assert.eq( n , c.itcount() , tojson( q ) );
+    assert.eq( n , t.find( q ).hint( { $natural : 1 } ).itcount() , "natural " + tojson( q ) );
+    return t.find( q ).hint( { a : 1 , b : 1 } ).explain();
+}
+
+e = check( { b : { $gte : 500 , $lt : 510 } } , null , 10 );
+assert( e.cursor.match( /skip/ ) , "A1" );
+assert.gt( 100 , e.nscanned , "A2" );
+
+e = check( { a : { $gt : 0 } , b : 701 } , null , 1 );
+assert.gt( 20 , e.nscanned , "B1" );
+
+check( { b : { $gte : 500 , $lt : 510 } } , { a : -1 , b : -1 } , 10 );
+check( { b : { $in : [ 3 , 501 , 998 ] } } , null , 3 );
+check( { a : { $in : [ 1 , 3 ] } , b : { $lt : 100 } } , null , 50 );
+check( { b : { $gt : 2000 } } , null , 0 );
+
+t.dropIndexes();
+t.ensureIndex( { a : 1 , b : -1 , c : 1 } );
+assert.eq( 5 , t.find( { a : { $gte : 2 } , b : { $lt : 100 } , c : 9 } ).hint( { a : 1 , b : -1 , c : 1 } ).itcount() , "C1" );
+assert.eq( 5 , t.find( { a : { $gte : 2 } , b : { $lt : 100 } , c : 9 } ).sort( { a : -1 , b : 1 , c : -1 } ).hint( { a : 1 , b : -1 , c : 1 } ).itcount() , "C2" );
+assert.eq( 0 , t.find( { a : { $lt : 4 } , b : { $gt : 100 , $lt : 90 } } ).hint( { a : 1 , b : -1 , c : 1 } ).itcount() , "C3" );
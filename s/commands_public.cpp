@@ -23,6 +23,7 @@
 #include "../client/connpool.h"
 #include "../client/parallel.h"
 #include "../db/commands.h"
+#include "../db/pipeline.h"
 
 #include "config.h"
 #include "chunk.h"
@@ -413,6 +414,79 @@ namespace mongo {
             }
         } disinctCmd;
 
+        class AggregateCmd : public PublicGridCommand {
+        public:
+            AggregateCmd() : PublicGridCommand("aggregate"){}
+            virtual void help( stringstream &help ) const {
+                help << "{ aggregate : 'collection name' , pipeline : [ ... ] }";
+            }
+            bool run(const char *ns, BSONObj& cmdObj, string& errmsg, BSONObjBuilder& result, bool){
+                
+                string dbName = getDBName( ns );
+                string collection = cmdObj.firstElement().valuestrsafe();
+                string fullns = dbName + "." + collection;
+
+                DBConfig * conf = grid.getDBConfig( dbName , false );
+                
+                if ( ! conf || ! conf->isShardingEnabled() || ! conf->isSharded( fullns ) ){
+                    return passthrough( conf , cmdObj , result );
+                }
+                
+                ChunkManager * cm = conf->getChunkManager( fullns );
+                massert( 13127 ,  "how could chunk manager be null!" , cm );
+
+                if ( cmdObj["pipeline"].type() != Array ){
+                    errmsg = "pipeline has to be an array";
+                    return false;
+                }
+
+                // shards run everything up to the first $group (which sends partial results), we merge
+                BSONObj shardStages;
+                BSONObj mergeStages;
+                Pipeline::split( cmdObj["pipeline"].embeddedObject() , shardStages , mergeStages );
+
+                BSONObj q;
+                if ( shardStages.firstElement().type() == Object ){
+                    BSONObj first = shardStages.firstElement().embeddedObject();
+                    if ( first.firstElement().fieldName() == string( "$match" ) )
+                        q = first.firstElement().embeddedObjectUserCheck();
+                }
+
+                vector<Chunk*> chunks;
+                cm->getChunksForQuery( chunks , q );
+
+                set<string> shards;
+                for ( vector<Chunk*>::iterator i = chunks.begin() ; i != chunks.end() ; i++ )
+                    shards.insert( (*i)->getShard() );
+
+                BSONObjBuilder shardCommand;
+                shardCommand.append( "aggregate" , collection );
+                shardCommand.appendArray( "pipeline" , shardStages );
+                BSONObj shardCmd = shardCommand.obj();
+
+                list< shared_ptr<Future::CommandResult> > futures;
+                for ( set<string>::iterator i = shards.begin() ; i != shards.end() ; i++ )
+                    futures.push_back( Future::spawnCommand( *i , dbName , shardCmd ) );
+
+                Pipeline pipeline( mergeStages );
+                bool more = true;
+                for ( list< shared_ptr<Future::CommandResult> >::iterator i=futures.begin(); i!=futures.end(); i++ ){
+                    shared_ptr<Future::CommandResult> res = *i;
+                    if ( ! res->join() ){
+                        errmsg = "aggregate failed on shard: ";
+                        errmsg += res->result().toString();
+                        return false;
+                    }
+                    BSONObjIterator it( res->result()["result"].embeddedObjectUserCheck() );
+                    while ( more && it.more() )
+                        more = pipeline.add( it.next().embeddedObject() );
+                }
+
+                pipeline.done( result );
+                return true;
+            }
+        } aggregateCmd;
+
         class FileMD5Cmd : public PublicGridCommand {
         public:
             FileMD5Cmd() : PublicGridCommand("filemd5"){}
@@ -162,6 +162,9 @@ public:
 
         ProgressMeter m( fileLength );
 
+        bool isIndexes = endsWith( ns.c_str() , ".system.indexes" );
+        vector<BSONObj> indexes;
+
         while ( read < fileLength ) {
             file.read( buf , 4 );
             int size = ((int*)buf)[0];
@@ -189,7 +192,10 @@ public:
                     cerr << "\t " << e << endl;
                 }
             }
-            conn().insert( ns.c_str() , o );
+            if ( isIndexes )
+                indexes.push_back( o.getOwned() );
+            else
+                conn().insert( ns.c_str() , o );
 
             read += o.objsize();
             num++;
@@ -199,6 +205,48 @@ public:
 
         uassert( 10265 ,  "counts don't match" , m.done() == fileLength );
         out() << "\t "  << m.hits() << " objects" << endl;
+
+        if ( isIndexes )
+            createIndexes( ns , indexes );
+    }
+
+    /* build the indexes of each collection together, so the collection is only scanned once.
+       falls back to one insert per index if the server doesn't have createIndexes.
+    */
+    void createIndexes( const string& ns , const vector<BSONObj>& indexes ) {
+        string db = ns.substr( 0 , ns.find( '.' ) );
+
+        vector<string> order;
+        map< string , vector<BSONObj> > byNs;
+        for ( unsigned i=0; i<indexes.size(); i++ ){
+            string idxNs = indexes[i].getStringField( "ns" );
+            if ( byNs.count( idxNs ) == 0 )
+                order.push_back( idxNs );
+            byNs[idxNs].push_back( indexes[i] );
+        }
+
+        for ( unsigned i=0; i<order.size(); i++ ){
+            vector<BSONObj>& specs = byNs[order[i]];
+            
+            BSONObjBuilder cmd;
+            cmd.append( "createIndexes" , order[i].substr( order[i].find( '.' ) + 1 ) );
+            {
+                BSONArrayBuilder arr( cmd.subarrayStart( "indexes" ) );
+                for ( unsigned j=0; j<specs.size(); j++ )
+                    arr.append( specs[j] );
+                arr.done();
+            }
+
+            BSONObj info;
+            if ( conn().runCommand( db , cmd.obj() , info ) ){
+                out() << "\t built " << specs.size() << " indexes for " << order[i] << endl;
+                continue;
+            }
+
+            log(1) << "createIndexes failed for " << order[i] << ": " << info << ", inserting one at a time" << endl;
+            for ( unsigned j=0; j<specs.size(); j++ )
+                conn().insert( ns.c_str() , specs[j] );
+        }
     }
 };
 
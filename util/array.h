@@ -34,6 +34,12 @@ namespace mongo {
         void sort( int (*comp)(const void *, const void *) ){
             qsort( _data , _size , sizeof(T) , comp );
         }
+
+        /* comparison is a functor, so unlike qsort it can carry state (no globals) */
+        template< class Cmp >
+        void sort( const Cmp& cmp ){
+            std::sort( _data , _data + _size , cmp );
+        }
         
         int size(){
             return _size;